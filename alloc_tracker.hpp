@@ -0,0 +1,246 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Opt-in heap allocation tracking
+///
+///  Built with -DCASE_STUDY_TRACK_ALLOC this header
+///   - replaces the global operator new/delete and counts every allocation
+///     (and its size) against the innermost INSTRUMENT_SCOPE probe,
+///   - defines EIGEN_RUNTIME_NO_MALLOC and routes eigen_assert through
+///     AllocTracker, so every Eigen heap allocation (which bypasses operator
+///     new) is counted too. Eigen does not pass the size to that hook, so
+///     Eigen allocations are counted but carry no byte total,
+///   - turns REALTIME_REGION() into a guard that flags any allocation made
+///     inside it, aborting in strict mode.
+///
+///  Must be included before Eigen. Like gnuplot_i.hpp it defines non-inline
+///  functions, so include it from one translation unit per executable.
+///  Without the flag only the (unused) class and an empty REALTIME_REGION()
+///  remain.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _ALLOC_TRACKER_H_
+#define _ALLOC_TRACKER_H_
+
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+#include "instrumentation.hpp"
+
+
+#define ALLOC_UNSCOPED  (INSTRUMENT_OVERFLOW + 1)   // counter slot for allocations outside any probe
+
+
+class AllocTracker
+{
+    public:
+
+    struct Counters
+    {
+        std::atomic<uint64_t> allocs;
+        std::atomic<uint64_t> bytes;
+        std::atomic<uint64_t> frees;
+        std::atomic<uint64_t> eigenAllocs;
+        std::atomic<uint64_t> violations;   // allocations inside a real-time region
+    };
+
+    // one slot per probe id (overflow included) plus one for allocations
+    // outside any probe
+    static Counters& counters(int probe)
+    {
+        static Counters c[ALLOC_UNSCOPED + 1];
+        return c[(probe < 0 || probe > INSTRUMENT_OVERFLOW) ? ALLOC_UNSCOPED : probe];
+    }
+
+    // nesting depth of real-time regions on the calling thread
+    static inline int& realtimeDepth()
+    {
+        thread_local int depth = 0;
+        return depth;
+    }
+
+    // abort on the first allocation inside a real-time region
+    static std::atomic<bool>& strict()
+    {
+        static std::atomic<bool> s(false);
+        return s;
+    }
+
+    static inline void onAlloc(size_t bytes, bool eigen)
+    {
+        Counters &c = counters(Instrumentation::currentProbe());
+        c.allocs.fetch_add(1, std::memory_order_relaxed);
+        c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        if (eigen)
+            c.eigenAllocs.fetch_add(1, std::memory_order_relaxed);
+
+        if (realtimeDepth() > 0)
+        {
+            c.violations.fetch_add(1, std::memory_order_relaxed);
+            if (strict().load(std::memory_order_relaxed))
+            {
+                fprintf(stderr, "AllocTracker: %s allocation of %zu bytes inside a real-time region\n",
+                        eigen ? "Eigen" : "heap", bytes);
+                abort();
+            }
+        }
+    }
+
+    static inline void onFree()
+    {
+        counters(Instrumentation::currentProbe()).frees.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // eigen_assert replacement; Eigen's malloc check is the only assertion
+    // expected to fail, anything else keeps the usual assert behaviour
+    static void eigenAssert(const char *expr, const char *file, int line)
+    {
+        if (strstr(expr, "heap allocation is forbidden") != NULL)
+        {
+            onAlloc(0, true);
+            return;
+        }
+        fprintf(stderr, "%s:%d: Eigen assertion `%s' failed.\n", file, line, expr);
+        abort();
+    }
+
+    // Zeroes every counter, e.g. after a warm-up pass
+    static void reset()
+    {
+        for (int i = 0; i <= ALLOC_UNSCOPED; i++)
+        {
+            Counters &c = counters(i);
+            c.allocs = 0;
+            c.bytes = 0;
+            c.frees = 0;
+            c.eigenAllocs = 0;
+            c.violations = 0;
+        }
+    }
+
+    static uint64_t totalViolations()
+    {
+        uint64_t n = 0;
+        for (int i = 0; i <= ALLOC_UNSCOPED; i++)
+            n += counters(i).violations.load();
+        return n;
+    }
+
+    // One line per probe that allocated; allocations are attributed to the
+    // innermost probe only (exclusive totals)
+    static void report(std::ostream &out)
+    {
+        out << "Allocations per scope\n"
+            << std::setw(22) << std::left << "  scope" << std::right
+            << std::setw(10) << "allocs" << std::setw(12) << "bytes"
+            << std::setw(10) << "eigen" << std::setw(10) << "frees"
+            << std::setw(12) << "rt-allocs" << "\n";
+
+        for (int i = 0; i <= ALLOC_UNSCOPED; i++)
+        {
+            Counters &c = counters(i);
+            if (c.allocs.load() == 0 && c.frees.load() == 0)
+                continue;
+            std::string name = Instrumentation::name(i == ALLOC_UNSCOPED ? -1 : i);
+            out << "  " << std::setw(20) << std::left << name << std::right
+                << std::setw(10) << c.allocs.load() << std::setw(12) << c.bytes.load()
+                << std::setw(10) << c.eigenAllocs.load() << std::setw(10) << c.frees.load()
+                << std::setw(12) << c.violations.load() << "\n";
+        }
+    }
+
+    // Marks the enclosing scope as real-time: it must not allocate
+    class RealtimeRegion
+    {
+        public:
+        inline RealtimeRegion()  { realtimeDepth()++; }
+        inline ~RealtimeRegion() { realtimeDepth()--; }
+    };
+};
+
+
+#if defined(CASE_STUDY_TRACK_ALLOC)
+
+ #define EIGEN_RUNTIME_NO_MALLOC
+ #define eigen_assert(x) \
+    do { if (!(x)) AllocTracker::eigenAssert(#x, __FILE__, __LINE__); } while (false)
+
+ #define REALTIME_REGION() \
+    AllocTracker::RealtimeRegion INSTRUMENT_CONCAT(realtimeRegion_, __LINE__)
+
+//------------------------------------------------------------------------------
+//
+// global operator new/delete replacements
+//
+void* operator new(std::size_t size)
+{
+    AllocTracker::onAlloc(size, false);
+    void *p = std::malloc(size ? size : 1);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    AllocTracker::onAlloc(size, false);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    AllocTracker::onAlloc(size, false);
+    std::size_t a = std::size_t(align);
+    void *p = std::aligned_alloc(a, ((size ? size : 1) + a - 1) / a * a);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size, std::align_val_t align)
+{
+    return operator new(size, align);
+}
+
+void operator delete(void *p) noexcept
+{
+    if (p != NULL)
+        AllocTracker::onFree();
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept                             { operator delete(p); }
+void operator delete(void *p, std::size_t) noexcept                  { operator delete(p); }
+void operator delete[](void *p, std::size_t) noexcept                { operator delete(p); }
+void operator delete(void *p, const std::nothrow_t&) noexcept        { operator delete(p); }
+void operator delete[](void *p, const std::nothrow_t&) noexcept      { operator delete(p); }
+void operator delete(void *p, std::align_val_t) noexcept             { operator delete(p); }
+void operator delete[](void *p, std::align_val_t) noexcept           { operator delete(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept   { operator delete(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { operator delete(p); }
+
+#else
+
+ #define REALTIME_REGION()
+
+#endif
+
+#endif
@@ -0,0 +1,163 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Non-blocking plotting on a background worker
+///
+///  submit() queues a plot job and returns a future straight away; one worker
+///  thread owns a persistent gnuplot process and runs the jobs in order, so
+///  the caller never waits on gnuplot start-up, data transfer or rendering.
+///
+///  Jobs must only read data that cannot change underneath them; pass
+///  std::shared_ptr<const ...> snapshots rather than references to live
+///  state. Between jobs the session is reset (reset_all) and the output file
+///  of the previous job is closed.
+///
+///  If gnuplot cannot be started the job's future carries the
+///  GnuplotException and the next job tries again.
+///
+///  PlotterPool spreads jobs round-robin over several AsyncPlotters, so that
+///  many plots render in parallel, one gnuplot process per worker.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _ASYNC_PLOTTER_H_
+#define _ASYNC_PLOTTER_H_
+
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gnuplot_i.hpp"
+
+
+class AsyncPlotter
+{
+    public:
+
+    typedef std::function<void(Gnuplot&)> Job;
+
+    AsyncPlotter() : stop(false), worker(&AsyncPlotter::run, this) {}
+
+    // Finishes every queued job, then closes gnuplot
+    ~AsyncPlotter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    // Queues job; the future becomes ready once gnuplot has been sent the
+    // whole plot (or holds the exception the job threw)
+    std::future<void> submit(Job job)
+    {
+        Pending p;
+        p.job = std::move(job);
+        std::future<void> done = p.promise.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(p));
+        }
+        wake.notify_one();
+        return done;
+    }
+
+    // number of jobs not yet started
+    size_t pending()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue.size();
+    }
+
+    private:
+
+    struct Pending
+    {
+        Job                 job;
+        std::promise<void>  promise;
+    };
+
+        std::mutex                  mutex;
+        std::condition_variable     wake;
+        std::deque<Pending>         queue;
+        bool                        stop;
+        std::unique_ptr<Gnuplot>    gp;     // owned by the worker thread
+        std::thread                 worker; // last: starts once the rest is built
+
+    void run()
+    {
+        for (;;)
+        {
+            Pending p;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stop || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                p = std::move(queue.front());
+                queue.pop_front();
+            }
+
+            try
+            {
+                if (!gp)
+                    gp.reset(new Gnuplot());
+                else
+                    gp->reset_all();
+                p.job(*gp);
+                gp->showonscreen(); // closes the job's output file
+                p.promise.set_value();
+            }
+            catch (...)
+            {
+                p.promise.set_exception(std::current_exception());
+            }
+        }
+    }
+};
+
+
+class PlotterPool
+{
+    public:
+
+    explicit PlotterPool(size_t processes) : next(0)
+    {
+        if (processes == 0)
+            processes = 1;
+        for (size_t i = 0; i < processes; i++)
+            workers.push_back(std::unique_ptr<AsyncPlotter>(new AsyncPlotter()));
+    }
+
+    size_t size() const { return workers.size(); }
+
+    // Queues job on the next worker in turn
+    std::future<void> submit(AsyncPlotter::Job job)
+    {
+        size_t k = next.fetch_add(1, std::memory_order_relaxed) % workers.size();
+        return workers[k]->submit(std::move(job));
+    }
+
+    // Queues job on a given worker, e.g. to keep related plots together
+    std::future<void> submit(size_t worker, AsyncPlotter::Job job)
+    {
+        return workers[worker % workers.size()]->submit(std::move(job));
+    }
+
+    private:
+
+        std::vector<std::unique_ptr<AsyncPlotter> > workers;
+        std::atomic<size_t>                         next;
+};
+
+#endif
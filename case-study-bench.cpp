@@ -0,0 +1,387 @@
+// Benchmarks for the simulation, estimation and plotting paths
+//
+// Build: g++ -std=c++2b -O2 -pthread -I. case-study-bench.cpp -o case-study-bench -lbenchmark
+// Run:   ./case-study-bench --benchmark_format=json --benchmark_out=bench.json
+//        (any Google Benchmark flag works, e.g. --benchmark_filter=Filter)
+#include <fcntl.h>
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+
+#include "case-study.hpp" // simulator, lidar model, estimators and plotting
+#include "flight_recorder.hpp" // crash-safe mmap'd ring of the last N seconds
+
+typedef Eigen::Matrix<double,6,6> Matrix6d;
+typedef Eigen::Matrix<double,6,3> Matrix63d;
+typedef Eigen::Matrix<double,3,6> Matrix36d;
+typedef Eigen::Matrix<double,6,1> Vector6d;
+typedef Eigen::Matrix<double,3,1> Vector3d;
+
+
+// Simulator holds ~1 MB of telemetry; keep it off the stack
+static Simulator* benchSimulator(float clockCycle) {
+    static Simulator *sim = new Simulator();
+    // setSystemAttributes(clockCycle, lidarMinRange, singleSampleErrorOffset, multipathErrorOffset, multipathErrorDuration);
+    sim->setSystemAttributes(clockCycle, 10.0, 1.0, 0.5, 0.25);
+    sim->setTransAttributes(30.0, 0.0, -1.0, 1000.0, 30.0);
+    sim->setAccelAttributes(0.0, 10.0, 2.0);
+    sim->setDecelAttributes(50.0, 0.5);
+    return sim;
+}
+
+static void benchEstimator(Estimator3DoF &est, const Simulator &sim) {
+    configureEstimator3DoF(est, sim);
+    MatrixXd x0 = MatrixXd(6,1);
+    x0 << 0.0, 0.0, sim.transCruiseAltitude, sim.transInitVelocity, 0.0, 0.0;
+    est.setInitialState(x0, MatrixXd::Identity(6,6));
+}
+
+
+// ---------------------
+// Simulation
+// ---------------------
+
+// Arg: clock cycle in ms
+static void BM_GenSimData(benchmark::State &state) {
+    Simulator *sim = benchSimulator(state.range(0)*1e-3);
+
+    cout.setstate(ios_base::badbit); // silence "VEHICLE HAS LANDED"
+    for (auto _ : state) {
+        sim->genSimData();
+        benchmark::ClobberMemory();
+    }
+    cout.clear();
+
+    state.SetItemsProcessed(state.iterations()*sim->nSamples);
+    state.counters["samples"] = sim->nSamples;
+}
+BENCHMARK(BM_GenSimData)->Arg(500)->Arg(100)->Arg(50)->Arg(10)->Unit(benchmark::kMicrosecond);
+
+
+// ---------------------
+// Estimation
+// ---------------------
+
+static void BM_EstimateState_MatrixXd(benchmark::State &state) {
+    Estimator3DoF est;
+    benchEstimator(est, *benchSimulator(0.5));
+    MatrixXd x = MatrixXd::Random(6,1);
+    MatrixXd u = MatrixXd::Zero(3,1);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(est.estimateState(x, u));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_EstimateState_MatrixXd);
+
+static void BM_EstimateState_Fixed(benchmark::State &state) {
+    Estimator3DoF est;
+    benchEstimator(est, *benchSimulator(0.5));
+    Matrix6d  F = est.F;
+    Matrix63d G = est.G;
+    Vector6d  x = Vector6d::Random();
+    Vector3d  u = Vector3d::Zero();
+
+    for (auto _ : state) {
+        Vector6d X = F*x + G*u;
+        benchmark::DoNotOptimize(X);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_EstimateState_Fixed);
+
+// One predict/update cycle of the 6x6 filter
+static void BM_FilterStep_MatrixXd(benchmark::State &state) {
+    Estimator3DoF est;
+    benchEstimator(est, *benchSimulator(0.5));
+    MatrixXd u = MatrixXd::Zero(3,1);
+    MatrixXd z = MatrixXd(3,1);
+    z << 0.0, 0.0, 1000.0;
+
+    for (auto _ : state) {
+        est.predict(u);
+        est.update(z);
+        benchmark::DoNotOptimize(est._X.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FilterStep_MatrixXd);
+
+// Same cycle written against fixed-size matrices, for comparison
+static void BM_FilterStep_Fixed(benchmark::State &state) {
+    Estimator3DoF est;
+    benchEstimator(est, *benchSimulator(0.5));
+    Matrix6d  F = est.F, Q = est.Q, P = est.P;
+    Matrix63d G = est.G;
+    Matrix36d H = est.H;
+    Eigen::Matrix3d R = est.R;
+    Vector6d  X = est._X;
+    Vector3d  u = Vector3d::Zero();
+    Vector3d  z(0.0, 0.0, 1000.0);
+
+    for (auto _ : state) {
+        X = F*X + G*u;
+        P = F*P*F.transpose() + Q;
+        Eigen::Matrix<double,6,3> K = P*H.transpose()*(H*P*H.transpose() + R).inverse();
+        X = X + K*(z - H*X);
+        P = (Matrix6d::Identity() - K*H)*P;
+        benchmark::DoNotOptimize(X.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FilterStep_Fixed);
+
+// Whole landing through runEstimator; Arg: clock cycle in ms
+static void BM_RunEstimator(benchmark::State &state) {
+    Simulator *sim = benchSimulator(state.range(0)*1e-3);
+    cout.setstate(ios_base::badbit);
+    sim->genSimData();
+    cout.clear();
+
+    Estimator3DoF est;
+    for (auto _ : state) {
+        benchEstimator(est, *sim);
+        runEstimator(*sim, est, 0, sim->nSamples);
+    }
+    state.SetItemsProcessed(state.iterations()*sim->nSamples);
+}
+BENCHMARK(BM_RunEstimator)->Arg(500)->Arg(100)->Arg(10)->Unit(benchmark::kMicrosecond);
+
+
+// ---------------------
+// Plotting
+// ---------------------
+
+// Full-resolution telemetry copy-out; Arg: number of samples
+static void BM_TelemetryCopyOut(benchmark::State &state) {
+    Simulator *sim = benchSimulator(0.5);
+    for (auto _ : state) {
+        vector<float> t, x, y, z;
+        copyTelemetryColumns(*sim, state.range(0), t, x, y, z);
+        benchmark::DoNotOptimize(z.data());
+    }
+    state.SetItemsProcessed(state.iterations()*state.range(0));
+}
+BENCHMARK(BM_TelemetryCopyOut)->RangeMultiplier(4)->Range(1024, NPOINTS);
+
+// Reduction of n points to PLOT_MAX_POINTS before plotting; Arg: number of points
+static void benchDownsample(benchmark::State &state, Downsample::Method method) {
+    vector<float> x(state.range(0)), y(state.range(0));
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = 0.1f*i;
+        y[i] = 1000.0f*cos(1e-5f*i) + (i % 7);
+    }
+    vector<size_t> keep, idx;
+    keep.push_back(x.size()/2);
+
+    for (auto _ : state) {
+        Downsample::select(&x[0], &y[0], x.size(), PLOT_MAX_POINTS, method, keep, idx);
+        benchmark::DoNotOptimize(idx.data());
+    }
+    state.SetItemsProcessed(state.iterations()*state.range(0));
+}
+
+static void BM_Downsample_LTTB(benchmark::State &state)   { benchDownsample(state, Downsample::LTTB); }
+static void BM_Downsample_MinMax(benchmark::State &state) { benchDownsample(state, Downsample::MIN_MAX); }
+BENCHMARK(BM_Downsample_LTTB)->RangeMultiplier(10)->Range(10000, 10000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Downsample_MinMax)->RangeMultiplier(10)->Range(10000, 10000000)->Unit(benchmark::kMicrosecond);
+
+// Packing/unpacking one 100 Hz landing column; Arg: telemetry state index
+static void BM_TelemetryEncode(benchmark::State &state) {
+    Simulator *sim = benchSimulator(0.01);
+    cout.setstate(ios_base::badbit);
+    sim->genSimData();
+    cout.clear();
+    vector<uint32_t> packed;
+    for (auto _ : state) {
+        packed.clear();
+        TelemetryCodec::encode(sim->vehicleTelemetry[state.range(0)], sim->nSamples, packed);
+        benchmark::DoNotOptimize(packed.data());
+    }
+    state.SetBytesProcessed(state.iterations()*sim->nSamples*sizeof(float));
+    state.counters["ratio"] = double(sim->nSamples*sizeof(float)) / TelemetryCodec::bytes(&packed[0]);
+}
+BENCHMARK(BM_TelemetryEncode)->DenseRange(0, 3);
+
+static void BM_TelemetryDecode(benchmark::State &state) {
+    Simulator *sim = benchSimulator(0.01);
+    cout.setstate(ios_base::badbit);
+    sim->genSimData();
+    cout.clear();
+    vector<uint32_t> packed;
+    TelemetryCodec::encode(sim->vehicleTelemetry[state.range(0)], sim->nSamples, packed);
+    vector<float> out(sim->nSamples);
+    for (auto _ : state) {
+        TelemetryCodec::decode(&packed[0], 0, out.size(), &out[0]);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations()*sim->nSamples*sizeof(float));
+}
+BENCHMARK(BM_TelemetryDecode)->DenseRange(0, 3);
+
+// Flight recorder append with a warm cache (back to back, no real-time
+// sleep between records); Arg: floats per record
+static void BM_FlightRecorderAppend(benchmark::State &state) {
+    vector<string> fields(state.range(0), "f");
+    vector<float> record(state.range(0), 1.0f);
+    FlightRecorder recorder;
+    if (!recorder.open("bench_flight.rec", fields, 100000)) {
+        state.SkipWithError(recorder.error.c_str());
+        return;
+    }
+    for (auto _ : state) {
+        recorder.append(&record[0]);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+    recorder.close();
+    remove("bench_flight.rec");
+}
+BENCHMARK(BM_FlightRecorderAppend)->Arg(4)->Arg(14)->Arg(32);
+
+// CSV export of 14 columns x 100k rows to /dev/null (formatting and write
+// calls only); Arg: precision, -1 = shortest round trip
+static void BM_CsvExport(benchmark::State &state) {
+    const size_t rows = 100000;
+    vector<vector<float> > data(2*NSTATES, vector<float>(rows));
+    vector<const float*> columns;
+    vector<string> names;
+    for (int k = 0; k < 2*NSTATES; k++) {
+        for (size_t i = 0; i < rows; i++)
+            data[k][i] = 1000.0f*cos(1e-4f*i + k);
+        columns.push_back(&data[k][0]);
+        names.push_back(telemetryColumns[k]);
+    }
+    size_t bytes = 0;
+    for (auto _ : state) {
+        TelemetryCsv::write("/dev/null", names, columns, rows, state.range(0));
+    }
+    char buf[64];
+    for (size_t i = 0; i < rows; i++)
+        for (int k = 0; k < 2*NSTATES; k++)
+            bytes += TelemetryCsv::formatValue(buf, data[k][i], state.range(0)) - buf + 1;
+    state.SetBytesProcessed(state.iterations()*bytes);
+}
+BENCHMARK(BM_CsvExport)->Arg(-1)->Arg(4)->Unit(benchmark::kMillisecond);
+
+// A by-value Simulator copy, as the plot functions used to make on entry
+static void BM_SimulatorCopy(benchmark::State &state) {
+    Simulator *sim  = benchSimulator(0.5);
+    Simulator *copy = new Simulator();
+    for (auto _ : state) {
+        *copy = *sim;
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations()*sizeof(Simulator));
+    delete copy;
+}
+BENCHMARK(BM_SimulatorCopy);
+
+// Text tmpfile writing as done by Gnuplot::plot_xy (mkstemp + ofstream,
+// one formatted "x y" line per point); Arg: number of points
+static void BM_GnuplotTmpfileWrite(benchmark::State &state) {
+    vector<float> x(state.range(0)), y(state.range(0));
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = 0.1f*i;
+        y[i] = 1000.0f - 0.05f*i;
+    }
+
+    long long bytes = 0;
+    for (auto _ : state) {
+        char name[] = "/tmp/gnuplotiXXXXXX";
+        int fd = mkstemp(name);
+        std::ofstream tmp(name);
+        for (unsigned int i = 0; i < x.size(); i++)
+            tmp << x[i] << " " << y[i] << std::endl;
+        tmp.flush();
+        bytes += tmp.tellp();
+        tmp.close();
+        close(fd);
+        remove(name);
+    }
+    state.SetItemsProcessed(state.iterations()*state.range(0));
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_GnuplotTmpfileWrite)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+
+
+// End-to-end plot through a gnuplot process that renders to the "unknown"
+// terminal; the destructor's pclose() waits until gnuplot has read and
+// plotted everything. Skipped when gnuplot cannot be started.
+template<typename PlotFn>
+static void benchPlot(benchmark::State &state, PlotFn plot) {
+    for (auto _ : state) {
+        try {
+            Gnuplot gp("points");
+            gp.cmd("set terminal unknown");
+            plot(gp);
+        }
+        catch (GnuplotException ge) {
+            state.SkipWithError(ge.what());
+            break;
+        }
+    }
+}
+
+// Arg: number of points
+static void benchPoints(benchmark::State &state, vector<float> &x, vector<float> &y) {
+    x.resize(state.range(0));
+    y.resize(state.range(0));
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = 0.1f*i;
+        y[i] = 1000.0f - 0.05f*i;
+    }
+    state.SetItemsProcessed(3*state.range(0)); // Iterations(3)
+}
+
+// Text tmpfile path
+static void BM_PlotXY_Text(benchmark::State &state) {
+    vector<float> x, y;
+    benchPoints(state, x, y);
+    benchPlot(state, [&](Gnuplot &gp) { gp.plot_xy(x, y, "text"); });
+}
+BENCHMARK(BM_PlotXY_Text)->RangeMultiplier(10)->Range(10000, 10000000)->Iterations(3)->Unit(benchmark::kMillisecond);
+
+// Inline binary through the pipe: no tmpfile, no formatting
+static void BM_PlotXY_Binary(benchmark::State &state) {
+    vector<float> x, y;
+    benchPoints(state, x, y);
+    benchPlot(state, [&](Gnuplot &gp) { gp.plot_xy_binary(x, y, "binary"); });
+}
+BENCHMARK(BM_PlotXY_Binary)->RangeMultiplier(10)->Range(10000, 10000000)->Iterations(3)->Unit(benchmark::kMillisecond);
+
+// Overlaid landings of 100 points each; Arg: number of landings
+static void benchLandings(benchmark::State &state, vector<vector<float> > &x, vector<vector<float> > &y) {
+    x.assign(state.range(0), vector<float>(100));
+    y.assign(state.range(0), vector<float>(100));
+    for (size_t s = 0; s < x.size(); s++) {
+        for (size_t i = 0; i < 100; i++) {
+            x[s][i] = 0.1f*i + s;
+            y[s][i] = 1000.0f - 10.0f*i;
+        }
+    }
+    state.SetItemsProcessed(3*state.range(0)); // Iterations(3)
+}
+
+// One plot_xy (one tmpfile, one plot element) per landing; a session can
+// hold at most GP_MAX_TMP_FILES of them
+static void BM_PlotLandings_PerSeries(benchmark::State &state) {
+    vector<vector<float> > x, y;
+    benchLandings(state, x, y);
+    benchPlot(state, [&](Gnuplot &gp) {
+        for (size_t s = 0; s < x.size(); s++)
+            gp.plot_xy(x[s], y[s]);
+    });
+}
+BENCHMARK(BM_PlotLandings_PerSeries)->Arg(10)->Arg(50)->Iterations(3)->Unit(benchmark::kMillisecond);
+
+// All landings in one tmpfile, parsed once
+static void BM_PlotLandings_OneFile(benchmark::State &state) {
+    vector<vector<float> > x, y;
+    benchLandings(state, x, y);
+    benchPlot(state, [&](Gnuplot &gp) { gp.plot_xy_series(x, y, "landings"); });
+}
+BENCHMARK(BM_PlotLandings_OneFile)->Arg(10)->Arg(50)->Arg(10000)->Iterations(3)->Unit(benchmark::kMillisecond);
+
+
+BENCHMARK_MAIN();
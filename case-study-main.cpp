@@ -1,308 +1,1717 @@
-#include <cmath>
-#include <iostream>
-#include <Eigen/Dense>   // matrix manipulation library
-
-#include "gnuplot_i.hpp" // Gnuplot class handles POSIX-Pipe-communication with Gnuplot
-
-using namespace std;
-using Eigen::MatrixXd;
-
-#define NSTATES 7 // time + number of vehicle states considered
-#define NPOINTS 18000 // number of samples points require for 30min @10Hz sampling rate
-#define PI 3.14159
-#define g 9.81
-
-/*
-Vehicle landing profile:
----P1--->
-        |
-        P2
-        |
-        v
-        |
-        P3
-        |
-        v
-        |
-        P4
-        |
-        v
-        _
-*/
-class Simulator {
-    // TODO: if time, create proper get/set methods
-    public:
-        float clockCycle; 
-
-        // System attributes
-        float lidarMinRange;
-        float singleSampleErrorOffset;
-        float multipathErrorOffset; 
-        float multipathErrorDuration;
-
-        // Phase 1: transition phase attributes
-        float transInitVelocity;
-        float transFinalVelocity;
-        float transDecel;
-        float transCruiseAltitude; 
-        float transHeadingAngle;
-
-        // Phase 2: acceleration/hover phase attributes
-        float hoverAccel; 
-        float hoverInitVelocity;
-        float hoverFinalVelocity;  
-
-        // Phase 3: deceleration/touchdown phase attributes
-        float descentTargetAltitude; 
-        float descentFinalVelocity; // aiming for low touchdown impact g
-
-        // TODO: if time, fix up creation of telemetry data i.e dynamic implementation
-        float vehicleTelemetry[NSTATES][NPOINTS];
-        float predVehicleState[NSTATES][NPOINTS];
-
-        // Set system attributes method
-        void setSystemAttributes(float a, float b, float c, float d, float e) {
-            clockCycle              = a; 
-            lidarMinRange           = b;
-            singleSampleErrorOffset = c;
-            multipathErrorOffset    = d;
-            multipathErrorDuration  = e;
-        }
-
-        // Phase 1 method
-        void setTransAttributes(float a, float b, float c, float d, float e) {
-            transInitVelocity   = a; 
-            transFinalVelocity  = b;
-            transDecel          = c;
-            transCruiseAltitude = d;
-            transHeadingAngle   = e;
-        }
-
-        // Phase 2 method
-        void setAccelAttributes(float x, float y, float z) {
-            hoverInitVelocity  = x;
-            hoverFinalVelocity = y;
-            hoverAccel         = z; 
-        }
-
-        // Phase 3
-        // Constant velocity; no attributes
-
-        // Phase 4 method
-        // Assuming that vehicle will have decelerated to final velocity at z ~= 0.0
-        void setDecelAttributes(float x, float y) {
-            descentTargetAltitude = x;
-            descentFinalVelocity  = y;
-        }
-
-        // Outside method declaration
-        void genSimData();
+#include <thread>
+#include <filesystem>
+#include <csignal>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "case-study.hpp" // simulator, lidar model, estimators and plotting
+#include "spsc_ring.hpp" // lock-free queues between pipeline stages
+#include "rt_executor.hpp" // periodic deadline-driven execution
+#include "live_plotter.hpp" // throttled live plot fed from the estimation loop
+#include "density_raster.hpp" // multithreaded point binning straight to PNG
+#include "flight_recorder.hpp" // crash-safe mmap'd ring of the last N seconds
+#include "log_replay.hpp" // prefetching replay source for recorded logs
+#include "telemetry_stream.hpp" // double-buffered chunked reads of logs of any length
+
+
+// What-if replay: how would the estimate have evolved had the lidar dropped out
+// over [dropStart, dropEnd)? Rewinds to the nearest checkpoint instead of t=0
+// and reports snapshot cost and time-to-answer against a full re-run
+void whatIfDropout(Simulator &data, Estimator3DoF &est, const MatrixXd &x0, const MatrixXd &P0,
+                   int dropStart, int dropEnd, int interval) {
+    using namespace std::chrono;
+
+    // Baseline run, indexing a checkpoint every `interval` steps
+    EstimatorCheckpoints checkpoints;
+    if (!checkpoints.setInterval(interval)) {
+        cout << "checkpoint interval must be positive\n";
+        return;
+    }
+    est.setInitialState(x0, P0);
+    runEstimator(data, est, 0, data.nSamples, -1, -1, &checkpoints);
+
+    // Snapshot/restore cost
+    const int nReps = 100000;
+    Estimator3DoFSnapshot s;
+    auto t0 = steady_clock::now();
+    for (int i = 0; i < nReps; i++) {
+        s = est.snapshot();
+    }
+    auto t1 = steady_clock::now();
+    for (int i = 0; i < nReps; i++) {
+        est.restore(s);
+    }
+    auto t2 = steady_clock::now();
+
+    // What-if from the nearest checkpoint
+    Estimator3DoFSnapshot start;
+    if (!checkpoints.nearest(dropStart, start)) {
+        cout << "no checkpoints recorded\n";
+        return;
+    }
+    auto t3 = steady_clock::now();
+    est.restore(start);
+    runEstimator(data, est, est.step, data.nSamples, dropStart, dropEnd);
+    auto t4 = steady_clock::now();
+    MatrixXd rewound = est._X;
+
+    // Same question answered by re-running from t=0
+    est.setInitialState(x0, P0);
+    runEstimator(data, est, 0, data.nSamples, dropStart, dropEnd);
+    auto t5 = steady_clock::now();
+
+    cout << "What-if lidar dropout over samples [" << dropStart << ", " << dropEnd << ")\n";
+    cout << "  snapshot size       : " << sizeof(Estimator3DoFSnapshot) << " bytes\n";
+    cout << "  checkpoints         : " << checkpoints.snapshots.size() << " (every " << interval << " steps)\n";
+    cout << "  snapshot            : " << duration<double, std::nano>(t1 - t0).count()/nReps << " ns\n";
+    cout << "  restore             : " << duration<double, std::nano>(t2 - t1).count()/nReps << " ns\n";
+    cout << "  time-to-answer      : " << duration<double, std::micro>(t4 - t3).count() << " us (checkpoint)\n";
+    cout << "  time-to-answer      : " << duration<double, std::micro>(t5 - t4).count() << " us (full re-run)\n";
+    cout << "  final state mismatch: " << (rewound - est._X).norm() << "\n";
+}
+
+
+// One sample travelling through the pipeline runtime
+struct PipelineSample {
+    long long stamp;          // creation time (steady_clock, ns)
+    float     state[NSTATES]; // true telemetry column
+    float     lidar[3];       // measured position
+    bool      valid;          // lidar return available
+    bool      restart;        // first sample of a restarted landing profile
+    float     est[6];         // filter estimate
+};
+
+// Per-stage statistics reported by the pipeline runtime
+struct StageStats {
+    const char *name         = "";
+    long        items        = 0;
+    double      seconds      = 0.0; // stage lifetime
+    double      stallSeconds = 0.0; // time spent waiting on an empty input or full output queue
+    double      occupancySum = 0.0; // input queue occupancy, sampled once per batch
+    long        occupancyN   = 0;
+    size_t      occupancyMax = 0;
 };
 
+// Blocking batch push; spins (yielding) while the downstream queue is full
+static void pushBatch(SpscRing<PipelineSample> &q, const PipelineSample *items, size_t n, StageStats &stats) {
+    size_t sent = q.push(items, n);
+    if (sent == n) {
+        return;
+    }
+    long long t0 = nowNs();
+    while (sent < n) {
+        std::this_thread::yield();
+        sent += q.push(items + sent, n - sent);
+    }
+    stats.stallSeconds += (nowNs() - t0)*1e-9;
+}
 
-// Method generates simulation timeseries data 
-void Simulator::genSimData() {
-    int index = 0;
-    float t = 0.0;
-    float dt = clockCycle;
-    float x = 0.0, y = 0.0, z = 0.0;
-    float x_K1 = 0.0, y_K1 = 0.0, z_K1 = transCruiseAltitude;
-    float vx = 0.0, vy = 0.0, vz = 0.0;
-    float vx_K1 = transInitVelocity, vy_K1 = 0.0, vz_K1 = 0.0;
-
-    // ---------------------
-    // In this section, calculate the guards/time limits for each landing phase
-    // ---------------------
-    // t = (v-u)/a
-    float timeGuardP1 = abs((transFinalVelocity-transInitVelocity) / transDecel);
-    //float remP1       = remainder(timeEndP1, clockCycle);
-    //float timeGuardP1 = (timeEndP1 - remP1) + clockCycle; // wait for completion of clock cycle once phase end time is reached
-
-    // t = (v-u)/a
-    // s = ut + 0.5*at^2
-    float timeGuardP2 = abs((hoverFinalVelocity-hoverInitVelocity) / hoverAccel); 
-    float totalDistP2 = hoverInitVelocity*timeGuardP2 + 0.5*hoverAccel*pow(timeGuardP2,2);
-
-    // t = (total-s2-s1)/(0.5*(u+v))
-    float timeGuardP3 = (transCruiseAltitude - totalDistP2 - descentTargetAltitude)/(hoverFinalVelocity);
-
-    // t = 2s/(u+v)
-    float timeGuardP4  = 2.0*descentTargetAltitude/(hoverFinalVelocity + descentFinalVelocity);
-    float descentDecel = (descentFinalVelocity - hoverFinalVelocity)/timeGuardP4;
-
-    // This is the total duration of the landing phase
-    float totalTimeGuard = timeGuardP1 + timeGuardP2 + timeGuardP3 + timeGuardP4;
-
-    // ---------------------
-    // In this section, establish the landing telemetry
-    // Variables with _K1 addendum are used to store previous value
-    // ---------------------
-    while (t < totalTimeGuard) {
-        index++;
-        t += clockCycle;
-
-        if (t < timeGuardP1) {
-            x  = vx_K1*dt + 0.5*transDecel*pow(dt,2);
-            vx = (vx_K1 + transDecel*dt);//*cos(double(PI*transHeadingAngle/180.0));
-
-            y  = vy_K1*dt + 0.5*transDecel*pow(dt,2);
-            vy = (vy_K1 + transDecel*dt);//*sin(double(PI*transHeadingAngle/180.0));
-            //cout << "PHASE 1: \n";
-        }
-        else if (t < (timeGuardP1 + timeGuardP2)) {
-            x  = 0.0;
-            y  = 0.0;
-            z  = vz_K1*dt + 0.5*hoverAccel*pow(dt,2);
-            vz = vz_K1 + hoverAccel*dt;
-            //cout << "PHASE 2: \n";
-        }
-        else if (t < (timeGuardP1 + timeGuardP2 + timeGuardP3)) {
-            x  = 0.0;
-            y  = 0.0;
-            z  = vz_K1*dt;
-            vz = vz_K1;
-            //cout << "PHASE 3: \n";
-        }
-        else if (t < (timeGuardP1 + timeGuardP2 + timeGuardP3 + timeGuardP4)) {
-            x  = 0.0;
-            y  = 0.0;
-            z  = vz_K1*dt + 0.5*descentDecel*pow(dt,2);
-            vz = vz_K1 + descentDecel*dt;
-            //cout << "PHASE 4: \n";
+// Generic transform stage: pops batches from `in`, applies `process` to each
+// sample and forwards the batch to `out` (NULL for a sink)
+template<typename Process>
+void runStage(SpscRing<PipelineSample> &in, SpscRing<PipelineSample> *out, size_t batch,
+              StageStats &stats, Process process) {
+    vector<PipelineSample> items(batch);
+    long long start = nowNs();
+
+    while (true) {
+        size_t occupancy = in.size();
+        size_t n = in.pop(items.data(), batch);
+        if (n == 0) {
+            if (in.drained()) {
+                break;
+            }
+            long long t0 = nowNs();
+            std::this_thread::yield();
+            stats.stallSeconds += (nowNs() - t0)*1e-9;
+            continue;
         }
-        else {
-            x = y = z = 0.0;
-            // pass
-        }
-        
-        // Set the time stamp
-        vehicleTelemetry[0][index] = t;
-        // Set the x coordinate
-        vehicleTelemetry[1][index] = x_K1 + x;
-        x_K1  = x_K1 + x; // store previous value of x
-        vx_K1 = vx;
-        // Set the y coordinate
-        vehicleTelemetry[2][index] = y_K1 + y; // TODO: idealisation of landing sequence; assuming heading is 0
-        y_K1  = y_K1 + y; // store previous value of y
-        vy_K1 = vy;
-        // Set the z coordinate
-        vehicleTelemetry[3][index] = z_K1 - z;
-        z_K1  = z_K1 - z; // store previous value of z
-        vz_K1 = vz;
-        //cout << z_K1 << "\n";
-    }
-    cout << "VEHICLE HAS LANDED" << "\n";
-};
+        stats.occupancySum += occupancy;
+        stats.occupancyN++;
+        stats.occupancyMax = max(stats.occupancyMax, occupancy);
+
+        for (size_t i = 0; i < n; i++) {
+            process(items[i]);
+        }
+        stats.items += n;
+        if (out != NULL) {
+            pushBatch(*out, items.data(), n, stats);
+        }
+    }
+    if (out != NULL) {
+        out->close();
+    }
+    stats.seconds = (nowNs() - start)*1e-9;
+}
+
+// Staged pipeline: simulator -> lidar error model -> estimator -> sink
+// Each stage runs on its own thread, connected by bounded SPSC rings, so the
+// run completes in roughly the time of the slowest stage. The simulator
+// restarts the landing profile until nTotal samples have been produced.
+// With threaded == false the same stages run back-to-back on the calling thread.
+void runPipeline(const Simulator &sim, Estimator3DoF &est, const MatrixXd &x0, const MatrixXd &P0,
+                 long nTotal, size_t batch, size_t queueSize, bool threaded) {
+    SimulatorStream stream;
+    LidarErrorModel lidar;
+    stream.init(sim);
+    lidar.init(sim);
+    est.setInitialState(x0, P0);
+
+    MatrixXd u = MatrixXd::Zero(3,1);
+    MatrixXd z = MatrixXd(3,1);
+    vector<long long> latency;
+    latency.reserve(nTotal);
+    double sqErr = 0.0;
+
+    // Stage bodies, shared by the threaded and serial runs
+    auto simulate = [&](PipelineSample &p) {
+        p.restart = !stream.next(p.state);
+        if (p.restart) {
+            stream.init(sim);
+            stream.next(p.state);
+        }
+        p.stamp = nowNs();
+    };
+    auto measure = [&](PipelineSample &p) {
+        p.valid = lidar.measure(p.state, p.lidar);
+    };
+    auto estimate = [&](PipelineSample &p) {
+        // a new landing starts back at altitude; so does the filter
+        if (p.restart) {
+            est.setInitialState(x0, P0);
+        }
+        est.predict(u);
+        if (p.valid) {
+            z << p.lidar[0], p.lidar[1], p.lidar[2];
+            est.update(z);
+        }
+        for (int j = 0; j < 6; j++) {
+            p.est[j] = est._X(j,0);
+        }
+    };
+    auto sink = [&](PipelineSample &p) {
+        sqErr += pow(p.est[2] - p.state[3], 2);
+        latency.push_back(nowNs() - p.stamp);
+    };
+
+    StageStats stats[4];
+    stats[0].name = "simulator";
+    stats[1].name = "lidar";
+    stats[2].name = "estimator";
+    stats[3].name = "sink";
 
+    long long start = nowNs();
+    if (threaded) {
+        SpscRing<PipelineSample> q1(queueSize), q2(queueSize), q3(queueSize);
 
-// Kalman filter class
-// 3DoF model
-class Estimator3DoF {
-    public:
-        MatrixXd F  = MatrixXd(6,6);
-        MatrixXd G  = MatrixXd(6,3);
-        MatrixXd _X = MatrixXd(6,1);
+        std::thread source([&]() {
+            vector<PipelineSample> items(batch);
+            long long t0 = nowNs();
+            for (long produced = 0; produced < nTotal; ) {
+                size_t n = min<long>(batch, nTotal - produced);
+                for (size_t i = 0; i < n; i++) {
+                    simulate(items[i]);
+                }
+                pushBatch(q1, items.data(), n, stats[0]);
+                produced += n;
+            }
+            q1.close();
+            stats[0].items   = nTotal;
+            stats[0].seconds = (nowNs() - t0)*1e-9;
+        });
+        std::thread lidarStage([&]() { runStage(q1, &q2, batch, stats[1], measure); });
+        std::thread estStage([&]()   { runStage(q2, &q3, batch, stats[2], estimate); });
+        runStage(q3, (SpscRing<PipelineSample>*)NULL, batch, stats[3], sink);
 
-    void setStateAttributes (MatrixXd x, MatrixXd y) {
-        F = x;
-        G = y;
+        source.join();
+        lidarStage.join();
+        estStage.join();
     }
+    else {
+        PipelineSample p;
+        for (long i = 0; i < nTotal; i++) {
+            simulate(p);
+            measure(p);
+            estimate(p);
+            sink(p);
+        }
+        for (int k = 0; k < 4; k++) {
+            stats[k].items = nTotal;
+        }
+    }
+    double total = (nowNs() - start)*1e-9;
 
-    // Class evaluates the state extrapolation equation  
-    MatrixXd estimateState (MatrixXd x, MatrixXd u) {
-        _X = F*x + G*u;
-        return _X;
+    sort(latency.begin(), latency.end());
+    cout << (threaded ? "Threaded" : "Serial") << " pipeline: " << nTotal << " samples in "
+         << total << " s (" << nTotal/total << " samples/s), altitude RMSE "
+         << sqrt(sqErr/nTotal) << " m\n";
+    if (threaded) {
+        cout << "  stage       samples/s   stall[s]  queue-in avg/max\n";
+        for (int k = 0; k < 4; k++) {
+            cout << "  " << stats[k].name << "\t" << stats[k].items/stats[k].seconds
+                 << "\t" << stats[k].stallSeconds;
+            if (stats[k].occupancyN > 0) {
+                cout << "\t" << stats[k].occupancySum/stats[k].occupancyN << "/" << stats[k].occupancyMax;
+            }
+            cout << "\n";
+        }
     }
-};
+    if (!latency.empty()) {
+        cout << "  end-to-end latency p50/p99/max: "
+             << latency[latency.size()/2]*1e-3 << " / "
+             << latency[size_t(latency.size()*0.99)]*1e-3 << " / "
+             << latency.back()*1e-3 << " us\n";
+    }
+}
 
 
-// Kalman filter class
-// 6DoF model
-class Estimator6DoF {
-    public:
-        // pass
+// Flight recorder record of one real-time cycle
+#define FLIGHT_RECORDS 14
+static const char *flightFields[FLIGHT_RECORDS] = {
+    "t", "x", "y", "z", "lidar.x", "lidar.y", "lidar.z", "lidar.valid",
+    "est.x", "est.y", "est.z", "est.vx", "est.vy", "est.vz"
 };
 
+static inline void flightRecord(const float *sample, const float *meas, bool valid,
+                                const Estimator3DoF &est, float *record) {
+    for (int k = 0; k < 4; k++)
+        record[k] = sample[k];
+    for (int k = 0; k < 3; k++)
+        record[4 + k] = meas[k];
+    record[7] = valid ? 1.0f : 0.0f;
+    for (int k = 0; k < 6; k++)
+        record[8 + k] = float(est._X(k,0));
+}
+
+// Real-time execution of the estimation loop
+// One lidar sample and one predict/update per period, released on absolute
+// deadlines; reports exec time, jitter, deadline misses and worst-case margin
+// With live set, every cycle also pushes true and estimated altitude to it
+void runRealtime(Simulator &sim, double rateHz, long nCycles, int cpu, int fifoPriority, bool lockMemory,
+                 LivePlotter *live = NULL, FlightRecorder *recorder = NULL) {
+    sim.clockCycle = 1.0/rateHz;
+
+    Estimator3DoF   est;
+    SimulatorStream stream;
+    LidarErrorModel lidar;
+    configureEstimator3DoF(est, sim);
+    stream.init(sim);
+    lidar.init(sim);
+
+    MatrixXd x0 = MatrixXd(6,1);
+    x0 << 0.0, 0.0, sim.transCruiseAltitude, sim.transInitVelocity, 0.0, 0.0;
+    est.setInitialState(x0, MatrixXd::Identity(6,6));
 
-// Vehicle parameter class
-// https://sci-hub.se/10.1109/control.2014.6915128
-// TODO; this class is potentially not required; depending on the state model
-class Vehicle {
-    public:
-        float Jxx; 
-        float Jyy; 
-        float Jzz;
-        float m;
-    
-    void setVehicleAttributes(double x, double y, double z, double a) {
-        Jxx = x; 
-        Jyy = y; 
-        Jzz = z;
-        m   = a; 
+    // Everything the cycle touches is allocated up front
+    float sample[NSTATES];
+    float meas[3];
+    MatrixXd u = MatrixXd::Zero(3,1);
+    MatrixXd z = MatrixXd(3,1);
+    float record[FLIGHT_RECORDS];
+    unique_ptr<Instrumentation::Histogram> appendTicks(new Instrumentation::Histogram());
+    memset(appendTicks.get(), 0, sizeof(Instrumentation::Histogram));
+
+    RtExecutor rt(rateHz, cpu, fifoPriority, lockMemory);
+    long long startNs = nowNs();
+    uint64_t startTicks = Instrumentation::ticks();
+    rt.run(nCycles, [&]() {
+        INSTRUMENT_SCOPE("rt.cycle");
+        REALTIME_REGION();
+        if (!stream.next(sample)) {
+            stream.init(sim);
+            stream.next(sample);
+        }
+        bool valid = lidar.measure(sample, meas);
+        est.predict(u);
+        if (valid) {
+            z << meas[0], meas[1], meas[2];
+            est.update(z);
+        }
+        if (live != NULL) {
+            float alt[2] = { sample[3], float(est._X(2,0)) };
+            live->push(sample[0], alt);
+        }
+        if (recorder != NULL) {
+            flightRecord(sample, meas, valid, est, record);
+            uint64_t t0 = Instrumentation::ticks();
+            recorder->append(record);
+            appendTicks->record(Instrumentation::ticks() - t0);
+        }
+    });
+    double nsPerTick = double(nowNs() - startNs) / double(Instrumentation::ticks() - startTicks);
+
+    cout << "Real-time estimation loop at " << rateHz << " Hz" << (live != NULL ? " with live plot" : "")
+         << (recorder != NULL ? " with flight recorder" : "") << "\n";
+    rt.report(cout);
+    if (recorder != NULL) {
+        cout << "  append p50/p99/max: " << appendTicks->percentile(0.5)*nsPerTick << " / "
+             << appendTicks->percentile(0.99)*nsPerTick << " / " << appendTicks->max*nsPerTick << " ns\n";
     }
-};
+}
+
+
+// Measures what the instrumentation costs relative to one 6x6 filter step
+// The step itself contains two probes (predict/update) when compiled in
+#define INSTRUMENT_BUDGET_PERCENT 3.0
+
+void measureInstrumentationOverhead(const Simulator &sim, long nIterations) {
+    Estimator3DoF est;
+    configureEstimator3DoF(est, sim);
+    MatrixXd x0 = MatrixXd(6,1);
+    x0 << 0.0, 0.0, sim.transCruiseAltitude, sim.transInitVelocity, 0.0, 0.0;
+    est.setInitialState(x0, MatrixXd::Identity(6,6));
+
+    MatrixXd u = MatrixXd::Zero(3,1);
+    MatrixXd z = MatrixXd(3,1);
+    z << 0.0, 0.0, sim.transCruiseAltitude;
+
+    long long tc = nowNs();
+    for (long i = 0; i < nIterations; i++)
+        Instrumentation::ticks();
+
+    int probe = Instrumentation::probe("overhead.empty");
+    long long t0 = nowNs();
+    for (long i = 0; i < nIterations; i++) {
+        Instrumentation::ScopedTimer timer(probe);
+    }
+    long long t1 = nowNs();
+    for (long i = 0; i < nIterations; i++) {
+        est.predict(u);
+        est.update(z);
+    }
+    long long t2 = nowNs();
+
+    double clockNs = double(t0 - tc)/nIterations;
+    double probeNs = double(t1 - t0)/nIterations;
+    double stepNs  = double(t2 - t1)/nIterations;
+    double share   = 100.0*2.0*probeNs/stepNs;
+#if defined(CASE_STUDY_INSTRUMENT)
+    cout << "Instrumentation compiled in\n";
+#else
+    cout << "Instrumentation compiled out (build with -DCASE_STUDY_INSTRUMENT to enable)\n";
+#endif
+    cout << "  probe cost       : " << probeNs << " ns (two clock reads: " << 2.0*clockNs << " ns)\n";
+    cout << "  6x6 filter step  : " << stepNs << " ns\n";
+    cout << "  enabled overhead : " << share << " % of a step (2 probes), budget "
+         << INSTRUMENT_BUDGET_PERCENT << " %: " << (share <= INSTRUMENT_BUDGET_PERCENT ? "within" : "OVER") << "\n";
+}
+
+
+// Allocation report for a full simulated landing
+// A warm-up pass registers probes and sizes every buffer; the measured pass
+// then asserts that the estimation loop (REALTIME_REGION) never allocates
+void measureAllocations([[maybe_unused]] Simulator &sim, [[maybe_unused]] Estimator3DoF &est,
+                        [[maybe_unused]] const MatrixXd &x0) {
+#if defined(CASE_STUDY_TRACK_ALLOC)
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            AllocTracker::reset();
+            AllocTracker::strict() = true;
+        }
+        sim.genSimData();
+        plotTelemetryData(sim, "testData1_output_check");
+        est.setInitialState(x0, MatrixXd::Identity(6,6));
+        runEstimator(sim, est, 0, sim.nSamples);
+        compareVehicleData(sim, "testData1_output_compare");
+    }
+    AllocTracker::strict() = false;
+    AllocTracker::report(cout);
+    cout << "Allocations inside real-time regions: " << AllocTracker::totalViolations() << "\n";
+#else
+    cout << "Allocation tracking compiled out (build with -DCASE_STUDY_TRACK_ALLOC to enable)\n";
+#endif
+}
+
+
+
+// Main-thread stall per report (telemetry + comparison plot): blocking plot
+// functions against jobs queued on an AsyncPlotter with a shared snapshot
+void measureAsyncPlotting(Simulator &sim, Estimator3DoF &est, const MatrixXd &x0, int reports) {
+    est.setInitialState(x0, MatrixXd::Identity(6,6));
+    runEstimator(sim, est, 0, sim.nSamples);
+
+    long long t0 = nowNs();
+    for (int r = 0; r < reports; r++) {
+        plotTelemetryData(sim, "testData1_output_check");
+        compareVehicleData(sim, "testData1_output_compare");
+    }
+    long long syncNs = nowNs() - t0;
+
+    long long stallNs = 0, failed = 0;
+    vector<future<void> > done;
+    t0 = nowNs();
+    {
+        AsyncPlotter plotter;
+        for (int r = 0; r < reports; r++) {
+            long long s0 = nowNs();
+            shared_ptr<const TelemetrySnapshot> snap = snapshotTelemetry(sim);
+            done.push_back(plotter.submit([snap](Gnuplot &gp) { drawTelemetry(gp, *snap, "testData1_output_check"); }));
+            done.push_back(plotter.submit([snap](Gnuplot &gp) { drawComparison(gp, *snap, "testData1_output_compare"); }));
+            stallNs += nowNs() - s0;
+        }
+        for (size_t k = 0; k < done.size(); k++) {
+            try {
+                done[k].get();
+            }
+            catch (GnuplotException ge) {
+                if (failed++ == 0)
+                    cout << ge.what() << endl;
+            }
+        }
+    }
+    long long asyncNs = nowNs() - t0;
+
+    cout << "Plotting " << reports << " reports (2 plots each)\n";
+    cout << "  blocking : " << syncNs*1e-3/reports << " us main-thread stall per report\n";
+    cout << "  async    : " << stallNs*1e-3/reports << " us main-thread stall per report, "
+         << asyncNs*1e-3/reports << " us per report until all plots were sent\n";
+    if (failed > 0)
+        cout << "  " << failed << " plot jobs failed\n";
+}
+
+
+
+// Throughput of rendering many reports to files: one blocking gnuplot
+// process per plot against a pool of persistent processes working in
+// parallel. Timed until every gnuplot process has exited, i.e. every file
+// is written.
+void measurePlotterPool(Simulator &sim, Estimator3DoF &est, const MatrixXd &x0,
+                        int reports, size_t processes, PlotFormat format) {
+    est.setInitialState(x0, MatrixXd::Identity(6,6));
+    runEstimator(sim, est, 0, sim.nSamples);
+    shared_ptr<const TelemetrySnapshot> snap = snapshotTelemetry(sim);
+
+    long long failed = 0;
+    long long t0 = nowNs();
+    for (int r = 0; r < reports; r++) {
+        try {
+            Gnuplot gp;
+            drawTelemetry(gp, *snap, "pool_check", format);
+        }
+        catch (GnuplotException ge) {
+            if (failed++ == 0)
+                cout << ge.what() << endl;
+        }
+        try {
+            Gnuplot gp;
+            drawComparison(gp, *snap, "pool_compare", format);
+        }
+        catch (GnuplotException ge) {
+            failed++;
+        }
+    }
+    double plainS = (nowNs() - t0)*1e-9;
+
+    size_t counts[2] = { 1, processes };
+    double pooledS[2];
+    for (int c = 0; c < 2; c++) {
+        vector<future<void> > done;
+        t0 = nowNs();
+        {
+            PlotterPool pool(counts[c]);
+            for (int r = 0; r < reports; r++) {
+                // one file name per process so parallel jobs never share an output
+                size_t w = r % pool.size();
+                string tag = to_string(w);
+                done.push_back(pool.submit(w, [snap, tag, format](Gnuplot &gp) { drawTelemetry(gp, *snap, "pool_check_" + tag, format); }));
+                done.push_back(pool.submit(w, [snap, tag, format](Gnuplot &gp) { drawComparison(gp, *snap, "pool_compare_" + tag, format); }));
+            }
+            for (size_t k = 0; k < done.size(); k++) {
+                try {
+                    done[k].get();
+                }
+                catch (GnuplotException ge) {
+                    failed++;
+                }
+            }
+        }
+        pooledS[c] = (nowNs() - t0)*1e-9;
+    }
+
+    cout << "Rendering " << reports << " reports (2 plots each) to " << (format == PLOT_PNG ? "png" : "ps") << "\n";
+    cout << "  process per plot : " << 2*reports/plainS << " plots/s\n";
+    cout << "  pool, 1 process  : " << 2*reports/pooledS[0] << " plots/s\n";
+    cout << "  pool, " << processes << " processes: " << 2*reports/pooledS[1] << " plots/s\n";
+    if (failed > 0)
+        cout << "  " << failed << " plots failed\n";
+}
+
+
+
+// Density image of nPoints noisy lidar altitude measurements against time,
+// gathered from repeated landings at 100 Hz: a chunk of measurements is
+// generated once and binned repeatedly, so only the binning is timed
+void renderDensity(Simulator &sim, long long nPoints, unsigned int threads, unsigned int size) {
+    sim.clockCycle = 0.01;
+
+    size_t chunk = (size_t)min<long long>(nPoints, 10000000);
+    vector<float> t(chunk), alt(chunk);
+    SimulatorStream stream;
+    LidarErrorModel lidar;
+    float sample[NSTATES], meas[3];
+    unsigned int seed = 1;
+    stream.init(sim);
+    lidar.init(sim, seed);
+    float tMax = 0.0;
+    for (size_t i = 0; i < chunk; i++) {
+        if (!stream.next(sample)) {
+            stream.init(sim);
+            lidar.init(sim, ++seed);
+            stream.next(sample);
+        }
+        lidar.measure(sample, meas);
+        t[i]   = sample[0];
+        alt[i] = meas[2];
+        tMax   = max(tMax, sample[0]);
+    }
+
+    DensityRaster raster(size, size, 0.0f, tMax, -50.0f, 1.1f*sim.transCruiseAltitude);
+    long long t0 = nowNs();
+    for (long long done = 0; done < nPoints; done += chunk) {
+        size_t n = (size_t)min<long long>(chunk, nPoints - done);
+        raster.accumulate(&t[0], &alt[0], n, threads);
+    }
+    double binS = (nowNs() - t0)*1e-9;
+
+    t0 = nowNs();
+    bool written = raster.writePng("density.png");
+    double pngS = (nowNs() - t0)*1e-9;
+
+    cout << "Density raster " << size << "x" << size << " of " << nPoints << " points ("
+         << seed << " landings in the generated chunk)\n";
+    cout << "  binning   : " << binS << " s, " << nPoints/binS*1e-6 << " Mpoints/s\n";
+    cout << "  density.png " << (written ? "written" : "NOT written") << " in " << pngS*1e3 << " ms\n";
+
+    // optional display
+    if (getenv("DISPLAY") != NULL) {
+        try {
+            Gnuplot gp;
+            raster.show(gp, "lidar altitude density");
+            cout << "Press enter to close the plot\n";
+            cin.get();
+        }
+        catch (GnuplotException ge) {
+            cout << ge.what() << endl;
+        }
+    }
+}
+
+
+// Records a landing at the given clock cycle (simulated + estimated states)
+// to a TelemetryFile, maps it back and checks it against memory, then times
+// zero-copy column access and random access by time
+void recordTelemetry(Simulator &sim, Estimator3DoF &est, const string &fileName, float clockCycle) {
+    sim.clockCycle = clockCycle;
+    sim.genSimData();
+    configureEstimator3DoF(est, sim);
+    MatrixXd x0 = MatrixXd(6,1);
+    x0 << sim.vehicleTelemetry[1][0], sim.vehicleTelemetry[2][0], sim.vehicleTelemetry[3][0],
+          sim.transInitVelocity, 0.0, 0.0;
+    est.setInitialState(x0, MatrixXd::Identity(6,6));
+    runEstimator(sim, est, 0, sim.nSamples);
+
+    long long t0 = nowNs();
+    if (!saveTelemetry(sim, fileName)) {
+        cout << "Cannot write " << fileName << "\n";
+        return;
+    }
+    double writeS = (nowNs() - t0)*1e-9;
+
+    t0 = nowNs();
+    TelemetryFile file;
+    if (!file.open(fileName)) {
+        cout << file.error << "\n";
+        return;
+    }
+    double openS = (nowNs() - t0)*1e-9;
+    size_t n = file.samples();
+    const TelemetryHeader &h = file.header();
+    size_t bytes = h.columnOffset[h.nColumns - 1] + n*sizeof(float);
+
+    // every column must match memory bit for bit
+    int mismatched = 0;
+    for (int k = 0; k < 2*NSTATES; k++) {
+        const float *src = k < NSTATES ? sim.vehicleTelemetry[k] : sim.predVehicleState[k - NSTATES];
+        if (memcmp(file.data(file.columnIndex(telemetryColumns[k])), src, n*sizeof(float)) != 0)
+            mismatched++;
+    }
+    unique_ptr<Simulator> copy(new Simulator());
+    bool restored = loadTelemetry(file, *copy) && copy->clockCycle == sim.clockCycle &&
+                    copy->descentFinalVelocity == sim.descentFinalVelocity &&
+                    memcmp(copy->predVehicleState[3], sim.predVehicleState[3], n*sizeof(float)) == 0;
+
+    // Eigen expressions straight on the mapped columns
+    t0 = nowNs();
+    float maxErr = (file.column(file.columnIndex("z")) - file.column(file.columnIndex("est.z"))).cwiseAbs().maxCoeff();
+    double mapS = (nowNs() - t0)*1e-9;
+
+    // random access by time
+    const int nLookups = 1000000;
+    const float *alt = file.data(file.columnIndex("z"));
+    float tMax = file.data(0)[n - 1];
+    mt19937 rng(1);
+    uniform_real_distribution<float> when(0.0f, tMax);
+    double sum = 0.0;
+    t0 = nowNs();
+    for (int i = 0; i < nLookups; i++) {
+        size_t k = file.indexAt(when(rng));
+        sum += alt[min(k, n - 1)];
+    }
+    double lookupS = (nowNs() - t0)*1e-9;
+
+    cout << "Recorded " << n << " samples x " << h.nColumns << " columns, " << h.nParams
+         << " parameters at " << h.sampleRate << " Hz to " << fileName << " (" << bytes << " bytes)\n";
+    cout << "  write        : " << writeS*1e3 << " ms, " << bytes/writeS*1e-6 << " MB/s\n";
+    cout << "  open + map   : " << openS*1e6 << " us\n";
+    cout << "  verify       : " << (mismatched == 0 ? "all columns identical" : to_string(mismatched) + " columns differ")
+         << ", restore " << (restored ? "ok" : "FAILED") << "\n";
+    cout << "  max |z - est.z| over the mapped columns: " << maxErr << " m in " << mapS*1e6 << " us\n";
+    cout << "  lookup by time: " << lookupS*1e9/nLookups << " ns (checksum " << sum/nLookups << ")\n";
+}
+
+
+// Compression ratio of every telemetry column and decode throughput of the
+// packed file, for landings generated at several clock cycles
+void measureCompression(Simulator &sim, Estimator3DoF &est) {
+    float clockCycles[] = {0.5f, 0.1f, 0.01f};
+    for (float clockCycle : clockCycles) {
+        sim.clockCycle = clockCycle;
+        sim.genSimData();
+        configureEstimator3DoF(est, sim);
+        MatrixXd x0 = MatrixXd(6,1);
+        x0 << sim.vehicleTelemetry[1][0], sim.vehicleTelemetry[2][0], sim.vehicleTelemetry[3][0],
+              sim.transInitVelocity, 0.0, 0.0;
+        est.setInitialState(x0, MatrixXd::Identity(6,6));
+        runEstimator(sim, est, 0, sim.nSamples);
+
+        long long t0 = nowNs();
+        bool saved = saveTelemetry(sim, "compress_raw.tlm") && saveTelemetry(sim, "compress_packed.tlm", TELEMETRY_PACKED);
+        double saveS = (nowNs() - t0)*1e-9;
+        TelemetryFile raw, packed;
+        if (!saved || !raw.open("compress_raw.tlm") || !packed.open("compress_packed.tlm")) {
+            cout << "Cannot write/read the telemetry files\n";
+            return;
+        }
+
+        size_t n = packed.samples();
+        cout << "Landing at " << 1.0/clockCycle << " Hz, " << n << " samples (raw + packed written in "
+             << saveS*1e3 << " ms)\n";
+        cout << "  ratio   ";
+        size_t rawBytes = 0, packedBytes = 0;
+        vector<float> out(n);
+        int mismatched = 0;
+        for (int k = 0; k < packed.columns(); k++) {
+            rawBytes    += raw.storedBytes(k);
+            packedBytes += packed.storedBytes(k);
+            packed.read(k, 0, n, &out[0]);
+            if (memcmp(&out[0], raw.data(k), n*sizeof(float)) != 0)
+                mismatched++;
+            cout << (k > 0 ? ", " : " ") << packed.header().columnName[k] << " "
+                 << double(raw.storedBytes(k))/packed.storedBytes(k);
+        }
+        cout << "\n  total    " << double(rawBytes)/packedBytes << " (" << rawBytes << " -> " << packedBytes
+             << " bytes), " << (mismatched == 0 ? "lossless" : to_string(mismatched) + " columns differ") << "\n";
+
+        // whole-file decode, repeated to ~1 GB of output
+        long reps = max(1L, long(1e9 / (rawBytes + 1)));
+        t0 = nowNs();
+        for (long r = 0; r < reps; r++)
+            for (int k = 0; k < packed.columns(); k++)
+                packed.read(k, 0, n, &out[0]);
+        double decodeS = (nowNs() - t0)*1e-9;
+
+        // random access: 64 samples at a random time
+        const int nReads = 100000;
+        mt19937 rng(1);
+        uniform_real_distribution<float> when(0.0f, raw.data(0)[n - 1]);
+        float z[64];
+        double sum = 0.0;
+        t0 = nowNs();
+        for (int i = 0; i < nReads; i++) {
+            size_t first = min(packed.indexAt(when(rng)), n > 64 ? n - 64 : 0);
+            packed.read(packed.columnIndex("z"), first, min<size_t>(64, n), z);
+            sum += z[0];
+        }
+        double randomS = (nowNs() - t0)*1e-9;
+
+        cout << "  decode   " << reps*rawBytes/decodeS*1e-9 << " GB/s of float32 output\n";
+        cout << "  64 samples at a random time: " << randomS*1e9/nReads << " ns (checksum " << sum/nReads << ")\n";
+    }
+    remove("compress_raw.tlm");
+    remove("compress_packed.tlm");
+}
+
+
+// Reads a flight recorder file back: prints the recovered window and stores
+// it as a TelemetryFile (fileName + ".tlm") for the other tools
+bool recoverFlightRecord(const string &fileName) {
+    vector<string> fields;
+    vector<float>  records;
+    uint64_t       firstSeq;
+    string         error;
+    long long t0 = nowNs();
+    if (!FlightRecorder::recover(fileName, fields, records, firstSeq, error)) {
+        cout << error << "\n";
+        return false;
+    }
+    double recoverS = (nowNs() - t0)*1e-9;
+
+    size_t nf = fields.size(), n = records.size() / nf;
+    cout << "Recovered " << n << " records of " << nf << " fields from " << fileName << " in "
+         << recoverS*1e3 << " ms";
+    if (n == 0) {
+        cout << "\n";
+        return true;
+    }
+    cout << " (records " << firstSeq << " to " << firstSeq + n - 1 << ")\n";
+
+    // column-major copy for the telemetry file, and a continuity check on t
+    vector<vector<float> > columns(nf, vector<float>(n));
+    for (size_t i = 0; i < n; i++)
+        for (size_t k = 0; k < nf; k++)
+            columns[k][i] = records[i*nf + k];
+    size_t gaps = 0;
+    for (size_t i = 1; i < n; i++)
+        if (!(columns[0][i] > columns[0][i - 1]))
+            gaps++;
+    cout << "  t = " << columns[0][0] << " .. " << columns[0][n - 1] << " s, "
+         << gaps << " non-increasing steps (landing restarts)\n";
+    cout << "  last record:";
+    for (size_t k = 0; k < nf; k++)
+        cout << " " << fields[k] << "=" << columns[k][n - 1];
+    cout << "\n";
+
+    double rate = n > 1 && columns[0][1] > columns[0][0] ? 1.0/(columns[0][1] - columns[0][0]) : 0.0;
+    TelemetryWriter out(rate);
+    out.addParam("firstRecord", double(firstSeq));
+    for (size_t k = 0; k < nf; k++)
+        out.addColumn(fields[k], &columns[k][0]);
+    bool saved = out.write(fileName + ".tlm", n);
+    cout << "  window " << (saved ? "saved to " + fileName + ".tlm" : "NOT saved") << "\n";
+    return saved;
+}
+
+// Flight recorder at rateHz with a window of `seconds`: append cost inside the
+// real-time loop, write(2) per record for comparison, then a child process
+// recording the loop is SIGKILLed halfway through and the window recovered
+void measureFlightRecorder(Simulator &sim, double rateHz, long nCycles, double seconds, const string &fileName) {
+    vector<string> fields(flightFields, flightFields + FLIGHT_RECORDS);
+    size_t capacity = max<size_t>(1, size_t(rateHz*seconds));
+
+    {
+        FlightRecorder recorder;
+        if (!recorder.open(fileName, fields, capacity)) {
+            cout << recorder.error << "\n";
+            return;
+        }
+        runRealtime(sim, rateHz, nCycles, -1, 0, false, NULL, &recorder);
+    }
+
+    // the alternative: one write() per record
+    {
+        int fd = open((fileName + ".write").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        float record[FLIGHT_RECORDS] = {};
+        const int nWrites = 10000;
+        long long t0 = nowNs();
+        for (int i = 0; i < nWrites && fd >= 0; i++)
+            if (write(fd, record, sizeof(record)) != ssize_t(sizeof(record)))
+                break;
+        double writeNs = double(nowNs() - t0)/nWrites;
+        if (fd >= 0)
+            close(fd);
+        remove((fileName + ".write").c_str());
+        cout << "  write(2) per record instead, back to back: " << writeNs << " ns\n";
+    }
+
+    // crash test
+    double runS = nCycles/rateHz;
+    pid_t child = fork();
+    if (child == 0) {
+        FlightRecorder recorder;
+        if (!recorder.open(fileName, fields, capacity))
+            _exit(1);
+        runRealtime(sim, rateHz, 2*nCycles, -1, 0, false, NULL, &recorder);
+        _exit(0);
+    }
+    if (child < 0) {
+        cout << "fork failed\n";
+        return;
+    }
+    this_thread::sleep_for(chrono::duration<double>(runS));
+    kill(child, SIGKILL);
+    int status = 0;
+    waitpid(child, &status, 0);
+    cout << "Recorder process " << (WIFSIGNALED(status) ? "killed" : "exited") << " after "
+         << runS << " s of a " << 2*runS << " s run\n";
+    recoverFlightRecord(fileName);
+}
+
+
+// CSV export/import throughput on `rows` rows of 100 Hz landing telemetry
+// and estimates (the landing repeated), against ofstream formatting, then a
+// landing exported, imported and replayed through the estimator
+void measureCsv(Simulator &sim, Estimator3DoF &est, size_t rows, unsigned threads, int precision) {
+    sim.clockCycle = 0.01;
+    sim.genSimData();
+    configureEstimator3DoF(est, sim);
+    MatrixXd x0 = MatrixXd(6,1);
+    x0 << sim.vehicleTelemetry[1][0], sim.vehicleTelemetry[2][0], sim.vehicleTelemetry[3][0],
+          sim.transInitVelocity, 0.0, 0.0;
+    est.setInitialState(x0, MatrixXd::Identity(6,6));
+    runEstimator(sim, est, 0, sim.nSamples);
+
+    vector<string> names(telemetryColumns, telemetryColumns + 2*NSTATES);
+    vector<vector<float> > data(2*NSTATES, vector<float>(rows));
+    vector<const float*> columns;
+    for (int k = 0; k < 2*NSTATES; k++) {
+        const float *src = k < NSTATES ? sim.vehicleTelemetry[k] : sim.predVehicleState[k - NSTATES];
+        for (size_t i = 0; i < rows; i++)
+            data[k][i] = src[i % sim.nSamples];
+        columns.push_back(&data[k][0]);
+    }
+    cout << "CSV of " << rows << " rows x " << 2*NSTATES << " columns\n";
+
+    // what Gnuplot's tmpfiles do: ofstream << per value (first 10% of the rows)
+    {
+        size_t n = rows/10;
+        long long t0 = nowNs();
+        ofstream f("csv_stream.csv");
+        for (size_t i = 0; i < n; i++)
+            for (int k = 0; k < 2*NSTATES; k++)
+                f << data[k][i] << (k + 1 < 2*NSTATES ? ',' : '\n');
+        f.close();
+        double s = (nowNs() - t0)*1e-9;
+        struct stat st;
+        stat("csv_stream.csv", &st);
+        cout << "  ofstream <<           : " << st.st_size/s*1e-6 << " MB/s\n";
+        remove("csv_stream.csv");
+    }
+
+    int precisions[2] = { -1, precision };
+    unsigned counts[2] = { 1, threads };
+    for (int pc = 0; pc < 2; pc++) {
+        int prec = precisions[pc];
+        string label = prec < 0 ? "shortest" : to_string(prec) + " decimals";
+        string fileName = "csv_export.csv";
+        for (int tc = 0; tc < 2; tc++) {
+            if (tc == 1 && counts[1] == 1)
+                continue;
+            long long t0 = nowNs();
+            bool ok = TelemetryCsv::write(fileName, names, columns, rows, prec, counts[tc]);
+            double s = (nowNs() - t0)*1e-9;
+            struct stat st;
+            stat(fileName.c_str(), &st);
+            cout << "  export " << label << ", " << counts[tc] << " thread(s): "
+                 << (ok ? "" : "FAILED ") << st.st_size/s*1e-6 << " MB/s (" << st.st_size*1e-6 << " MB)\n";
+        }
+
+        for (int tc = 0; tc < 2; tc++) {
+            if (tc == 1 && counts[1] == 1)
+                continue;
+            vector<string> readNames;
+            vector<vector<float> > readCols;
+            string error;
+            long long t0 = nowNs();
+            bool ok = TelemetryCsv::read(fileName, readNames, readCols, counts[tc], error);
+            double s = (nowNs() - t0)*1e-9;
+            struct stat st;
+            stat(fileName.c_str(), &st);
+
+            // shortest must be exact, fixed within half a unit of the last decimal
+            float tol = prec < 0 ? 0.0f : 0.5f*pow(10.0f, -prec);
+            size_t bad = 0;
+            for (int k = 0; ok && k < 2*NSTATES; k++) {
+                if (readCols[k].size() != rows) {
+                    bad = rows;
+                    break;
+                }
+                for (size_t i = 0; i < rows; i++)
+                    bad += !(fabs(readCols[k][i] - data[k][i]) <= tol*(1.0f + 1e-6f*fabs(data[k][i])) + tol);
+            }
+            cout << "  import " << label << ", " << counts[tc] << " thread(s): "
+                 << (ok ? "" : error + " ") << st.st_size/s*1e-6 << " MB/s, "
+                 << (bad == 0 ? (prec < 0 ? "exact" : "within tolerance") : to_string(bad) + " values differ") << "\n";
+        }
+        remove(fileName.c_str());
+    }
+
+    // replay: a landing exported, imported into a fresh simulator and re-estimated
+    unique_ptr<Simulator> replay(new Simulator(sim));
+    string error;
+    bool ok = saveTelemetryCsv(sim, "csv_replay.csv") && loadTelemetryCsv("csv_replay.csv", *replay, error);
+    if (!ok) {
+        cout << "  replay: " << error << "\n";
+        return;
+    }
+    est.setInitialState(x0, MatrixXd::Identity(6,6));
+    runEstimator(*replay, est, 0, replay->nSamples);
+    bool same = replay->nSamples == sim.nSamples;
+    for (int k = 0; same && k < NSTATES; k++)
+        same = memcmp(replay->predVehicleState[k], sim.predVehicleState[k], sim.nSamples*sizeof(float)) == 0;
+    cout << "  replay of csv_replay.csv through the estimator: " << replay->nSamples << " samples, estimates "
+         << (same ? "identical" : "DIFFERENT") << " to the in-memory run\n";
+    remove("csv_replay.csv");
+}
+
+
+// Writes a lidar log of about sizeMB (repeated landings at sim's clock cycle,
+// time restarting with each landing; lidarLogColumns) for the replay modes: a
+// TelemetryFile streamed chunk by chunk, or CSV when fileName ends in .csv
+bool generateSensorLog(const Simulator &sim, const string &fileName, double sizeMB, bool quiet = false,
+                       unsigned int seed = 1) {
+    bool csv = fileName.size() > 4 && fileName.compare(fileName.size() - 4, 4, ".csv") == 0;
+    size_t n = max<size_t>(1, size_t(sizeMB*1048576.0) / (csv ? 64 : 8*sizeof(float)));
+
+    SimulatorStream stream;
+    LidarErrorModel lidar;
+    stream.init(sim);
+    lidar.init(sim, seed);
+    auto fill = [&](size_t, size_t count, float *const *columns) {
+        float sample[NSTATES], meas[3];
+        for (size_t i = 0; i < count; i++) {
+            if (!stream.next(sample)) {
+                stream.init(sim);
+                stream.next(sample);
+            }
+            bool valid = lidar.measure(sample, meas);
+            for (int k = 0; k < 4; k++)
+                columns[k][i] = sample[k];
+            for (int k = 0; k < 3; k++)
+                columns[4 + k][i] = meas[k];
+            columns[7][i] = valid ? 1.0f : 0.0f;
+        }
+    };
+
+    long long t0 = nowNs();
+    bool ok;
+    if (csv) {
+        vector<vector<float> > data(8, vector<float>(n));
+        float *columns[8];
+        for (int k = 0; k < 8; k++)
+            columns[k] = &data[k][0];
+        fill(0, n, columns);
+        vector<const float*> in(columns, columns + 8);
+        ok = TelemetryCsv::write(fileName, vector<string>(lidarLogColumns, lidarLogColumns + 8), in, n, 3,
+                                 max(1u, thread::hardware_concurrency()));
+    }
+    else {
+        TelemetryWriter out(1.0 / sim.clockCycle);
+        for (const SimulatorParam &p : simulatorParams)
+            out.addParam(p.name, sim.*p.field);
+        for (int k = 0; k < 8; k++)
+            out.addColumn(lidarLogColumns[k], NULL);
+        ok = out.writeStreamed(fileName, n, fill);
+    }
+    if (!quiet)
+        cout << "Generated " << n << " lidar samples in " << fileName << " (" << (nowNs() - t0)*1e-9 << " s)\n";
+    return ok;
+}
+
+// Drops fileName from the page cache, so the next read comes from disk
+void evictFromCache(const string &fileName) {
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+
+// Replays a recorded lidar log through the estimator, as fast as possible
+// (speed 0) or paced to the recorded timestamps at speed x real time for at
+// most maxSeconds. The log is evicted from the page cache first, so the run
+// includes the disk reads; reports samples/s, MB/s and how long the filter
+// waited for the log
+void replayLog(Simulator &sim, const string &fileName, size_t sizeMB, double speed, double maxSeconds) {
+    struct stat st;
+    if (stat(fileName.c_str(), &st) != 0) {
+        sim.clockCycle = 0.01;
+        if (!generateSensorLog(sim, fileName, sizeMB)) {
+            cout << "Cannot write " << fileName << "\n";
+            return;
+        }
+    }
+
+    evictFromCache(fileName);
+
+    LogReplay log;
+    long long t0 = nowNs();
+    if (!log.open(fileName)) {
+        cout << log.error << "\n";
+        return;
+    }
+    double openS = (nowNs() - t0)*1e-9;
+    double period = log.samplePeriod() > 0.0 ? log.samplePeriod() : sim.clockCycle;
+
+    sim.clockCycle = float(period);
+    Estimator3DoF est;
+    configureEstimator3DoF(est, sim);
+    MatrixXd x0 = MatrixXd::Zero(6,1);
+    MatrixXd u  = MatrixXd::Zero(3,1);
+    MatrixXd z  = MatrixXd(3,1);
+
+    const size_t batch = speed > 0.0 ? 64 : 4096;
+    vector<ReplaySample> samples(batch);
+    vector<long long> lateness;
+    size_t total = 0, landings = 0;
+    long long waitNs = 0, firstWaitNs = 0, worstWaitNs = 0;
+    double simTime = 0.0, checksum = 0.0;
+    float lastT = 0.0f;
+
+    long long start = nowNs(), paceStart = start;
+    while (true) {
+        long long w0 = nowNs();
+        size_t n = log.next(&samples[0], batch);
+        long long w = nowNs() - w0;
+        waitNs += w;
+        if (total == 0)
+            firstWaitNs = w;
+        else
+            worstWaitNs = max(worstWaitNs, w);
+        if (n == 0)
+            break;
+
+        for (size_t i = 0; i < n; i++) {
+            const ReplaySample &s = samples[i];
+            // a new landing starts where the time goes back
+            if (total + i == 0 || s.t <= lastT) {
+                x0 << s.z[0], s.z[1], s.z[2], sim.transInitVelocity, 0.0, 0.0;
+                est.setInitialState(x0, MatrixXd::Identity(6,6));
+                simTime += total + i == 0 ? 0.0 : period;
+                if (total + i == 0)
+                    paceStart = nowNs();    // pace from the first sample, not from the cold open
+                landings++;
+            }
+            else
+                simTime += s.t - lastT;
+            lastT = s.t;
+
+            if (speed > 0.0) {
+                long long due = paceStart + (long long)(simTime/speed*1e9);
+                long long now = nowNs();
+                if (now < due) {
+                    this_thread::sleep_for(chrono::nanoseconds(due - now));
+                    now = nowNs();
+                }
+                lateness.push_back(now - due);
+            }
+
+            est.predict(u);
+            if (s.valid) {
+                z << s.z[0], s.z[1], s.z[2];
+                est.update(z);
+            }
+        }
+        checksum += est._X(2,0);
+        total += n;
+        if (speed > 0.0 && (nowNs() - start)*1e-9 >= maxSeconds)
+            break;
+    }
+    if (!log.error.empty())
+        cout << "  " << log.error << "\n";
+    double s = (nowNs() - start)*1e-9;
+    double bytes = double(log.position());
+
+    cout << "Replayed " << total << " samples (" << landings << " landings) from " << fileName
+         << (log.isCsv() ? " (CSV, " : " (") << log.bytes()*1e-6 << " MB) ";
+    if (speed > 0.0)
+        cout << "at " << speed << "x real time\n";
+    else
+        cout << "as fast as possible\n";
+    cout << "  open + map      : " << openS*1e6 << " us\n";
+    cout << "  throughput      : " << total/s << " samples/s, " << bytes/s*1e-6 << " MB/s (" << s << " s)\n";
+    cout << "  waiting for log : " << waitNs*1e-6 << " ms total (" << 100.0*waitNs*1e-9/s
+         << "%), first batch " << firstWaitNs*1e-3 << " us, worst later batch "
+         << worstWaitNs*1e-3 << " us\n";
+    if (!lateness.empty()) {
+        sort(lateness.begin(), lateness.end());
+        cout << "  lateness p50/p99/max: " << lateness[lateness.size()/2]*1e-3 << " / "
+             << lateness[size_t(lateness.size()*0.99)]*1e-3 << " / " << lateness.back()*1e-3 << " us\n";
+    }
+    cout << "  (checksum " << checksum << ")\n";
+}
+
+
+// Out-of-core reprocessing: lidar logs of 1 MB, 10 MB, ... up to maxMB are
+// generated, evicted from the page cache and streamed through the estimator
+// in chunks (TelemetryStream + LogEstimator); throughput and peak memory
+// should not depend on the log length
+void measureStreaming(Simulator &sim, size_t maxMB, size_t chunkRows, const string &fileName) {
+    sim.clockCycle = 0.01;
+    vector<string> names(lidarLogColumns, lidarLogColumns + 8);
+    cout << "Streaming reprocessing of 100 Hz lidar logs, " << chunkRows << " rows per chunk\n";
+
+    for (size_t sizeMB = 1; sizeMB <= maxMB; sizeMB *= 10) {
+        long long t0 = nowNs();
+        if (!generateSensorLog(sim, fileName, sizeMB, true)) {
+            cout << "Cannot write " << fileName << "\n";
+            return;
+        }
+        evictFromCache(fileName);
+        double generateS = (nowNs() - t0)*1e-9;
+
+        TelemetryStream log;
+        LogEstimator    run;
+        if (!log.open(fileName, names, chunkRows)) {
+            cout << log.error << "\n";
+            return;
+        }
+        sim.clockCycle = float(log.param("clockCycle", sim.clockCycle));
+        run.init(sim);
+
+        vector<const float*> columns;
+        long long waitNs = 0;
+        long long start = nowNs();
+        while (true) {
+            long long w0 = nowNs();
+            size_t n = log.next(columns);
+            waitNs += nowNs() - w0;
+            if (n == 0)
+                break;
+            run.process(&columns[0], n);
+        }
+        double s = (nowNs() - start)*1e-9;
+        if (!log.error.empty())
+            cout << "  " << log.error << "\n";
+
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        const EstimationMetrics &m = run.metrics;
+        cout << "  " << sizeMB << " MB: " << m.samples << " samples, " << m.landings << " landings in " << s
+             << " s (generated in " << generateS << " s)\n";
+        cout << "    " << m.samples/s << " samples/s, " << log.bytesRead()/s*1e-6 << " MB/s, waited for reads "
+             << 100.0*waitNs*1e-9/s << "%, peak RSS " << ru.ru_maxrss/1024 << " MB, rms error x/y/z "
+             << m.rms(0) << " / " << m.rms(1) << " / " << m.rms(2) << " m\n";
+        log.close();
+        remove(fileName.c_str());
+    }
+}
 
-// Function plots/saves data to a *.ps file in work directory
-// TODO: once idealised example is extended, extend plotting to xyz plot inplace of xy only
-// TODO: generalise function to plot required arrays only? Not sure if this is possible...
-void plotTelemetryData(Simulator testData, string fileName) {
-    // Generate a plot of the above telemetry data
-    try {
-        Gnuplot g1("Vehicle Position");
 
-        vector<float> t, x, y, z;
+// Fleet reprocessing: re-runs the estimator over every .tlm lidar log in dir
+// on a pool of threads, largest file first, and writes one row per file
+// plus the merged metrics to summaryFile. A missing dir is filled with
+// nFiles generated logs (0.1 - 20 MB, varied clock cycle and lidar error)
+void reprocessFleet(Simulator &sim, const string &dir, unsigned threads, size_t nFiles, const string &summaryFile) {
+    namespace fs = std::filesystem;
+    if (!fs::exists(dir)) {
+        fs::create_directories(dir);
+        long long t0 = nowNs();
+        TaskPool::run(nFiles, threads, [&](size_t i, unsigned) {
+            mt19937 rng(unsigned(i) + 1);
+            unique_ptr<Simulator> s(new Simulator(sim));
+            float clockCycles[] = {0.01f, 0.02f, 0.05f};
+            s->clockCycle              = clockCycles[rng() % 3];
+            s->singleSampleErrorOffset = uniform_real_distribution<float>(0.5f, 2.0f)(rng);
+            s->multipathErrorOffset    = uniform_real_distribution<float>(0.0f, 5.0f)(rng);
+            double sizeMB = 0.1*pow(200.0, uniform_real_distribution<double>(0.0, 1.0)(rng));
+            generateSensorLog(*s, dir + "/landing" + to_string(i) + ".tlm", sizeMB, true, unsigned(i) + 1);
+        });
+        cout << "Generated " << nFiles << " logs in " << dir << " (" << (nowNs() - t0)*1e-9 << " s)\n";
+    }
 
-        for (int i = 0; i < NPOINTS; i++) {
-            t.push_back(testData.vehicleTelemetry[0][i]);
-            x.push_back(testData.vehicleTelemetry[1][i]);
-            y.push_back(testData.vehicleTelemetry[2][i]);
-            z.push_back(testData.vehicleTelemetry[3][i]);
+    // largest first: the longest runs start early instead of straggling
+    vector<pair<uintmax_t, string> > files;
+    for (const fs::directory_entry &e : fs::directory_iterator(dir))
+        if (e.is_regular_file() && e.path().extension() == ".tlm")
+            files.push_back(make_pair(e.file_size(), e.path().string()));
+    sort(files.begin(), files.end(), greater<pair<uintmax_t, string> >());
+    uintmax_t totalBytes = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        totalBytes += files[i].first;
+        evictFromCache(files[i].second);
+    }
+
+    struct FileResult {
+        EstimationMetrics metrics;
+        double            seconds = 0.0;
+        string            error;
+    };
+    vector<FileResult> results(files.size());
+    unsigned workers = TaskPool::workers(files.size(), threads);
+    vector<double> busy(workers, 0.0);
+    vector<unique_ptr<Simulator> > sims;
+    for (unsigned w = 0; w < workers; w++)
+        sims.push_back(unique_ptr<Simulator>(new Simulator(sim)));
+    vector<string> names(lidarLogColumns, lidarLogColumns + 8);
+
+    long long start = nowNs();
+    TaskPool::run(files.size(), workers, [&](size_t i, unsigned w) {
+        long long t0 = nowNs();
+        TelemetryStream log;
+        LogEstimator    run;
+        vector<const float*> columns;
+        if (log.open(files[i].second, names)) {
+            // the estimator is configured from the parameters the log was recorded with
+            for (const SimulatorParam &p : simulatorParams)
+                sims[w].get()->*p.field = float(log.param(p.name, sim.*p.field));
+            run.init(*sims[w]);
+            for (size_t n = log.next(columns); n > 0; n = log.next(columns))
+                run.process(&columns[0], n);
         }
+        results[i].metrics = run.metrics;
+        results[i].error   = log.error;
+        results[i].seconds = (nowNs() - t0)*1e-9;
+        busy[w] += results[i].seconds;
+    });
+    double s = (nowNs() - start)*1e-9;
 
-        g1.savetops(fileName);
-        g1.set_xlabel("x").set_ylabel("z");//.set_zlabel("z");
-        g1.set_grid().set_xrange(0,500).set_yrange(0,1200);//set_zrange(0,1200);
-        g1.set_title("Simulator Generated Vehicle Data\\n testData1");
-        g1.set_style("points").plot_xy(x, z, "vehicle trajectory data");
+    EstimationMetrics total;
+    size_t failed = 0;
+    ofstream out(summaryFile);
+    out << "file,samples,landings,updates,rms.x,rms.y,rms.z,max.x,max.y,max.z,seconds\n";
+    for (size_t i = 0; i < files.size(); i++) {
+        const EstimationMetrics &m = results[i].metrics;
+        if (!results[i].error.empty()) {
+            cout << "  " << results[i].error << "\n";
+            failed++;
+            continue;
+        }
+        total.merge(m);
+        out << fs::path(files[i].second).filename().string() << "," << m.samples << "," << m.landings << ","
+            << m.updates << "," << m.rms(0) << "," << m.rms(1) << "," << m.rms(2) << "," << m.maxAbs[0] << ","
+            << m.maxAbs[1] << "," << m.maxAbs[2] << "," << results[i].seconds << "\n";
     }
-    catch (GnuplotException ge) {
-        cout << ge.what() << endl;
+    out << "ALL," << total.samples << "," << total.landings << "," << total.updates << "," << total.rms(0) << ","
+        << total.rms(1) << "," << total.rms(2) << "," << total.maxAbs[0] << "," << total.maxAbs[1] << ","
+        << total.maxAbs[2] << "," << s << "\n";
+    out.close();
+
+    double busySum = 0.0;
+    for (unsigned w = 0; w < workers; w++)
+        busySum += busy[w];
+    cout << "Reprocessed " << files.size() - failed << " of " << files.size() << " logs in " << dir << " ("
+         << totalBytes*1e-6 << " MB) on " << workers << " thread(s) in " << s << " s\n";
+    cout << "  " << files.size()/s << " files/s, " << total.samples/s << " samples/s, " << totalBytes/s*1e-6
+         << " MB/s, workers busy " << 100.0*busySum/(workers*s) << "% of the time\n";
+    cout << "  merged: " << total.samples << " samples, " << total.landings << " landings, rms error x/y/z "
+         << total.rms(0) << " / " << total.rms(1) << " / " << total.rms(2) << " m, max |z error| "
+         << total.maxAbs[2] << " m\n";
+    cout << "  summary written to " << summaryFile << "\n";
+}
+
+
+// The landing campaign run by the campaign, shard and merge modes: runs
+// draws of sim's descent profile and lidar error at a 10 Hz clock cycle
+Campaign landingCampaign(uint64_t runs, uint64_t seed = 1) {
+    Campaign c;
+    c.seed = seed;
+    c.runs = runs;
+    c.params = {
+        { "clockCycle",              &Simulator::clockCycle,              0.1f,  0.1f },
+        { "hoverFinalVelocity",      &Simulator::hoverFinalVelocity,      8.0f, 12.0f },
+        { "descentTargetAltitude",   &Simulator::descentTargetAltitude,  30.0f, 70.0f },
+        { "descentFinalVelocity",    &Simulator::descentFinalVelocity,    0.2f,  1.0f },
+        { "singleSampleErrorOffset", &Simulator::singleSampleErrorOffset, 0.5f,  1.5f },
+        { "multipathErrorOffset",    &Simulator::multipathErrorOffset,    0.0f,  4.0f },
+        { "multipathErrorDuration",  &Simulator::multipathErrorDuration,  0.1f,  1.0f },
+    };
+    return c;
+}
+
+void printCampaignStats(const Campaign &c, const CampaignStats &stats) {
+    cout << "  " << c.runs << " landings, " << stats.failures << " failures (touchdownError > "
+         << c.failureLimit << " m): P = " << double(stats.failures)/c.runs << "\n";
+    for (int k = 0; k < LANDING_METRICS; k++) {
+        const Moments &m = stats.moments[k];
+        const QuantileSketch &q = stats.sketch[k];
+        cout << "  " << landingMetricInfo[k].name << ": mean " << m.mean << ", sd " << m.stddev()
+             << ", skew " << m.skewness() << ", min " << m.min << ", p50/p90/p99 " << q.quantile(0.5) << " / "
+             << q.quantile(0.9) << " / " << q.quantile(0.99) << ", max " << m.max << "\n";
     }
 }
 
-// Function compares simulated telemetry data with estimated
-void compareVehicleData(Simulator testData, string fileName) {
-    // Generate a plot of the above telemetry data
-    try {
-        Gnuplot g1("Vehicle Position");
+// Partial result files of a campaign directory
+vector<string> campaignPartials(const string &dir) {
+    vector<string> files;
+    for (const std::filesystem::directory_entry &e : std::filesystem::directory_iterator(dir))
+        if (e.path().extension() == ".part")
+            files.push_back(e.path().string());
+    sort(files.begin(), files.end());
+    return files;
+}
 
-        vector<float> t, x, y, z, _x, _y, _z;
+// Runs one shard in this process and writes dir/shard-<index>-of-<count>.part
+bool runShard(const Simulator &sim, const Campaign &c, const string &dir, uint64_t index, uint64_t count,
+              unsigned threads) {
+    map<uint64_t, CampaignStats> blocks;
+    runCampaignShard(c, sim, index, count, threads, blocks);
+    string fileName = dir + "/shard-" + to_string(index) + "-of-" + to_string(count) + ".part";
+    return saveCampaignPartial(fileName, c, index, count, blocks);
+}
 
-        for (int i = 0; i < NPOINTS; i++) {
-            //t.push_back(testData.vehicleTelemetry[0][i]);
-            x.push_back(testData.vehicleTelemetry[1][i]);
-            y.push_back(testData.vehicleTelemetry[2][i]);
-            z.push_back(testData.vehicleTelemetry[3][i]);
+// Runs a campaign as shards in separate processes (at most processes at a
+// time), merges the partial results, and checks the merge is bit for bit
+// the same as the whole campaign run as a single shard
+void runShardedCampaign(const Simulator &sim, uint64_t runs, uint64_t shards, unsigned processes,
+                        const string &dir) {
+    Campaign c = landingCampaign(runs);
+    std::filesystem::create_directories(dir);
+    for (const string &f : campaignPartials(dir))
+        remove(f.c_str());
 
-            //t.push_back(testData.predVehicleState[0][j]);
-            _x.push_back(testData.predVehicleState[1][i]);
-            _y.push_back(testData.predVehicleState[2][i]);
-            _z.push_back(testData.predVehicleState[3][i]);
+    long long t0 = nowNs();
+    size_t running = 0, failed = 0;
+    for (uint64_t s = 0; s < shards; s++) {
+        if (running == processes) {
+            int status = 0;
+            wait(&status);
+            failed += !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+            running--;
+        }
+        cout.flush();
+        pid_t child = fork();
+        if (child == 0) {
+            _exit(runShard(sim, c, dir, s, shards, 1) ? 0 : 1);
         }
+        running += child > 0;
+        failed  += child < 0;
+    }
+    for (; running > 0; running--) {
+        int status = 0;
+        wait(&status);
+        failed += !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    double runS = (nowNs() - t0)*1e-9;
 
-        g1.savetops(fileName);
-        g1.set_xlabel("x").set_ylabel("z");//.set_zlabel("z");
-        g1.set_grid().set_xrange(0,500).set_yrange(0,1200);//set_zrange(0,1200);
-        g1.set_title("Simulator Generated Vehicle Data\\n testData1");
-        g1.set_style("points").plot_xy(x, z, "Simulated vehicle trajectory").plot_xy(_x, _z, "Predicted vehicle trajectory");
+    t0 = nowNs();
+    CampaignStats merged;
+    string error;
+    bool ok = failed == 0 && mergeCampaign(c, campaignPartials(dir), merged, error);
+    double mergeS = (nowNs() - t0)*1e-9;
+    cout << "Campaign of " << runs << " landings in " << c.blocks() << " blocks, " << shards << " shards on "
+         << processes << " processes: " << runS << " s, " << runs/runS << " landings/s, merge " << mergeS*1e3 << " ms\n";
+    if (!ok) {
+        cout << "  " << (failed > 0 ? to_string(failed) + " shard process(es) failed" : error) << "\n";
+        return;
     }
-    catch (GnuplotException ge) {
-        cout << ge.what() << endl;
+    printCampaignStats(c, merged);
+
+    // the same campaign as one shard in this process
+    map<uint64_t, CampaignStats> blocks;
+    runCampaignShard(c, sim, 0, 1, processes, blocks);
+    CampaignStats single;
+    for (const auto &b : blocks)
+        single.merge(b.second);
+    string a, b;
+    merged.save(a);
+    single.save(b);
+    cout << "  " << shards << " shards against 1 shard: " << (a == b ? "identical" : "DIFFERENT") << " statistics\n";
+}
+
+
+// Sweeps the landing profile: by default transDecel, hoverAccel,
+// hoverFinalVelocity, descentTargetAltitude, descentFinalVelocity and
+// clockCycle, or the given "name=lo:hi" axes; a grid of points per axis or
+// a Latin hypercube of points samples. Writes the result table to fileName
+// and reports sweep throughput and the best and worst runs
+void runParameterSweep(const Simulator &sim, SweepDesign design, uint32_t points, unsigned threads,
+                       const string &fileName, const vector<string> &axisSpecs) {
+    Sweep sweep;
+    sweep.design  = design;
+    sweep.samples = points;
+    vector<string> specs = axisSpecs;
+    if (specs.empty())
+        specs = { "transDecel=-2:-0.5", "hoverAccel=1:3", "hoverFinalVelocity=8:12",
+                  "descentTargetAltitude=30:70", "descentFinalVelocity=0.2:1", "clockCycle=0.05:0.5" };
+    for (const string &spec : specs) {
+        size_t eq = spec.find('='), colon = spec.find(':', eq);
+        if (eq == string::npos || colon == string::npos ||
+            !sweep.addAxis(spec.substr(0, eq), atof(spec.substr(eq + 1).c_str()), atof(spec.substr(colon + 1).c_str()), points)) {
+            cout << "Bad axis " << spec << " (name=lo:hi with a Simulator attribute name, at most "
+                 << SWEEP_MAX_AXES << " axes)\n";
+            return;
+        }
+    }
+    sweep.prepare();
+
+    vector<vector<float> > table;
+    long long t0 = nowNs();
+    runSweep(sweep, sim, threads, table);
+    double s = (nowNs() - t0)*1e-9;
+    bool saved = saveSweepTable(sweep, table, fileName);
+
+    uint64_t runs = sweep.runs();
+    size_t nAxes = sweep.axes.size();
+    double simulated = 0.0;
+    for (uint64_t i = 0; i < runs; i++)
+        simulated += table[nAxes + 1][i];
+    cout << (design == SWEEP_GRID ? "Grid" : "Latin hypercube") << " sweep of " << runs << " landings over "
+         << nAxes << " attributes on " << TaskPool::workers(runs, threads) << " thread(s): " << s << " s\n";
+    cout << "  " << runs/s << " landings/s, " << simulated/s << " simulated seconds/s\n";
+    cout << "  table of " << runs << " x " << table.size() << " written to " << fileName
+         << (saved ? "" : " FAILED") << "\n";
+
+    // best and worst run by peak estimation error
+    const vector<float> &peak = table[nAxes + 2];
+    size_t best  = min_element(peak.begin(), peak.end()) - peak.begin();
+    size_t worst = max_element(peak.begin(), peak.end()) - peak.begin();
+    for (size_t i : { best, worst }) {
+        cout << "  " << (i == best ? "best: " : "worst:");
+        for (size_t k = 0; k < nAxes; k++)
+            cout << " " << sweep.axes[k].name << " " << table[k][i];
+        cout << " ->";
+        for (int k = 0; k < LANDING_METRICS; k++)
+            cout << " " << landingMetricInfo[k].name << " " << table[nAxes + k][i];
+        cout << "\n";
+    }
+}
+
+
+// Runs-to-convergence of P(touchdownError > limit) and mean touchdownError:
+// each sampling method runs until the 95% confidence interval is within
+// relTarget of P and relTarget/5 of the mean (or maxRuns). Plain and antithetic MC use the
+// standard error of runs (pairs); Sobol uses the spread of 8 independently
+// scrambled replicates, doubling the points per replicate. Then the change
+// in mean touchdownError between two estimator tunings, with independent
+// and with common random numbers
+void compareSampling(const Simulator &sim, double relTarget, uint64_t maxRuns, unsigned threads) {
+    const uint64_t step = 64, minRuns = 256;
+    const int replicates = 8;
+    const double t7 = 2.365;        // Student t, 95%, 7 degrees of freedom
+    Campaign c = landingCampaign(maxRuns);
+    const double target[2] = { relTarget, relTarget/5.0 };
+    cout << "Runs to a 95% confidence interval within " << 100.0*target[0] << "% of P(touchdownError > "
+         << c.failureLimit << " m) and " << 100.0*target[1] << "% of the mean (at most " << maxRuns << " runs)\n";
+
+    const char *methods[3] = { "plain MC", "antithetic", "Sobol (8 scrambles)" };
+    CampaignSampling sampling[3] = { SAMPLING_MC, SAMPLING_ANTITHETIC, SAMPLING_SOBOL };
+    vector<LandingMetrics> out;
+    for (int m = 0; m < 3; m++) {
+        c.sampling = sampling[m];
+        Moments est[2];                 // per run (or pair, or replicate) estimates of P and the mean
+        uint64_t runs = 0, converged[2] = { 0, 0 };
+        long long t0 = nowNs();
+
+        if (sampling[m] != SAMPLING_SOBOL) {
+            while (runs < maxRuns && (converged[0] == 0 || converged[1] == 0)) {
+                evaluateCampaignRuns(c, sim, runs, step, threads, out);
+                for (uint64_t i = 0; i < step; i += (m == 1 ? 2 : 1)) {
+                    double f[2] = { double(out[i].touchdownError() > c.failureLimit), out[i].touchdownError() };
+                    if (m == 1) {
+                        f[0] = 0.5*(f[0] + double(out[i + 1].touchdownError() > c.failureLimit));
+                        f[1] = 0.5*(f[1] + out[i + 1].touchdownError());
+                    }
+                    est[0].add(f[0]);
+                    est[1].add(f[1]);
+                }
+                runs += step;
+                for (int q = 0; q < 2; q++)
+                    if (converged[q] == 0 && runs >= minRuns && est[q].halfWidth() <= target[q]*fabs(est[q].mean))
+                        converged[q] = runs;
+            }
+        }
+        else {
+            if (c.sobolDims() < c.params.size())
+                cout << "  (" << c.params.size() - c.sobolDims() << " parameter(s) past the first " << SOBOL_MAX_DIMS
+                     << " are sampled pseudo-randomly)\n";
+            vector<Moments> rep[2];
+            rep[0].resize(replicates);
+            rep[1].resize(replicates);
+            for (uint64_t n = 0, next = 32; replicates*next <= maxRuns && (converged[0] == 0 || converged[1] == 0);
+                 n = next, next *= 2) {
+                for (int r = 0; r < replicates; r++) {
+                    c.seed = r + 1;
+                    evaluateCampaignRuns(c, sim, n, next - n, threads, out);
+                    for (const LandingMetrics &l : out) {
+                        rep[0][r].add(double(l.touchdownError() > c.failureLimit));
+                        rep[1][r].add(l.touchdownError());
+                    }
+                }
+                runs = replicates*next;
+                for (int q = 0; q < 2; q++) {
+                    est[q] = Moments();
+                    for (int r = 0; r < replicates; r++)
+                        est[q].add(rep[q][r].mean);
+                    if (converged[q] == 0 && runs >= minRuns && est[q].halfWidth(t7) <= target[q]*fabs(est[q].mean))
+                        converged[q] = runs;
+                }
+            }
+            c.seed = 1;
+        }
+        double s = (nowNs() - t0)*1e-9;
+        double z = sampling[m] == SAMPLING_SOBOL ? t7 : 1.96;
+        cout << "  " << methods[m] << ": P = " << est[0].mean << " +- " << est[0].halfWidth(z) << " after "
+             << (converged[0] ? to_string(converged[0]) : "> " + to_string(runs)) << " runs; mean touchdownError "
+             << est[1].mean << " +- " << est[1].halfWidth(z) << " m after "
+             << (converged[1] ? to_string(converged[1]) : "> " + to_string(runs)) << " runs (" << s << " s)\n";
+    }
+
+    // processNoise 0.1 against 1.0: independent noise against common random numbers
+    c.sampling = SAMPLING_MC;
+    Campaign tuned = c;
+    tuned.processNoise = 1.0;
+    for (int crn = 0; crn < 2; crn++) {
+        tuned.seed = crn ? c.seed : c.seed + 1000;
+        Moments a, b, diff;
+        vector<LandingMetrics> outB;
+        uint64_t runs = 0, converged = 0;
+        while (runs < maxRuns && converged == 0) {
+            evaluateCampaignRuns(c, sim, runs, step, threads, out);
+            evaluateCampaignRuns(tuned, sim, runs, step, threads, outB);
+            for (uint64_t i = 0; i < step; i++) {
+                a.add(out[i].touchdownError());
+                b.add(outB[i].touchdownError());
+                diff.add(outB[i].touchdownError() - out[i].touchdownError());
+            }
+            runs += step;
+            double half = crn ? diff.halfWidth() : 1.96*sqrt(a.variance()/a.n + b.variance()/b.n);
+            if (runs >= minRuns && half <= relTarget*fabs(b.mean - a.mean))
+                converged = runs;
+        }
+        double half = crn ? diff.halfWidth() : 1.96*sqrt(a.variance()/a.n + b.variance()/b.n);
+        cout << "  processNoise 1.0 - 0.1, " << (crn ? "common random numbers" : "independent noise    ") << ": "
+             << b.mean - a.mean << " +- " << half << " m after "
+             << (converged ? to_string(converged) : "> " + to_string(runs)) << " runs per tuning\n";
     }
 }
 
 
-int main() {  
+// Failure probability of a rare multipath case, P(touchdownError >
+// limit) with the offset uniform over 0-4 m and the duration over 0.1-1 s:
+// importance sampling tuned by cross-entropy, against brute-force Monte
+// Carlo on the same case. Both report the 95% confidence interval and the
+// landings a 10% interval takes
+void rareMultipathFailures(const Simulator &sim, float limit, uint64_t isRuns, uint64_t mcRuns, unsigned threads) {
+    const uint64_t batch = 1024, pilotRuns = 2000;
+    Simulator base = sim;
+    base.clockCycle = 0.1;
+    MultipathImportance is;
+    is.failureLimit = limit;
+    cout << "P(touchdownError > " << limit << " m), multipath offset " << is.lo[0] << " - " << is.hi[0]
+         << " m, duration " << is.lo[1] << " - " << is.hi[1] << " s\n";
+
+    long long t0 = nowNs();
+    uint64_t pilot = tuneMultipathImportance(is, base, pilotRuns, threads);
+    double topQuarter[2] = { 0.0, 0.0 };
+    for (int k = 0; k < 2; k++)
+        for (int b = 3*IMPORTANCE_BINS/4; b < IMPORTANCE_BINS; b++)
+            topQuarter[k] += is.prob[k][b];
+    cout << "  cross-entropy tuning: " << pilot << " landings; top quarter of the range drawn with P = "
+         << topQuarter[0] << " (offset), " << topQuarter[1] << " (duration); noise shift at the end of bursts "
+         << is.lidar.noiseShift[0] << " m\n";
+
+    // landings for a 95% interval of +-10%, from the variance per run
+    auto runsFor10 = [](const Moments &m) {
+        return m.mean > 0.0 ? to_string(uint64_t(pow(19.6*m.stddev()/m.mean, 2))) : string("(no failures)");
+    };
+
+    vector<RareEventRun> out;
+    MultipathImportance nominal;
+    nominal.failureLimit = limit;
+    Moments est[2];
+    for (int mc = 0; mc < 2; mc++) {
+        const MultipathImportance &method = mc ? nominal : is;
+        uint64_t runs = mc ? mcRuns : isRuns, failures = 0;
+        double maxWeight = 0.0;
+        if (mc)
+            t0 = nowNs();
+        for (uint64_t first = 0; first < runs; first += batch) {
+            runMultipathImportance(method, base, first, min(batch, runs - first), threads, out);
+            for (const RareEventRun &r : out) {
+                bool fail = r.m.touchdownError() > limit;
+                failures += fail;
+                est[mc].add(fail ? r.weight() : 0.0);
+                if (fail)
+                    maxWeight = max(maxWeight, r.weight());
+            }
+        }
+        double s = (nowNs() - t0)*1e-9;
+        cout << "  " << (mc ? "brute-force MC:     " : "importance sampling:") << " P = " << est[mc].mean << " +- "
+             << est[mc].halfWidth() << " from " << runs << " landings (" << failures << " failures";
+        if (!mc)
+            cout << ", largest weight " << maxWeight;
+        cout << "), " << s << " s; a 10% interval takes " << runsFor10(est[mc]) << " landings"
+             << (mc ? "" : " (plus the tuning)") << "\n";
+    }
+    if (est[0].n > 1 && est[1].n > 1)
+        cout << "  difference: " << (est[0].mean - est[1].mean)/sqrt(pow(est[0].halfWidth(1.0), 2) +
+                                                                  pow(est[1].halfWidth(1.0), 2))
+             << " standard errors\n";
+}
+
+
+// Safe-landing envelope in (descentTargetAltitude, descentFinalVelocity,
+// singleSampleErrorOffset) by adaptive refinement (Envelope), against the
+// full lattice at the same resolution when verify is set: landings run and
+// lattice points classified differently
+void mapEnvelope(const Simulator &sim, uint32_t levels, uint32_t seeds, float errorLimit, unsigned threads,
+                 bool verify, const string &fileName) {
+    Envelope env;
+    env.levels = levels;
+    env.seeds  = seeds;
+    env.errorLimit = errorLimit;
+    env.axes = {
+        { "descentTargetAltitude",   &Simulator::descentTargetAltitude,   20.0f, 100.0f },
+        { "descentFinalVelocity",    &Simulator::descentFinalVelocity,     0.2f,   3.0f },
+        { "singleSampleErrorOffset", &Simulator::singleSampleErrorOffset,  0.2f,   3.0f },
+    };
+    Simulator base = sim;
+    base.clockCycle = 0.1;
+    cout << "Envelope of touchdownError <= " << errorLimit << " m (" << seeds << " landings per point), "
+         << env.points() << " points per axis (" << env.lattice() << " lattice points)\n";
+
+    vector<EnvelopeLevel> progress;
+    long long t0 = nowNs();
+    env.run(base, threads, &progress);
+    double s = (nowNs() - t0)*1e-9;
+    for (size_t l = 0; l < progress.size(); l++)
+        cout << "  level " << l << ": " << progress[l].cells << " cells, " << progress[l].split
+             << " on the boundary, " << progress[l].newPoints << " new points\n";
+    vector<uint8_t> adaptive = env.classify();
+    uint64_t safe = count(adaptive.begin(), adaptive.end(), 1);
+    cout << "  adaptive: " << env.scores.size() << " points (" << 100.0*env.scores.size()/env.lattice()
+         << "% of the lattice), " << env.landings << " landings, " << s << " s; " << env.boundary.size()
+         << " boundary cells, " << 100.0*safe/env.lattice() << "% of the box safe\n";
+
+    // evaluated points: attributes, largest touchdownError and pass/fail
+    vector<vector<float> > table(env.axes.size() + 2);
+    vector<uint32_t> idx(env.axes.size());
+    for (const auto &p : env.scores) {
+        env.index(p.first, idx.data());
+        for (size_t a = 0; a < env.axes.size(); a++)
+            table[a].push_back(env.value(a, idx[a]));
+        table[env.axes.size()].push_back(p.second);
+        table[env.axes.size() + 1].push_back(p.second <= errorLimit);
+    }
+    vector<string> names;
+    vector<const float*> columns;
+    for (const CampaignParam &a : env.axes)
+        names.push_back(a.name);
+    names.push_back("touchdownError");
+    names.push_back("safe");
+    for (const vector<float> &c : table)
+        columns.push_back(c.data());
+    bool saved = TelemetryCsv::write(fileName, names, columns, env.scores.size());
+    cout << "  evaluated points written to " << fileName << (saved ? "" : " FAILED") << "\n";
+
+    if (!verify)
+        return;
+    Envelope full = env;
+    full.clear();
+    vector<uint64_t> all(full.lattice());
+    for (uint64_t k = 0; k < all.size(); k++)
+        all[k] = k;
+    t0 = nowNs();
+    full.evaluate(all, base, threads);
+    s = (nowNs() - t0)*1e-9;
+    uint64_t wrong = 0, unresolved = 0;
+    for (uint64_t k = 0; k < all.size(); k++) {
+        if (adaptive[k] == 2)
+            unresolved++;
+        else if (adaptive[k] != full.pass(k))
+            wrong++;
+    }
+    cout << "  full lattice: " << full.landings << " landings, " << s << " s; the adaptive map used "
+         << 100.0*env.landings/full.landings << "% of them and classifies " << wrong << " of "
+         << all.size() << " points differently";
+    if (unresolved > 0)
+        cout << " (" << unresolved << " not covered)";
+    cout << "\n";
+}
+
+
+int main(int argc, char *argv[]) {  
   
     // Initialise the simulation object & attributes
     Simulator testData1;
@@ -316,55 +1725,272 @@ int main() {
     testData1.setDecelAttributes(50.0, 0.5);
     testData1.genSimData();
 
-    // Plot/save telemetry data
-    plotTelemetryData(testData1, "testData1_output_check");
-
     // Initialise the estimation object for 3DoF model
-    // Considering the following example:
-    // https://www.kalmanfilter.net/stateextrap.html#ex2
-    // TODO: doubling up on parameter/attribute names... not a good implementation
     Estimator3DoF vehicleState3DoF;
-    MatrixXd F  = MatrixXd(6,6); // state transition matrix
-    MatrixXd G  = MatrixXd(6,3); // control matrix
-    MatrixXd _X = MatrixXd(6,1); // extrapolation equation result
-    MatrixXd x  = MatrixXd(6,1); // current vehicle state
-    MatrixXd u  = MatrixXd(3,1); // control input
-
-    F << 1.0, 0.0, 0.0, testData1.clockCycle, 0.0, 0.0,
-         0.0, 1.0, 0.0, 0.0, testData1.clockCycle, 0.0,
-         0.0, 0.0, 1.0, 0.0, 0.0, testData1.clockCycle,
-         0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
-         0.0, 0.0, 0.0, 0.0, 1.0, 0.0,
-         0.0, 0.0, 0.0, 0.0, 0.0, 1.0;
-    
-    G << 0.5*pow(testData1.clockCycle,2), 0.0, 0.0,
-         0.0, 0.5*pow(testData1.clockCycle,2), 0.0,
-         0.0, 0.0, 0.5*pow(testData1.clockCycle,2),
-         testData1.clockCycle, 0.0, 0.0,
-         0.0, testData1.clockCycle, 0.0,
-         0.0, 0.0, testData1.clockCycle;
-
-    vehicleState3DoF.setStateAttributes(F, G);
+    MatrixXd x0 = MatrixXd(6,1); // initial vehicle state
+
+    configureEstimator3DoF(vehicleState3DoF, testData1);
+
+    x0 << testData1.vehicleTelemetry[1][0],
+          testData1.vehicleTelemetry[2][0],
+          testData1.vehicleTelemetry[3][0],
+          testData1.transInitVelocity, 0.0, 0.0;
+
+    // ./case-study whatif [dropStart] [dropEnd] [checkpointInterval]
+    if (argc > 1 && string(argv[1]) == "whatif") {
+        int dropStart = argc > 2 ? atoi(argv[2]) : testData1.nSamples/2;
+        int dropEnd   = argc > 3 ? atoi(argv[3]) : dropStart + 20;
+        int interval  = argc > 4 ? atoi(argv[4]) : 100;
+        if (interval <= 0) {
+            cout << "checkpoint interval must be positive\n";
+            return 1;
+        }
+        whatIfDropout(testData1, vehicleState3DoF, x0, MatrixXd::Identity(6,6), dropStart, dropEnd, interval);
+        return 0;
+    }
+
+    // ./case-study pipeline [nSamples] [batch] [queueSize]
+    if (argc > 1 && string(argv[1]) == "pipeline") {
+        long   nTotal    = argc > 2 ? atol(argv[2]) : 1000000;
+        size_t batch     = argc > 3 ? atoi(argv[3]) : 64;
+        size_t queueSize = argc > 4 ? atoi(argv[4]) : 4096;
+        if (nTotal <= 0 || (argc > 3 && atoi(argv[3]) <= 0)) {
+            cout << "sample count and batch must be positive\n";
+            return 1;
+        }
+        runPipeline(testData1, vehicleState3DoF, x0, MatrixXd::Identity(6,6), nTotal, batch, queueSize, false);
+        runPipeline(testData1, vehicleState3DoF, x0, MatrixXd::Identity(6,6), nTotal, batch, queueSize, true);
+        return 0;
+    }
+
+    // ./case-study realtime [rateHz] [cycles] [cpu] [fifoPriority] [mlock]
+    // Without a rate the loop is checked at 10, 100 and 1000 Hz
+    if (argc > 1 && string(argv[1]) == "realtime") {
+        double rateHz   = argc > 2 ? atof(argv[2]) : 0.0;
+        long   nCycles  = argc > 3 ? atol(argv[3]) : 100;
+        int    cpu      = argc > 4 ? atoi(argv[4]) : -1;
+        int    priority = argc > 5 ? atoi(argv[5]) : 0;
+        bool   lockMem  = argc > 6 ? atoi(argv[6]) != 0 : false;
+
+        double rates[] = {10.0, 100.0, 1000.0};
+        for (int k = 0; k < 3; k++) {
+            if (rateHz > 0.0 && rates[k] != rateHz) {
+                continue;
+            }
+            runRealtime(testData1, rates[k], nCycles, cpu, priority, lockMem);
+        }
+        if (rateHz > 0.0 && rateHz != 10.0 && rateHz != 100.0 && rateHz != 1000.0) {
+            runRealtime(testData1, rateHz, nCycles, cpu, priority, lockMem);
+        }
+        return 0;
+    }
+
+    // ./case-study live [rateHz] [cycles] [window]
+    // Same loop without and with a 5 Hz live altitude plot
+    if (argc > 1 && string(argv[1]) == "live") {
+        double rateHz  = argc > 2 ? atof(argv[2]) : 1000.0;
+        long   nCycles = argc > 3 ? atol(argv[3]) : 5000;
+        size_t window  = argc > 4 ? atoi(argv[4]) : 2000;
+
+        runRealtime(testData1, rateHz, nCycles, -1, 0, false);
+        {
+            vector<string> titles;
+            titles.push_back("true altitude");
+            titles.push_back("estimated altitude");
+            LivePlotter live(titles, window, 5.0);
+            runRealtime(testData1, rateHz, nCycles, -1, 0, false, &live);
+            if (!live.error.empty())
+                cout << "  live plot: " << live.error << "\n";
+            cout << "  live plot: " << live.pushed << " samples queued, " << live.dropped << " dropped, "
+                 << live.frames << " frames, " << live.skipped << " frames skipped\n";
+        }
+        return 0;
+    }
+
+    // ./case-study density [points] [threads] [size]
+    if (argc > 1 && string(argv[1]) == "density") {
+        long long    nPoints = argc > 2 ? atoll(argv[2]) : 100000000LL;
+        unsigned int threads = argc > 3 ? atoi(argv[3]) : 0;
+        unsigned int size    = argc > 4 ? atoi(argv[4]) : 1024;
+        renderDensity(testData1, nPoints, threads, size);
+        return 0;
+    }
+
+    // ./case-study instrument [iterations]
+    if (argc > 1 && string(argv[1]) == "instrument") {
+        measureInstrumentationOverhead(testData1, argc > 2 ? atol(argv[2]) : 1000000);
+        return 0;
+    }
+
+    // ./case-study alloc
+    if (argc > 1 && string(argv[1]) == "alloc") {
+        measureAllocations(testData1, vehicleState3DoF, x0);
+        return 0;
+    }
+
+    // ./case-study async [reports]
+    if (argc > 1 && string(argv[1]) == "async") {
+        measureAsyncPlotting(testData1, vehicleState3DoF, x0, argc > 2 ? atoi(argv[2]) : 20);
+        return 0;
+    }
+
+    // ./case-study pool [reports] [processes] [png]
+    if (argc > 1 && string(argv[1]) == "pool") {
+        int    reports   = argc > 2 ? atoi(argv[2]) : 1000;
+        size_t processes = argc > 3 ? atoi(argv[3]) : max(2u, thread::hardware_concurrency());
+        bool   png       = argc > 4 ? atoi(argv[4]) != 0 : true;
+        measurePlotterPool(testData1, vehicleState3DoF, x0, reports, processes, png ? PLOT_PNG : PLOT_PS);
+        return 0;
+    }
+
+    // ./case-study record [file] [clockCycle]
+    if (argc > 1 && string(argv[1]) == "record") {
+        string fileName   = argc > 2 ? argv[2] : "testData1.tlm";
+        float  clockCycle = argc > 3 ? atof(argv[3]) : 0.1;
+        recordTelemetry(testData1, vehicleState3DoF, fileName, clockCycle);
+        return 0;
+    }
+
+    // ./case-study compress
+    if (argc > 1 && string(argv[1]) == "compress") {
+        measureCompression(testData1, vehicleState3DoF);
+        return 0;
+    }
+
+    // ./case-study recorder [rateHz] [cycles] [seconds] [file]
+    if (argc > 1 && string(argv[1]) == "recorder") {
+        double rateHz   = argc > 2 ? atof(argv[2]) : 1000.0;
+        long   nCycles  = argc > 3 ? atol(argv[3]) : 5000;
+        double seconds  = argc > 4 ? atof(argv[4]) : 2.0;
+        string fileName = argc > 5 ? argv[5] : "flight.rec";
+        measureFlightRecorder(testData1, rateHz, nCycles, seconds, fileName);
+        return 0;
+    }
+
+    // ./case-study recover [file]
+    if (argc > 1 && string(argv[1]) == "recover") {
+        return recoverFlightRecord(argc > 2 ? argv[2] : "flight.rec") ? 0 : 1;
+    }
+
+    // ./case-study csv [rows] [threads] [precision]
+    if (argc > 1 && string(argv[1]) == "csv") {
+        size_t   rows      = argc > 2 ? atol(argv[2]) : 2000000;
+        unsigned threads   = argc > 3 ? atoi(argv[3]) : max(1u, thread::hardware_concurrency());
+        int      precision = argc > 4 ? atoi(argv[4]) : 4;
+        measureCsv(testData1, vehicleState3DoF, rows, threads, precision);
+        return 0;
+    }
+
+    // ./case-study replay [file] [sizeMB] [speed] [seconds]
+    // speed 0 replays as fast as possible; the log is generated if missing
+    if (argc > 1 && string(argv[1]) == "replay") {
+        string fileName = argc > 2 ? argv[2] : "lidar.tlm";
+        size_t sizeMB   = argc > 3 ? atol(argv[3]) : 1024;
+        double speed    = argc > 4 ? atof(argv[4]) : 0.0;
+        double seconds  = argc > 5 ? atof(argv[5]) : 5.0;
+        replayLog(testData1, fileName, sizeMB, speed, seconds);
+        return 0;
+    }
+
+    // ./case-study stream [maxMB] [chunkRows] [file]
+    if (argc > 1 && string(argv[1]) == "stream") {
+        size_t maxMB     = argc > 2 ? atol(argv[2]) : 102400;
+        size_t chunkRows = argc > 3 ? atol(argv[3]) : 65536;
+        string fileName  = argc > 4 ? argv[4] : "stream.tlm";
+        measureStreaming(testData1, maxMB, chunkRows, fileName);
+        return 0;
+    }
+
+    // ./case-study fleet [dir] [threads] [files] [summary]
+    if (argc > 1 && string(argv[1]) == "fleet") {
+        string   dir     = argc > 2 ? argv[2] : "fleet";
+        unsigned threads = argc > 3 ? atoi(argv[3]) : 0;
+        size_t   nFiles  = argc > 4 ? atol(argv[4]) : 200;
+        string   summary = argc > 5 ? argv[5] : "fleet_summary.csv";
+        reprocessFleet(testData1, dir, threads, nFiles, summary);
+        return 0;
+    }
+
+    // ./case-study campaign [runs] [shards] [processes] [dir]
+    if (argc > 1 && string(argv[1]) == "campaign") {
+        uint64_t runs      = argc > 2 ? atoll(argv[2]) : 20000;
+        uint64_t shards    = argc > 3 ? atoll(argv[3]) : 8;
+        unsigned processes = argc > 4 ? atoi(argv[4]) : max(1u, thread::hardware_concurrency());
+        string   dir       = argc > 5 ? argv[5] : "campaign";
+        runShardedCampaign(testData1, runs, max<uint64_t>(1, shards), max(1u, processes), dir);
+        return 0;
+    }
+
+    // ./case-study shard <dir> <index> <count> [runs] [threads]
+    // One shard of the campaign, e.g. on another host sharing dir
+    if (argc > 4 && string(argv[1]) == "shard") {
+        uint64_t runs    = argc > 5 ? atoll(argv[5]) : 20000;
+        unsigned threads = argc > 6 ? atoi(argv[6]) : 0;
+        std::filesystem::create_directories(argv[2]);
+        return runShard(testData1, landingCampaign(runs), argv[2], atoll(argv[3]), atoll(argv[4]), threads) ? 0 : 1;
+    }
+
+    // ./case-study merge <dir> [runs]
+    if (argc > 2 && string(argv[1]) == "merge") {
+        Campaign      c = landingCampaign(argc > 3 ? atoll(argv[3]) : 20000);
+        CampaignStats merged;
+        string        error;
+        if (!mergeCampaign(c, campaignPartials(argv[2]), merged, error)) {
+            cout << error << "\n";
+            return 1;
+        }
+        printCampaignStats(c, merged);
+        return 0;
+    }
+
+    // ./case-study sweep [grid|lhs] [points] [threads] [file] [name=lo:hi ...]
+    if (argc > 1 && string(argv[1]) == "sweep") {
+        SweepDesign design  = argc > 2 && string(argv[2]) == "lhs" ? SWEEP_LATIN_HYPERCUBE : SWEEP_GRID;
+        uint32_t    points  = argc > 3 ? atoi(argv[3]) : (design == SWEEP_GRID ? 4 : 4096);
+        unsigned    threads = argc > 4 ? atoi(argv[4]) : 0;
+        string      file    = argc > 5 ? argv[5] : "sweep.tlm";
+        runParameterSweep(testData1, design, points, threads, file, vector<string>(argv + min(argc, 6), argv + argc));
+        return 0;
+    }
+
+    // ./case-study converge [relTarget] [maxRuns] [threads]
+    if (argc > 1 && string(argv[1]) == "converge") {
+        double   relTarget = argc > 2 ? atof(argv[2]) : 0.1;
+        uint64_t maxRuns   = argc > 3 ? atoll(argv[3]) : 32768;
+        unsigned threads   = argc > 4 ? atoi(argv[4]) : 0;
+        compareSampling(testData1, relTarget, maxRuns, threads);
+        return 0;
+    }
+
+    // ./case-study rare [limit] [isRuns] [mcRuns] [threads]
+    if (argc > 1 && string(argv[1]) == "rare") {
+        float    limit   = argc > 2 ? atof(argv[2]) : 5.0;
+        uint64_t isRuns  = argc > 3 ? atoll(argv[3]) : 40000;
+        uint64_t mcRuns  = argc > 4 ? atoll(argv[4]) : 200000;
+        unsigned threads = argc > 5 ? atoi(argv[5]) : 0;
+        rareMultipathFailures(testData1, limit, isRuns, mcRuns, threads);
+        return 0;
+    }
+
+    // ./case-study envelope [levels] [seeds] [errorLimit] [threads] [verify] [file]
+    if (argc > 1 && string(argv[1]) == "envelope") {
+        uint32_t levels  = argc > 2 ? atoi(argv[2]) : 3;
+        uint32_t seeds   = argc > 3 ? atoi(argv[3]) : 4;
+        float    limit   = argc > 4 ? atof(argv[4]) : 3.0;
+        unsigned threads = argc > 5 ? atoi(argv[5]) : 0;
+        bool     verify  = argc > 6 ? atoi(argv[6]) != 0 : false;
+        string   file    = argc > 7 ? argv[7] : "envelope.csv";
+        mapEnvelope(testData1, levels, seeds, limit, threads, verify, file);
+        return 0;
+    }
+
+    // Plot/save telemetry data
+    plotTelemetryData(testData1, "testData1_output_check");
 
     // Create an estimate of the vehicle state
-    // Utilise the simulated data as the current state
-    for (int i = 0; i < NPOINTS; i++) {
-        x << testData1.vehicleTelemetry[1][i], 
-             testData1.vehicleTelemetry[2][i], 
-             testData1.vehicleTelemetry[3][i], 
-             testData1.vehicleTelemetry[4][i], 
-             testData1.vehicleTelemetry[5][i], 
-             testData1.vehicleTelemetry[6][i];
-
-        _X = vehicleState3DoF.estimateState(x, u);
-
-        testData1.predVehicleState[1][i] = _X(0,0);
-        testData1.predVehicleState[2][i] = _X(1,0);
-        testData1.predVehicleState[3][i] = _X(2,0);
-        testData1.predVehicleState[1][i] = _X(3,0);
-        testData1.predVehicleState[2][i] = _X(4,0);
-        testData1.predVehicleState[3][i] = _X(5,0);
-    } 
+    // Utilise the simulated position data as the measurement
+    vehicleState3DoF.setInitialState(x0, MatrixXd::Identity(6,6));
+    runEstimator(testData1, vehicleState3DoF, 0, testData1.nSamples);
 
     // Compare simulated data to predicted results
     // TODO: DRY......
@@ -381,4 +2007,4 @@ int main() {
     Estimator6DoF vehicleState6DoF;
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,1686 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Landing simulator, lidar error model and 3DoF Kalman filter
+///
+///  Shared by case-study-main.cpp and case-study-bench.cpp. Like
+///  gnuplot_i.hpp this header defines non-inline functions, so include it
+///  from exactly one translation unit per executable. File-scope tables and
+///  small helpers are inline, so a program that never uses one is not
+///  warned about it.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _CASE_STUDY_H_
+#define _CASE_STUDY_H_
+
+
+#include <cmath>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <algorithm>
+#include <type_traits>
+#include <memory>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <fstream>
+
+#include "instrumentation.hpp" // INSTRUMENT_SCOPE probes, enabled with -DCASE_STUDY_INSTRUMENT
+#include "alloc_tracker.hpp" // allocation tracking, enabled with -DCASE_STUDY_TRACK_ALLOC; must precede Eigen
+
+#include <Eigen/Dense>   // matrix manipulation library
+
+#include "gnuplot_i.hpp" // Gnuplot class handles POSIX-Pipe-communication with Gnuplot
+#include "downsample.hpp" // LTTB / min-max reduction of plot series
+#include "async_plotter.hpp" // background plotting on a persistent gnuplot process
+#include "telemetry_file.hpp" // mmap-able columnar telemetry files
+#include "telemetry_csv.hpp" // to_chars/from_chars CSV export and import
+#include "task_pool.hpp" // worker threads claiming tasks in order
+#include "mergeable_stats.hpp" // moments, histograms and quantile sketches that merge exactly
+#include "sobol.hpp" // scrambled Sobol points for quasi-Monte Carlo campaigns
+
+using namespace std;
+using Eigen::MatrixXd;
+
+#if defined(CASE_STUDY_TRACK_ALLOC)
+// Every Eigen heap allocation now trips eigen_assert, which AllocTracker counts
+inline const bool eigenMallocTracked = !Eigen::internal::set_is_malloc_allowed(false);
+#endif
+
+#define NSTATES 7 // time + number of vehicle states considered
+#define NPOINTS 18000 // number of samples points require for 30min @10Hz sampling rate
+#define PI 3.14159
+#define g 9.81
+#define PLOT_MAX_POINTS 2000 // points per plotted series after downsampling
+
+/*
+Vehicle landing profile:
+---P1--->
+        |
+        P2
+        |
+        v
+        |
+        P3
+        |
+        v
+        |
+        P4
+        |
+        v
+        _
+*/
+class Simulator {
+    // TODO: if time, create proper get/set methods
+    public:
+        float clockCycle; 
+
+        // System attributes
+        float lidarMinRange;
+        float singleSampleErrorOffset;
+        float multipathErrorOffset; 
+        float multipathErrorDuration;
+
+        // Phase 1: transition phase attributes
+        float transInitVelocity;
+        float transFinalVelocity;
+        float transDecel;
+        float transCruiseAltitude; 
+        float transHeadingAngle;
+
+        // Phase 2: acceleration/hover phase attributes
+        float hoverAccel; 
+        float hoverInitVelocity;
+        float hoverFinalVelocity;  
+
+        // Phase 3: deceleration/touchdown phase attributes
+        float descentTargetAltitude; 
+        float descentFinalVelocity; // aiming for low touchdown impact g
+
+        // TODO: if time, fix up creation of telemetry data i.e dynamic implementation
+        float vehicleTelemetry[NSTATES][NPOINTS];
+        float predVehicleState[NSTATES][NPOINTS];
+        int   nSamples = 0; // number of populated columns in vehicleTelemetry
+
+        // Set system attributes method
+        void setSystemAttributes(float a, float b, float c, float d, float e) {
+            clockCycle              = a; 
+            lidarMinRange           = b;
+            singleSampleErrorOffset = c;
+            multipathErrorOffset    = d;
+            multipathErrorDuration  = e;
+        }
+
+        // Phase 1 method
+        void setTransAttributes(float a, float b, float c, float d, float e) {
+            transInitVelocity   = a; 
+            transFinalVelocity  = b;
+            transDecel          = c;
+            transCruiseAltitude = d;
+            transHeadingAngle   = e;
+        }
+
+        // Phase 2 method
+        void setAccelAttributes(float x, float y, float z) {
+            hoverInitVelocity  = x;
+            hoverFinalVelocity = y;
+            hoverAccel         = z; 
+        }
+
+        // Phase 3
+        // Constant velocity; no attributes
+
+        // Phase 4 method
+        // Assuming that vehicle will have decelerated to final velocity at z ~= 0.0
+        void setDecelAttributes(float x, float y) {
+            descentTargetAltitude = x;
+            descentFinalVelocity  = y;
+        }
+
+        // Outside method declaration
+        void genSimData();
+};
+
+
+// Incremental landing profile generator
+// Produces one telemetry column [t, x, y, z, vx, vy, vz] per clock cycle so the
+// simulation can run as a stream (e.g. as a pipeline stage) rather than in bulk
+class SimulatorStream {
+    public:
+        const Simulator *sim = NULL;
+        int   index = 0;
+        float t = 0.0;
+        float dt = 0.0;
+        float x_K1 = 0.0, y_K1 = 0.0, z_K1 = 0.0;
+        float vx_K1 = 0.0, vy_K1 = 0.0, vz_K1 = 0.0;
+
+        // Guards/time limits for each landing phase
+        float timeGuardP1, timeGuardP2, timeGuardP3, timeGuardP4;
+        float descentDecel;
+        float totalTimeGuard;
+
+    void init(const Simulator &s) {
+        sim   = &s;
+        index = 0;
+        t     = 0.0;
+        dt    = s.clockCycle;
+        x_K1  = 0.0, y_K1 = 0.0, z_K1 = s.transCruiseAltitude;
+        vx_K1 = s.transInitVelocity, vy_K1 = 0.0, vz_K1 = 0.0;
+
+        // ---------------------
+        // In this section, calculate the guards/time limits for each landing phase
+        // ---------------------
+        // t = (v-u)/a
+        timeGuardP1 = abs((s.transFinalVelocity-s.transInitVelocity) / s.transDecel);
+        //float remP1       = remainder(timeEndP1, clockCycle);
+        //float timeGuardP1 = (timeEndP1 - remP1) + clockCycle; // wait for completion of clock cycle once phase end time is reached
+
+        // t = (v-u)/a
+        // s = ut + 0.5*at^2
+        timeGuardP2 = abs((s.hoverFinalVelocity-s.hoverInitVelocity) / s.hoverAccel); 
+        float totalDistP2 = s.hoverInitVelocity*timeGuardP2 + 0.5*s.hoverAccel*pow(timeGuardP2,2);
+
+        // t = (total-s2-s1)/(0.5*(u+v))
+        timeGuardP3 = (s.transCruiseAltitude - totalDistP2 - s.descentTargetAltitude)/(s.hoverFinalVelocity);
+
+        // t = 2s/(u+v)
+        timeGuardP4  = 2.0*s.descentTargetAltitude/(s.hoverFinalVelocity + s.descentFinalVelocity);
+        descentDecel = (s.descentFinalVelocity - s.hoverFinalVelocity)/timeGuardP4;
+
+        // This is the total duration of the landing phase
+        totalTimeGuard = timeGuardP1 + timeGuardP2 + timeGuardP3 + timeGuardP4;
+    }
+
+    // Writes the next telemetry column; returns false once the vehicle has landed
+    bool next(float sample[NSTATES]) {
+        INSTRUMENT_SCOPE("sim.next");
+        float x = 0.0, y = 0.0, z = 0.0;
+        float vx = vx_K1, vy = vy_K1, vz = vz_K1;
+
+        if (index > 0) {
+            if (t >= totalTimeGuard) {
+                return false;
+            }
+            t += dt;
+
+            if (t < timeGuardP1) {
+                x  = vx_K1*dt + 0.5*sim->transDecel*pow(dt,2);
+                vx = (vx_K1 + sim->transDecel*dt);//*cos(double(PI*transHeadingAngle/180.0));
+
+                y  = vy_K1*dt + 0.5*sim->transDecel*pow(dt,2);
+                vy = (vy_K1 + sim->transDecel*dt);//*sin(double(PI*transHeadingAngle/180.0));
+                //cout << "PHASE 1: \n";
+            }
+            else if (t < (timeGuardP1 + timeGuardP2)) {
+                z  = vz_K1*dt + 0.5*sim->hoverAccel*pow(dt,2);
+                vz = vz_K1 + sim->hoverAccel*dt;
+                //cout << "PHASE 2: \n";
+            }
+            else if (t < (timeGuardP1 + timeGuardP2 + timeGuardP3)) {
+                z  = vz_K1*dt;
+                vz = vz_K1;
+                //cout << "PHASE 3: \n";
+            }
+            else if (t < (timeGuardP1 + timeGuardP2 + timeGuardP3 + timeGuardP4)) {
+                z  = vz_K1*dt + 0.5*descentDecel*pow(dt,2);
+                vz = vz_K1 + descentDecel*dt;
+                //cout << "PHASE 4: \n";
+            }
+            else {
+                // pass
+            }
+        }
+
+        // ---------------------
+        // Variables with _K1 addendum are used to store previous value
+        // ---------------------
+        x_K1  = x_K1 + x;
+        y_K1  = y_K1 + y; // TODO: idealisation of landing sequence; assuming heading is 0
+        z_K1  = z_K1 - z;
+        vx_K1 = vx;
+        vy_K1 = vy;
+        vz_K1 = vz;
+
+        sample[0] = t;
+        sample[1] = x_K1;
+        sample[2] = y_K1;
+        sample[3] = z_K1;
+        sample[4] = vx_K1;
+        sample[5] = vy_K1;
+        sample[6] = -vz_K1; // vz is the descent rate; z decreases
+        index++;
+        return true;
+    }
+};
+
+
+// Method generates simulation timeseries data 
+void Simulator::genSimData() {
+    INSTRUMENT_SCOPE("genSimData");
+    SimulatorStream stream;
+    float sample[NSTATES];
+
+    // Clear previous run; the unused tail of the arrays stays at zero
+    memset(vehicleTelemetry, 0, sizeof(vehicleTelemetry));
+    memset(predVehicleState, 0, sizeof(predVehicleState));
+
+    stream.init(*this);
+    nSamples = 0;
+    while (nSamples < NPOINTS && stream.next(sample)) {
+        for (int j = 0; j < NSTATES; j++) {
+            vehicleTelemetry[j][nSamples] = sample[j];
+        }
+        nSamples++;
+    }
+    cout << "VEHICLE HAS LANDED" << "\n";
+};
+
+
+// Optional hook on lidar samples inside a multipath burst, e.g. to bias the
+// noise for importance sampling (MultipathBiasHook): given the true sample,
+// the seconds left in the burst and the single-sample noise drawn, returns
+// extra altitude error. Empty for the nominal model
+typedef std::function<float(const float sample[NSTATES], float remaining, float e)> LidarBurstHook;
+
+
+// Lidar error model
+// Corrupts the true altitude with single-sample noise and multipath bursts;
+// x/y are taken from the vision system as-is
+class LidarErrorModel {
+    public:
+        const Simulator *sim = NULL;
+        std::mt19937 rng;
+        std::normal_distribution<float>       noise;
+        std::uniform_real_distribution<float> uniform;
+        float multipathRate      = 0.01; // probability of a multipath burst starting each sample
+        float multipathRemaining = 0.0;  // seconds left in the current burst
+        LidarBurstHook burstHook;
+
+    void init(const Simulator &s, unsigned int seed = 1, const LidarBurstHook &hook = LidarBurstHook()) {
+        sim   = &s;
+        rng.seed(seed);
+        noise = std::normal_distribution<float>(0.0, s.singleSampleErrorOffset);
+        multipathRemaining = 0.0;
+        burstHook = hook;
+    }
+
+    // Writes the measured position; returns false when there is no valid lidar
+    // return (altitude below lidarMinRange)
+    bool measure(const float sample[NSTATES], float z[3]) {
+        INSTRUMENT_SCOPE("lidar.measure");
+        float e = noise(rng);
+        z[0] = sample[1];
+        z[1] = sample[2];
+        z[2] = sample[3] + e;
+
+        if (multipathRemaining <= 0.0 && uniform(rng) < multipathRate) {
+            multipathRemaining = sim->multipathErrorDuration;
+        }
+        if (multipathRemaining > 0.0) {
+            if (burstHook)
+                z[2] += burstHook(sample, multipathRemaining, e);
+            z[2] += sim->multipathErrorOffset;
+            multipathRemaining -= sim->clockCycle;
+        }
+
+        return sample[3] >= sim->lidarMinRange;
+    }
+};
+
+
+// Compact POD image of the complete Estimator3DoF state
+// Matrices are stored column-major (Eigen default) so they can be mapped directly
+struct Estimator3DoFSnapshot {
+    int    step;
+    double X[6];
+    double P[6*6];
+    double F[6*6];
+    double G[6*3];
+    double Q[6*6];
+    double H[3*6];
+    double R[3*3];
+};
+static_assert(is_trivially_copyable<Estimator3DoFSnapshot>::value, "snapshot must be memcpy-able");
+
+
+// Kalman filter class
+// 3DoF model
+class Estimator3DoF {
+    public:
+        MatrixXd F  = MatrixXd(6,6);
+        MatrixXd G  = MatrixXd(6,3);
+        MatrixXd _X = MatrixXd::Zero(6,1);
+
+        // Kalman filter attributes
+        MatrixXd P  = MatrixXd::Identity(6,6); // estimate covariance
+        MatrixXd Q  = MatrixXd::Identity(6,6); // process noise covariance
+        MatrixXd H  = MatrixXd(3,6);           // observation matrix (position measurement)
+        MatrixXd R  = MatrixXd::Identity(3,3); // measurement covariance
+        int step = 0;                          // number of predict cycles since initialisation
+
+        // Preallocated workspace so predict/update never touch the heap
+        MatrixXd _Xp = MatrixXd(6,1);
+        MatrixXd FP  = MatrixXd(6,6);
+        MatrixXd PHt = MatrixXd(6,3);
+        MatrixXd S   = MatrixXd(3,3);
+        MatrixXd Kt  = MatrixXd(3,6);          // transposed Kalman gain
+        MatrixXd y   = MatrixXd(3,1);          // innovation
+        Eigen::LLT<MatrixXd> Sllt = Eigen::LLT<MatrixXd>(3);
+
+    void setStateAttributes (MatrixXd x, MatrixXd y) {
+        F = x;
+        G = y;
+    }
+
+    void setNoiseAttributes (MatrixXd q, MatrixXd h, MatrixXd r) {
+        Q = q;
+        H = h;
+        R = r;
+    }
+
+    void setInitialState (MatrixXd x, MatrixXd p) {
+        _X   = x;
+        P    = p;
+        step = 0;
+    }
+
+    // Class evaluates the state extrapolation equation  
+    MatrixXd estimateState (MatrixXd x, MatrixXd u) {
+        INSTRUMENT_SCOPE("kf.estimateState");
+        _X = F*x + G*u;
+        return _X;
+    }
+
+    // Predict step: extrapolate state and covariance
+    // X = F*X + G*u, P = F*P*F' + Q
+    void predict (const MatrixXd &u) {
+        INSTRUMENT_SCOPE("kf.predict");
+        _Xp.noalias() = F*_X;
+        _Xp.noalias() += G*u;
+        _X = _Xp;
+        FP.noalias() = F*P;
+        P.noalias()  = FP*F.transpose();
+        P += Q;
+        step++;
+    }
+
+    // Update step: correct the prediction with a measurement z
+    // K = P*H'*S^-1 with S = H*P*H' + R, solved via Cholesky rather than an
+    // explicit inverse; P = (I - K*H)*P is applied as P - K*(P*H')' since P is symmetric
+    void update (const MatrixXd &z) {
+        INSTRUMENT_SCOPE("kf.update");
+        PHt.noalias() = P*H.transpose();
+        S.noalias()   = H*PHt;
+        S += R;
+        Sllt.compute(S);
+        Kt = PHt.transpose();
+        Sllt.solveInPlace(Kt);
+
+        y = z;
+        y.noalias() -= H*_X;
+        _X.noalias() += Kt.transpose()*y;
+        P.noalias()  -= Kt.transpose()*PHt.transpose();
+    }
+
+    // Copy the complete filter state into a POD blob
+    Estimator3DoFSnapshot snapshot() const {
+        Estimator3DoFSnapshot s;
+        s.step = step;
+        Eigen::Map<MatrixXd>(s.X, 6, 1) = _X;
+        Eigen::Map<MatrixXd>(s.P, 6, 6) = P;
+        Eigen::Map<MatrixXd>(s.F, 6, 6) = F;
+        Eigen::Map<MatrixXd>(s.G, 6, 3) = G;
+        Eigen::Map<MatrixXd>(s.Q, 6, 6) = Q;
+        Eigen::Map<MatrixXd>(s.H, 3, 6) = H;
+        Eigen::Map<MatrixXd>(s.R, 3, 3) = R;
+        return s;
+    }
+
+    // Rewind the filter to a previously taken snapshot
+    void restore(const Estimator3DoFSnapshot &s) {
+        step = s.step;
+        _X = Eigen::Map<const MatrixXd>(s.X, 6, 1);
+        P  = Eigen::Map<const MatrixXd>(s.P, 6, 6);
+        F  = Eigen::Map<const MatrixXd>(s.F, 6, 6);
+        G  = Eigen::Map<const MatrixXd>(s.G, 6, 3);
+        Q  = Eigen::Map<const MatrixXd>(s.Q, 6, 6);
+        H  = Eigen::Map<const MatrixXd>(s.H, 3, 6);
+        R  = Eigen::Map<const MatrixXd>(s.R, 3, 3);
+    }
+};
+
+
+// Checkpoint index over a filter run
+// A snapshot is kept every `interval` steps so a replay can resume at any step
+// after at most `interval` predict/update cycles
+class EstimatorCheckpoints {
+    public:
+        int interval = 100;
+        vector<Estimator3DoFSnapshot> snapshots;
+
+    // Rejects non-positive intervals, leaving the index unchanged
+    bool setInterval(int k) {
+        if (k <= 0) {
+            return false;
+        }
+        interval = k;
+        snapshots.clear();
+        return true;
+    }
+
+    // Call once per step before the filter processes it; keeps every K-th state
+    void record(const Estimator3DoF &est) {
+        if (est.step == int(snapshots.size())*interval) {
+            snapshots.push_back(est.snapshot());
+        }
+    }
+
+    // Latest checkpoint at or before the given step; false if nothing was recorded
+    bool nearest(int step, Estimator3DoFSnapshot &s) const {
+        if (snapshots.empty()) {
+            return false;
+        }
+        int i = min(max(step, 0)/interval, int(snapshots.size()) - 1);
+        s = snapshots[i];
+        return true;
+    }
+};
+
+
+// Sets up the 3DoF model matrices for the simulator's clock cycle
+// Considering the following example:
+// https://www.kalmanfilter.net/stateextrap.html#ex2
+// TODO: doubling up on parameter/attribute names... not a good implementation
+// processNoise scales the process noise covariance (the filter tuning)
+void configureEstimator3DoF(Estimator3DoF &est, const Simulator &sim, double processNoise = 0.1) {
+    MatrixXd F  = MatrixXd(6,6); // state transition matrix
+    MatrixXd G  = MatrixXd(6,3); // control matrix
+    MatrixXd H  = MatrixXd(3,6); // observation matrix
+
+    F << 1.0, 0.0, 0.0, sim.clockCycle, 0.0, 0.0,
+         0.0, 1.0, 0.0, 0.0, sim.clockCycle, 0.0,
+         0.0, 0.0, 1.0, 0.0, 0.0, sim.clockCycle,
+         0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+         0.0, 0.0, 0.0, 0.0, 1.0, 0.0,
+         0.0, 0.0, 0.0, 0.0, 0.0, 1.0;
+    
+    G << 0.5*pow(sim.clockCycle,2), 0.0, 0.0,
+         0.0, 0.5*pow(sim.clockCycle,2), 0.0,
+         0.0, 0.0, 0.5*pow(sim.clockCycle,2),
+         sim.clockCycle, 0.0, 0.0,
+         0.0, sim.clockCycle, 0.0,
+         0.0, 0.0, sim.clockCycle;
+
+    H << 1.0, 0.0, 0.0, 0.0, 0.0, 0.0,
+         0.0, 1.0, 0.0, 0.0, 0.0, 0.0,
+         0.0, 0.0, 1.0, 0.0, 0.0, 0.0;
+
+    est.setStateAttributes(F, G);
+    // Process noise covers the unmeasured acceleration; measurement noise follows the lidar error
+    est.setNoiseAttributes(processNoise*MatrixXd::Identity(6,6), H,
+                           pow(sim.singleSampleErrorOffset,2)*MatrixXd::Identity(3,3));
+}
+
+
+// Runs the filter over samples [first, last) of the simulated telemetry and
+// stores the estimates in predVehicleState
+// Samples in [dropStart, dropEnd) are treated as lidar dropouts (predict only)
+void runEstimator(Simulator &data, Estimator3DoF &est, int first, int last,
+                  int dropStart = -1, int dropEnd = -1, EstimatorCheckpoints *checkpoints = NULL) {
+    INSTRUMENT_SCOPE("runEstimator");
+    MatrixXd u = MatrixXd::Zero(3,1); // control input; vehicle acceleration is not measured
+    MatrixXd z = MatrixXd(3,1);       // position measurement
+
+    for (int i = first; i < last; i++) {
+        if (checkpoints != NULL) {
+            checkpoints->record(est);
+        }
+
+        REALTIME_REGION();
+        est.predict(u);
+        if (i < dropStart || i >= dropEnd) {
+            z << data.vehicleTelemetry[1][i],
+                 data.vehicleTelemetry[2][i],
+                 data.vehicleTelemetry[3][i];
+            est.update(z);
+        }
+
+        data.predVehicleState[0][i] = data.vehicleTelemetry[0][i];
+        for (int j = 0; j < 6; j++) {
+            data.predVehicleState[j+1][i] = est._X(j,0);
+        }
+    }
+}
+
+
+// Kalman filter class
+// 6DoF model
+class Estimator6DoF {
+    public:
+        // pass
+};
+
+
+// Vehicle parameter class
+// https://sci-hub.se/10.1109/control.2014.6915128
+// TODO; this class is potentially not required; depending on the state model
+class Vehicle {
+    public:
+        float Jxx; 
+        float Jyy; 
+        float Jzz;
+        float m;
+    
+    void setVehicleAttributes(double x, double y, double z, double a) {
+        Jxx = x; 
+        Jyy = y; 
+        Jzz = z;
+        m   = a; 
+    }
+};
+
+// Copies the first n t/x/y/z telemetry samples into plot columns
+void copyTelemetryColumns(const Simulator &testData, int n,
+                          vector<float> &t, vector<float> &x, vector<float> &y, vector<float> &z) {
+    for (int i = 0; i < n; i++) {
+        t.push_back(testData.vehicleTelemetry[0][i]);
+        x.push_back(testData.vehicleTelemetry[1][i]);
+        y.push_back(testData.vehicleTelemetry[2][i]);
+        z.push_back(testData.vehicleTelemetry[3][i]);
+    }
+}
+
+// Sample indices that plots must keep: both sides of every phase change
+// and touchdown (the last sample)
+void landingFeatures(const Simulator &sim, vector<size_t> &idx) {
+    SimulatorStream stream;
+    stream.init(sim);
+    float guard[3] = { stream.timeGuardP1,
+                       stream.timeGuardP1 + stream.timeGuardP2,
+                       stream.timeGuardP1 + stream.timeGuardP2 + stream.timeGuardP3 };
+
+    idx.clear();
+    int p = 0;
+    for (int i = 1; i < sim.nSamples && p < 3; i++) {
+        while (p < 3 && sim.vehicleTelemetry[0][i] >= guard[p]) {
+            idx.push_back(i - 1);
+            idx.push_back(i);
+            p++;
+        }
+    }
+    if (sim.nSamples > 0)
+        idx.push_back(sim.nSamples - 1);
+}
+
+// Immutable copy of what the plots need: the nSamples of the landing (not
+// the whole NPOINTS arrays) and the features to keep when downsampling.
+// Shared between plot jobs through shared_ptr<const TelemetrySnapshot>.
+struct TelemetrySnapshot {
+    int            nSamples;
+    vector<float>  telemetry[NSTATES];  // vehicleTelemetry[.][0..nSamples)
+    vector<float>  predicted[NSTATES];  // predVehicleState[.][0..nSamples)
+    vector<size_t> features;            // landingFeatures()
+};
+
+shared_ptr<const TelemetrySnapshot> snapshotTelemetry(const Simulator &sim) {
+    INSTRUMENT_SCOPE("snapshotTelemetry");
+    shared_ptr<TelemetrySnapshot> snap = make_shared<TelemetrySnapshot>();
+    snap->nSamples = sim.nSamples;
+    for (int k = 0; k < NSTATES; k++) {
+        snap->telemetry[k].assign(sim.vehicleTelemetry[k], sim.vehicleTelemetry[k] + sim.nSamples);
+        snap->predicted[k].assign(sim.predVehicleState[k], sim.predVehicleState[k] + sim.nSamples);
+    }
+    landingFeatures(sim, snap->features);
+    return snap;
+}
+
+// Downsamples the x/z track of one snapshot state (telemetry or predicted)
+// to at most maxPoints plot points
+void downsampleTrack(const TelemetrySnapshot &snap, const vector<float> state[NSTATES], size_t maxPoints,
+                     vector<float> &x, vector<float> &z) {
+    vector<size_t> idx;
+    Downsample::select(state[1].data(), state[3].data(), snap.nSamples, maxPoints,
+                       Downsample::LTTB, snap.features, idx);
+    Downsample::gather(state[1].data(), idx, x);
+    Downsample::gather(state[3].data(), idx, z);
+}
+
+// Output file type of the draw functions
+enum PlotFormat { PLOT_PS, PLOT_PNG };
+
+void savePlot(Gnuplot &g1, const string &fileName, PlotFormat format) {
+    if (format == PLOT_PNG)
+        g1.savetopng(fileName);
+    else
+        g1.savetops(fileName);
+}
+
+// Draws the simulated trajectory into an open gnuplot session, saved to fileName.ps/.png
+void drawTelemetry(Gnuplot &g1, const TelemetrySnapshot &snap, const string &fileName,
+                   PlotFormat format = PLOT_PS, size_t maxPoints = PLOT_MAX_POINTS) {
+    vector<float> x, z;
+
+    // only the nSamples of the landing, reduced to maxPoints
+    downsampleTrack(snap, snap.telemetry, maxPoints, x, z);
+
+    savePlot(g1, fileName, format);
+    g1.set_xlabel("x").set_ylabel("z");//.set_zlabel("z");
+    g1.set_grid().set_xrange(0,500).set_yrange(0,1200);//set_zrange(0,1200);
+    g1.set_title("Simulator Generated Vehicle Data\\n testData1");
+    g1.set_style("points").plot_xy_binary(x, z, "vehicle trajectory data");
+}
+
+// Draws simulated against predicted trajectory, saved to fileName.ps/.png
+void drawComparison(Gnuplot &g1, const TelemetrySnapshot &snap, const string &fileName,
+                    PlotFormat format = PLOT_PS, size_t maxPoints = PLOT_MAX_POINTS) {
+    vector<vector<float> > x(2), z(2); // simulated, predicted
+    vector<string> titles = {"Simulated vehicle trajectory", "Predicted vehicle trajectory"};
+
+    downsampleTrack(snap, snap.telemetry, maxPoints, x[0], z[0]);
+    downsampleTrack(snap, snap.predicted, maxPoints, x[1], z[1]);
+
+    savePlot(g1, fileName, format);
+    g1.set_xlabel("x").set_ylabel("z");//.set_zlabel("z");
+    g1.set_grid().set_xrange(0,500).set_yrange(0,1200);//set_zrange(0,1200);
+    g1.set_title("Simulator Generated Vehicle Data\\n testData1");
+    g1.set_style("points").plot_xy_binary_series(x, z, titles);
+}
+
+// Function plots/saves data to a *.ps file in work directory
+// Blocks until gnuplot has been started and sent the data; see AsyncPlotter
+// for the non-blocking variant
+// TODO: once idealised example is extended, extend plotting to xyz plot inplace of xy only
+void plotTelemetryData(const Simulator &testData, string fileName, size_t maxPoints = PLOT_MAX_POINTS) {
+    INSTRUMENT_SCOPE("plotTelemetryData");
+    // Generate a plot of the above telemetry data
+    try {
+        Gnuplot g1("Vehicle Position");
+        drawTelemetry(g1, *snapshotTelemetry(testData), fileName, PLOT_PS, maxPoints);
+    }
+    catch (GnuplotException ge) {
+        cout << ge.what() << endl;
+    }
+}
+
+// Function compares simulated telemetry data with estimated
+void compareVehicleData(const Simulator &testData, string fileName, size_t maxPoints = PLOT_MAX_POINTS) {
+    INSTRUMENT_SCOPE("compareVehicleData");
+    // Generate a plot of the above telemetry data
+    try {
+        Gnuplot g1("Vehicle Position");
+        drawComparison(g1, *snapshotTelemetry(testData), fileName, PLOT_PS, maxPoints);
+    }
+    catch (GnuplotException ge) {
+        cout << ge.what() << endl;
+    }
+}
+
+
+// Simulator configuration stored with recorded telemetry, by name
+inline const struct SimulatorParam {
+    const char  *name;
+    float Simulator::*field;
+} simulatorParams[] = {
+    { "clockCycle",              &Simulator::clockCycle },
+    { "lidarMinRange",           &Simulator::lidarMinRange },
+    { "singleSampleErrorOffset", &Simulator::singleSampleErrorOffset },
+    { "multipathErrorOffset",    &Simulator::multipathErrorOffset },
+    { "multipathErrorDuration",  &Simulator::multipathErrorDuration },
+    { "transInitVelocity",       &Simulator::transInitVelocity },
+    { "transFinalVelocity",      &Simulator::transFinalVelocity },
+    { "transDecel",              &Simulator::transDecel },
+    { "transCruiseAltitude",     &Simulator::transCruiseAltitude },
+    { "transHeadingAngle",       &Simulator::transHeadingAngle },
+    { "hoverAccel",              &Simulator::hoverAccel },
+    { "hoverInitVelocity",       &Simulator::hoverInitVelocity },
+    { "hoverFinalVelocity",      &Simulator::hoverFinalVelocity },
+    { "descentTargetAltitude",   &Simulator::descentTargetAltitude },
+    { "descentFinalVelocity",    &Simulator::descentFinalVelocity },
+};
+
+// Telemetry file column names: simulated states, then the estimates
+inline const char *const telemetryColumns[2*NSTATES] = {
+    "t", "x", "y", "z", "vx", "vy", "vz",
+    "est.t", "est.x", "est.y", "est.z", "est.vx", "est.vy", "est.vz"
+};
+
+// Writes the nSamples of telemetry and estimates, plus the simulator
+// configuration, to a TelemetryFile in one write; TELEMETRY_PACKED stores
+// every column compressed
+bool saveTelemetry(const Simulator &sim, const string &fileName, TelemetryEncoding encoding = TELEMETRY_RAW) {
+    INSTRUMENT_SCOPE("saveTelemetry");
+    TelemetryWriter out(1.0 / sim.clockCycle);
+    for (const SimulatorParam &p : simulatorParams)
+        out.addParam(p.name, sim.*p.field);
+    for (int k = 0; k < NSTATES; k++)
+        out.addColumn(telemetryColumns[k], sim.vehicleTelemetry[k], encoding);
+    for (int k = 0; k < NSTATES; k++)
+        out.addColumn(telemetryColumns[NSTATES + k], sim.predVehicleState[k], encoding);
+    return out.write(fileName, sim.nSamples);
+}
+
+// Restores configuration and columns from an open TelemetryFile; parameters
+// and columns missing from the file are left untouched
+bool loadTelemetry(const TelemetryFile &file, Simulator &sim) {
+    if (file.samples() > NPOINTS)
+        return false;
+    for (const SimulatorParam &p : simulatorParams)
+        sim.*p.field = float(file.param(p.name, sim.*p.field));
+    sim.nSamples = int(file.samples());
+    for (int k = 0; k < 2*NSTATES; k++) {
+        int c = file.columnIndex(telemetryColumns[k]);
+        if (c < 0)
+            continue;
+        float *dst = k < NSTATES ? sim.vehicleTelemetry[k] : sim.predVehicleState[k - NSTATES];
+        file.read(c, 0, file.samples(), dst);
+    }
+    return true;
+}
+
+
+// Writes telemetry and estimates as CSV, one row per sample; precision < 0
+// keeps every float exactly, otherwise fixed decimals
+bool saveTelemetryCsv(const Simulator &sim, const string &fileName, int precision = -1, unsigned threads = 1) {
+    INSTRUMENT_SCOPE("saveTelemetryCsv");
+    vector<string> names(telemetryColumns, telemetryColumns + 2*NSTATES);
+    vector<const float*> columns;
+    for (int k = 0; k < NSTATES; k++)
+        columns.push_back(sim.vehicleTelemetry[k]);
+    for (int k = 0; k < NSTATES; k++)
+        columns.push_back(sim.predVehicleState[k]);
+    return TelemetryCsv::write(fileName, names, columns, sim.nSamples, precision, threads);
+}
+
+// Reads a CSV log with (at least) the t, x, y, z telemetry columns into sim,
+// e.g. to replay it through runEstimator; other known columns are restored too
+bool loadTelemetryCsv(const string &fileName, Simulator &sim, string &error) {
+    vector<string> names;
+    vector<vector<float> > columns;
+    if (!TelemetryCsv::read(fileName, names, columns, 1, error))
+        return false;
+    size_t n = columns.empty() ? 0 : columns[0].size();
+    if (n > NPOINTS) {
+        error = fileName + " holds more than NPOINTS samples";
+        return false;
+    }
+    int found = 0;
+    for (size_t c = 0; c < names.size(); c++) {
+        for (int k = 0; k < 2*NSTATES; k++) {
+            if (names[c] != telemetryColumns[k])
+                continue;
+            float *dst = k < NSTATES ? sim.vehicleTelemetry[k] : sim.predVehicleState[k - NSTATES];
+            copy(columns[c].begin(), columns[c].end(), dst);
+            found += k < 4;
+        }
+    }
+    if (found < 4) {
+        error = fileName + " lacks one of the t, x, y, z columns";
+        return false;
+    }
+    sim.nSamples = int(n);
+    return true;
+}
+
+
+// Columns of a recorded lidar log: time, true position, lidar measurement
+inline const char *const lidarLogColumns[8] = {
+    "t", "x", "y", "z", "lidar.x", "lidar.y", "lidar.z", "lidar.valid"
+};
+
+// Running position error of the estimate against the true position; small
+// and mergeable, so logs of any length (and chunks, files or threads of a
+// batch) are summarised without keeping the trajectories
+struct EstimationMetrics {
+    uint64_t samples  = 0;
+    uint64_t updates  = 0;     // samples with a valid lidar return
+    uint64_t landings = 0;
+    double   sumSq[3]  = {0.0, 0.0, 0.0};
+    double   maxAbs[3] = {0.0, 0.0, 0.0};
+
+    void add(const float truth[3], const Estimator3DoF &est) {
+        for (int k = 0; k < 3; k++) {
+            double e = est._X(k,0) - truth[k];
+            sumSq[k] += e*e;
+            maxAbs[k] = max(maxAbs[k], fabs(e));
+        }
+        samples++;
+    }
+
+    void merge(const EstimationMetrics &o) {
+        samples  += o.samples;
+        updates  += o.updates;
+        landings += o.landings;
+        for (int k = 0; k < 3; k++) {
+            sumSq[k] += o.sumSq[k];
+            maxAbs[k] = max(maxAbs[k], o.maxAbs[k]);
+        }
+    }
+
+    double rms(int k) const { return samples > 0 ? sqrt(sumSq[k]/samples) : 0.0; }
+};
+
+// Runs the 3DoF filter over a lidar log (lidarLogColumns) delivered in chunks
+// of any size, restarting it wherever the time goes back (a new landing),
+// and accumulates the error metrics; memory does not depend on the log length
+class LogEstimator {
+    public:
+        Estimator3DoF     est;
+        EstimationMetrics metrics;
+        float             initVelocity = 0.0;
+        float             lastT = 0.0;
+        MatrixXd          x0 = MatrixXd::Zero(6,1);
+        MatrixXd          u  = MatrixXd::Zero(3,1);
+        MatrixXd          z  = MatrixXd(3,1);
+
+    void init(const Simulator &sim) {
+        configureEstimator3DoF(est, sim);
+        initVelocity = sim.transInitVelocity;
+        metrics = EstimationMetrics();
+    }
+
+    void process(const float *const *columns, size_t n) {
+        INSTRUMENT_SCOPE("LogEstimator.process");
+        for (size_t i = 0; i < n; i++) {
+            float t = columns[0][i];
+            if (metrics.samples == 0 || t <= lastT) {
+                x0 << columns[4][i], columns[5][i], columns[6][i], initVelocity, 0.0, 0.0;
+                est.setInitialState(x0, MatrixXd::Identity(6,6));
+                metrics.landings++;
+            }
+            lastT = t;
+
+            REALTIME_REGION();
+            est.predict(u);
+            if (columns[7][i] != 0.0f) {
+                z << columns[4][i], columns[5][i], columns[6][i];
+                est.update(z);
+                metrics.updates++;
+            }
+            float truth[3] = { columns[1][i], columns[2][i], columns[3][i] };
+            metrics.add(truth, est);
+        }
+    }
+};
+
+
+// Summary metrics of one simulated landing; the trajectory itself is not kept
+#define LANDING_METRICS 5
+inline const struct LandingMetricInfo {
+    const char *name;
+    float       lo, hi;     // histogram range
+} landingMetricInfo[LANDING_METRICS] = {
+    { "touchdownVelocity",      0.0,   2.0 },   // m/s, true descent rate at the last sample
+    { "landingDuration",        0.0, 300.0 },   // s
+    { "peakError",              0.0,  50.0 },   // m, max |est.z - z| over the landing
+    { "touchdownError",         0.0,  20.0 },   // m, max |est.z - z| in the final descent, lidar in range
+    { "touchdownVelocityError", 0.0,  20.0 },   // m/s, |est.vz - vz| at the last sample
+};
+
+struct LandingMetrics {
+    float value[LANDING_METRICS];   // in landingMetricInfo order
+
+    float touchdownError() const { return value[3]; }
+};
+
+// Simulates one landing of sim: stream, lidar model seeded with seed (and
+// optionally hooked, see LidarBurstHook) and the 3DoF filter, keeping only
+// the summary metrics; est is reused
+LandingMetrics simulateLanding(const Simulator &sim, unsigned int seed, Estimator3DoF &est,
+                               double processNoise = 0.1, const LidarBurstHook &hook = LidarBurstHook()) {
+    INSTRUMENT_SCOPE("simulateLanding");
+    SimulatorStream stream;
+    LidarErrorModel lidar;
+    stream.init(sim);
+    lidar.init(sim, seed, hook);
+    configureEstimator3DoF(est, sim, processNoise);
+
+    float sample[NSTATES], meas[3];
+    MatrixXd x0 = MatrixXd(6,1);
+    MatrixXd u  = MatrixXd::Zero(3,1);
+    MatrixXd z  = MatrixXd(3,1);
+    stream.next(sample);
+    x0 << sample[1], sample[2], sample[3], sim.transInitVelocity, 0.0, 0.0;
+    est.setInitialState(x0, MatrixXd::Identity(6,6));
+
+    LandingMetrics m = {};
+    do {
+        est.predict(u);
+        if (lidar.measure(sample, meas)) {
+            z << meas[0], meas[1], meas[2];
+            est.update(z);
+        }
+        float err = fabs(float(est._X(2,0)) - sample[3]);
+        m.value[2] = max(m.value[2], err);
+        if (sample[3] < sim.descentTargetAltitude && sample[3] >= sim.lidarMinRange)
+            m.value[3] = max(m.value[3], err);
+    } while (stream.next(sample));
+
+    m.value[0] = fabs(sample[6]);
+    m.value[1] = sample[0];
+    m.value[4] = fabs(float(est._X(5,0)) - sample[6]);
+    return m;
+}
+
+// One Simulator attribute of a campaign, drawn uniformly from [lo, hi]
+// (fixed when lo == hi)
+struct CampaignParam {
+    string          name;
+    float Simulator::*field;
+    float           lo, hi;
+};
+
+// SplitMix64: a well mixed 64-bit value from a counter-based state
+inline uint64_t splitMix64(uint64_t &state) {
+    uint64_t x = (state += 0x9E3779B97F4A7C15ULL);
+    x = (x ^ (x >> 30))*0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27))*0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// How a campaign draws the parameters of its runs
+enum CampaignSampling {
+    SAMPLING_MC,            // independent uniform draws
+    SAMPLING_ANTITHETIC,    // runs 2j and 2j+1 use u and 1 - u, with the same lidar noise
+    SAMPLING_SOBOL          // Owen-scrambled Sobol points (seed picks the scramble); parameters
+                            // past the first SOBOL_MAX_DIMS are drawn as in SAMPLING_MC
+};
+
+// Monte Carlo landing campaign. Every run is fully determined by (seed, run
+// index), so any process can compute any run. Runs are grouped in blocks of
+// blockRuns, the unit that is sharded and merged: a block's statistics do
+// not depend on who computed it, and blocks are always merged in order, so
+// the result is the same for any number of shards, processes or threads.
+// The lidar noise of a run depends only on seed and run (the pair, for
+// antithetic runs), never on the estimator tuning: campaigns that differ in
+// processNoise alone see identical noise (common random numbers)
+struct Campaign {
+    uint64_t              seed = 1;
+    uint64_t              runs = 0;
+    uint32_t              blockRuns = 256;
+    float                 failureLimit = 3.0;  // touchdownError above this is a failure
+    CampaignSampling      sampling = SAMPLING_MC;
+    double                processNoise = 0.1;  // estimator tuning, see configureEstimator3DoF
+    vector<CampaignParam> params;
+
+    uint64_t blocks() const { return (runs + blockRuns - 1)/blockRuns; }
+
+    // Parameters that take their coordinate from the Sobol point
+    size_t sobolDims() const {
+        return sampling == SAMPLING_SOBOL ? min<size_t>(params.size(), SOBOL_MAX_DIMS) : 0;
+    }
+
+    // Configures sim for run; returns the lidar seed of the run
+    unsigned int setup(uint64_t run, Simulator &sim) const {
+        double point[SOBOL_MAX_DIMS];
+        size_t q = sobolDims();
+        uint64_t pair  = sampling == SAMPLING_ANTITHETIC ? run/2 : run;
+        uint64_t state = seed*0xD1B54A32D192ED03ULL + pair;
+        if (q > 0)
+            SobolSequence(uint32_t(seed)).point(uint32_t(run), int(q), point);
+        for (size_t k = 0; k < params.size(); k++) {
+            double u = k < q ? point[k] : double(splitMix64(state) >> 11)*0x1.0p-53;
+            if (sampling == SAMPLING_ANTITHETIC && (run & 1))
+                u = 1.0 - u;
+            sim.*params[k].field = params[k].lo + float(u)*(params[k].hi - params[k].lo);
+        }
+        uint64_t noise = seed*0x9E6C63D0676A9A99ULL + pair;
+        return unsigned(splitMix64(noise));
+    }
+
+    // Everything that defines the campaign, for checking partial results agree
+    string fingerprint() const {
+        string out;
+        StatsIO::put(out, seed);
+        StatsIO::put(out, runs);
+        StatsIO::put(out, blockRuns);
+        StatsIO::put(out, failureLimit);
+        StatsIO::put(out, uint32_t(sampling));
+        StatsIO::put(out, processNoise);
+        for (const CampaignParam &p : params) {
+            out += p.name + '\0';
+            StatsIO::put(out, p.lo);
+            StatsIO::put(out, p.hi);
+        }
+        return out;
+    }
+};
+
+// Mergeable statistics of a set of landings, per metric
+struct CampaignStats {
+    Moments        moments[LANDING_METRICS];
+    FixedHistogram histogram[LANDING_METRICS];
+    QuantileSketch sketch[LANDING_METRICS];
+    uint64_t       failures = 0;
+
+    CampaignStats() {
+        for (int k = 0; k < LANDING_METRICS; k++)
+            histogram[k].init(landingMetricInfo[k].lo, landingMetricInfo[k].hi, 40);
+    }
+
+    void add(const LandingMetrics &m, float failureLimit) {
+        for (int k = 0; k < LANDING_METRICS; k++) {
+            moments[k].add(m.value[k]);
+            histogram[k].add(m.value[k]);
+            sketch[k].add(m.value[k]);
+        }
+        failures += m.touchdownError() > failureLimit;
+    }
+
+    void merge(const CampaignStats &o) {
+        for (int k = 0; k < LANDING_METRICS; k++) {
+            moments[k].merge(o.moments[k]);
+            histogram[k].merge(o.histogram[k]);
+            sketch[k].merge(o.sketch[k]);
+        }
+        failures += o.failures;
+    }
+
+    void save(string &out) const {
+        for (int k = 0; k < LANDING_METRICS; k++) {
+            moments[k].save(out);
+            histogram[k].save(out);
+            sketch[k].save(out);
+        }
+        StatsIO::put(out, failures);
+    }
+
+    bool load(const char *&p, const char *end) {
+        for (int k = 0; k < LANDING_METRICS; k++)
+            if (!moments[k].load(p, end) || !histogram[k].load(p, end) || !sketch[k].load(p, end))
+                return false;
+        return StatsIO::get(p, end, failures);
+    }
+};
+
+// Calls fn(sim, est, i) for every i in [0, n) on threads workers, each with
+// its own copy of base and its own estimator. Indices are claimed `batch` at
+// a time, to keep the shared counter off the hot path
+template<typename Fn>
+void forEachRun(const Simulator &base, unsigned threads, uint64_t n, Fn fn, uint64_t batch = 16) {
+    const uint64_t tasks = (n + batch - 1)/batch;
+    unsigned workers = TaskPool::workers(tasks, threads);
+    vector<unique_ptr<Simulator> > sims;
+    vector<Estimator3DoF> ests(workers);
+    for (unsigned w = 0; w < workers; w++)
+        sims.push_back(unique_ptr<Simulator>(new Simulator(base)));
+
+    TaskPool::run(tasks, workers, [&](size_t b, unsigned w) {
+        for (uint64_t i = b*batch; i < min(n, (b + 1)*batch); i++)
+            fn(*sims[w], ests[w], i);
+    });
+}
+
+// Runs the blocks of shard (blocks b with b % shards == shard) on threads
+// workers; blocks maps block index to its statistics
+void runCampaignShard(const Campaign &c, const Simulator &base, uint64_t shard, uint64_t shards,
+                      unsigned threads, map<uint64_t, CampaignStats> &blocks) {
+    INSTRUMENT_SCOPE("runCampaignShard");
+    vector<uint64_t> mine;
+    for (uint64_t b = shard; b < c.blocks(); b += shards)
+        mine.push_back(b);
+    vector<CampaignStats> stats(mine.size());
+
+    // one block per task: a block's statistics are only touched by one worker
+    forEachRun(base, threads, mine.size(), [&](Simulator &sim, Estimator3DoF &est, uint64_t i) {
+        uint64_t first = mine[i]*c.blockRuns, last = min(c.runs, first + c.blockRuns);
+        for (uint64_t run = first; run < last; run++) {
+            unsigned int seed = c.setup(run, sim);
+            stats[i].add(simulateLanding(sim, seed, est, c.processNoise), c.failureLimit);
+        }
+    }, 1);
+    for (size_t i = 0; i < mine.size(); i++)
+        blocks[mine[i]] = stats[i];
+}
+
+// Evaluates runs [first, first + count) of c on threads workers, in order
+void evaluateCampaignRuns(const Campaign &c, const Simulator &base, uint64_t first, uint64_t count,
+                          unsigned threads, vector<LandingMetrics> &out) {
+    out.resize(count);
+    forEachRun(base, threads, count, [&](Simulator &sim, Estimator3DoF &est, uint64_t i) {
+        unsigned int seed = c.setup(first + i, sim);
+        out[i] = simulateLanding(sim, seed, est, c.processNoise);
+    });
+}
+
+// Partial result file of a shard: "CSCAMPGN", the campaign fingerprint,
+// shard/shards, then (block index, statistics) per block. Written under a
+// temporary name and renamed, so a reader never sees half a file
+bool saveCampaignPartial(const string &fileName, const Campaign &c, uint64_t shard, uint64_t shards,
+                         const map<uint64_t, CampaignStats> &blocks) {
+    string out("CSCAMPGN");
+    string config = c.fingerprint();
+    StatsIO::put(out, uint64_t(config.size()));
+    out += config;
+    StatsIO::put(out, shard);
+    StatsIO::put(out, shards);
+    StatsIO::put(out, uint64_t(blocks.size()));
+    for (const auto &b : blocks) {
+        StatsIO::put(out, b.first);
+        b.second.save(out);
+    }
+
+    string tmp = fileName + ".tmp";
+    ofstream f(tmp, ios::binary);
+    f.write(out.data(), out.size());
+    f.close();
+    return f.good() && rename(tmp.c_str(), fileName.c_str()) == 0;
+}
+
+// Merges the partial results of c (which must all be present, each block
+// once) into total, folding the blocks in block order
+bool mergeCampaign(const Campaign &c, const vector<string> &files, CampaignStats &total, string &error) {
+    string config = c.fingerprint();
+    map<uint64_t, CampaignStats> blocks;
+    for (const string &fileName : files) {
+        ifstream f(fileName, ios::binary);
+        string data((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+        const char *p = data.data(), *end = p + data.size();
+        uint64_t length = 0, shard, shards, n;
+        bool ok = data.compare(0, 8, "CSCAMPGN") == 0;
+        p += ok ? 8 : 0;
+        ok = ok && StatsIO::get(p, end, length) && length <= uint64_t(end - p) && string(p, length) == config;
+        if (!ok) {
+            error = fileName + " is not a partial result of this campaign";
+            return false;
+        }
+        p += length;
+        ok = StatsIO::get(p, end, shard) && StatsIO::get(p, end, shards) && StatsIO::get(p, end, n);
+        for (uint64_t i = 0; ok && i < n; i++) {
+            uint64_t b;
+            CampaignStats s;
+            ok = StatsIO::get(p, end, b) && s.load(p, end) && b < c.blocks() && blocks.count(b) == 0;
+            if (ok)
+                blocks[b] = s;
+        }
+        if (!ok) {
+            error = fileName + " is corrupt or repeats a block";
+            return false;
+        }
+    }
+    if (blocks.size() != c.blocks()) {
+        error = to_string(c.blocks() - blocks.size()) + " of " + to_string(c.blocks()) + " blocks missing";
+        return false;
+    }
+    total = CampaignStats();
+    for (const auto &b : blocks)
+        total.merge(b.second);
+    return true;
+}
+
+
+// Swept Simulator attribute: points values evenly spaced over [lo, hi] on a
+// grid, or one stratum each of samples strata in a Latin hypercube
+struct SweepAxis {
+    string          name;
+    float Simulator::*field;
+    float           lo, hi;
+    uint32_t        points;
+};
+
+enum SweepDesign { SWEEP_GRID, SWEEP_LATIN_HYPERCUBE };
+
+#define SWEEP_MAX_AXES 16
+
+// Parameter sweep over any Simulator attributes (simulatorParams names).
+// A grid evaluates the cartesian product of the axes; a Latin hypercube
+// draws samples points with each axis' range cut into samples strata and
+// every stratum used once. Run i's point and lidar seed depend only on
+// (seed, i), so the sweep is reproducible with any number of threads
+struct Sweep {
+    vector<SweepAxis> axes;
+    SweepDesign       design = SWEEP_GRID;
+    uint64_t          samples = 0;      // Latin hypercube size
+    uint64_t          seed = 1;
+    vector<vector<uint32_t> > strata;   // Latin hypercube: stratum of run i on each axis
+
+    // Returns false for an unknown attribute or past SWEEP_MAX_AXES axes
+    bool addAxis(const string &name, float lo, float hi, uint32_t points) {
+        if (axes.size() == SWEEP_MAX_AXES)
+            return false;
+        for (const SimulatorParam &p : simulatorParams) {
+            if (name == p.name) {
+                axes.push_back({ name, p.field, lo, hi, max(1u, points) });
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint64_t runs() const {
+        if (design == SWEEP_LATIN_HYPERCUBE)
+            return samples;
+        uint64_t n = 1;
+        for (const SweepAxis &a : axes)
+            n *= a.points;
+        return n;
+    }
+
+    // Draws the Latin hypercube strata; call after the axes are added
+    void prepare() {
+        strata.clear();
+        if (design != SWEEP_LATIN_HYPERCUBE)
+            return;
+        uint64_t state = seed;
+        for (size_t k = 0; k < axes.size(); k++) {
+            vector<uint32_t> perm(samples);
+            for (uint64_t i = 0; i < samples; i++)
+                perm[i] = uint32_t(i);
+            for (uint64_t i = samples; i > 1; i--)      // Fisher-Yates
+                swap(perm[i - 1], perm[splitMix64(state) % i]);
+            strata.push_back(perm);
+        }
+    }
+
+    // Writes the attribute values of run (one per axis) and configures sim;
+    // returns the run's lidar seed
+    unsigned int setup(uint64_t run, Simulator &sim, float *values) const {
+        uint64_t state = seed*0xD1B54A32D192ED03ULL + run, rest = run;
+        for (size_t k = 0; k < axes.size(); k++) {
+            const SweepAxis &a = axes[k];
+            double u;
+            if (design == SWEEP_GRID) {
+                u = a.points > 1 ? double(rest % a.points)/(a.points - 1) : 0.5;
+                rest /= a.points;
+            }
+            else
+                u = (strata[k][run] + double(splitMix64(state) >> 11)*0x1.0p-53)/double(samples);
+            values[k] = a.lo + float(u)*(a.hi - a.lo);
+            sim.*a.field = values[k];
+        }
+        return unsigned(splitMix64(state));
+    }
+};
+
+// Evaluates every run of sweep on threads workers; table holds one column
+// per axis, then one per landing metric, runs() rows each
+void runSweep(const Sweep &sweep, const Simulator &base, unsigned threads, vector<vector<float> > &table) {
+    INSTRUMENT_SCOPE("runSweep");
+    const uint64_t runs = sweep.runs();
+    const size_t nAxes = sweep.axes.size();
+    table.assign(nAxes + LANDING_METRICS, vector<float>(runs));
+
+    forEachRun(base, threads, runs, [&](Simulator &sim, Estimator3DoF &est, uint64_t run) {
+        float values[SWEEP_MAX_AXES];
+        unsigned int seed = sweep.setup(run, sim, values);
+        LandingMetrics m = simulateLanding(sim, seed, est);
+        for (size_t k = 0; k < nAxes; k++)
+            table[k][run] = values[k];
+        for (int k = 0; k < LANDING_METRICS; k++)
+            table[nAxes + k][run] = m.value[k];
+    });
+}
+
+// Writes a sweep table as a TelemetryFile (packed columns), or as CSV when
+// fileName ends in .csv
+bool saveSweepTable(const Sweep &sweep, const vector<vector<float> > &table, const string &fileName) {
+    vector<string> names;
+    for (const SweepAxis &a : sweep.axes)
+        names.push_back(a.name);
+    for (int k = 0; k < LANDING_METRICS; k++)
+        names.push_back(landingMetricInfo[k].name);
+    vector<const float*> columns;
+    for (const vector<float> &c : table)
+        columns.push_back(c.data());
+
+    if (fileName.size() > 4 && fileName.compare(fileName.size() - 4, 4, ".csv") == 0)
+        return TelemetryCsv::write(fileName, names, columns, sweep.runs());
+    TelemetryWriter out(0.0);
+    out.addParam("seed", double(sweep.seed));
+    out.addParam("design", double(sweep.design));
+    for (size_t k = 0; k < names.size(); k++)
+        out.addColumn(names[k], columns[k], TELEMETRY_PACKED);
+    return out.write(fileName, sweep.runs());
+}
+
+
+// Importance sampling of the lidar errors: below belowAltitude, in the
+// last MULTIPATH_SHIFTS samples of a multipath burst, the single-sample
+// noise has mean noiseShift[r] instead of 0, r being the samples left in
+// the burst. The filter error peaks at the end of a burst; shifting the
+// earlier samples too only spreads the weights
+#define MULTIPATH_SHIFTS 3
+
+struct MultipathBias {
+    float belowAltitude = 0.0;
+    float noiseShift[MULTIPATH_SHIFTS] = {};
+};
+
+// What a biased lidar drew below belowAltitude: the log likelihood ratio
+// nominal/biased of it, and the noise at the end of bursts (sum and count
+// per samples left), from which the bias is fitted (cross-entropy)
+struct MultipathBiasStats {
+    double   logWeight;
+    double   burstNoise[MULTIPATH_SHIFTS];
+    uint32_t burstSamples[MULTIPATH_SHIFTS];
+};
+
+// Applies a MultipathBias to the lidar of one landing of sim, as its
+// LidarBurstHook (pass std::ref(hook)), and keeps the statistics
+struct MultipathBiasHook {
+    MultipathBias      bias;
+    MultipathBiasStats stats = {};
+    float              clockCycle;
+    double             variance;    // of the single-sample noise
+
+    MultipathBiasHook(const MultipathBias &b, const Simulator &sim)
+        : bias(b), clockCycle(sim.clockCycle),
+          variance(double(sim.singleSampleErrorOffset)*sim.singleSampleErrorOffset) {}
+
+    float operator()(const float sample[NSTATES], float remaining, float e) {
+        long r = lround(remaining/clockCycle) - 1;
+        // noise-free lidar: a shifted draw has no likelihood ratio, so no shift
+        if (sample[3] >= bias.belowAltitude || r >= MULTIPATH_SHIFTS || !(variance > 0.0))
+            return 0.0;
+        // e ~ N(0, sigma) shifted is a draw of N(noiseShift[r], sigma)
+        r = max(0L, r);
+        double mu = bias.noiseShift[r];
+        stats.logWeight -= (mu*mu + 2.0*mu*e)/(2.0*variance);
+        stats.burstNoise[r] += e + mu;
+        stats.burstSamples[r]++;
+        return float(mu);
+    }
+};
+
+
+// Rare multipath failures by importance sampling. Nominally the multipath
+// offset and duration are uniform over their ranges and the lidar noise has
+// mean 0. Here each attribute is drawn from a piecewise uniform density
+// over IMPORTANCE_BINS equal bins of its range (bin probabilities `prob`;
+// all equal is the nominal), and in the final descent the lidar noise is
+// pushed along the bursts (MultipathBias). Every run carries the
+// likelihood ratio nominal/sampling of all it drew, so weight*[touchdownError
+// > failureLimit] averages to the nominal failure probability whatever the
+// bias: unbiased, only the variance depends on it
+#define IMPORTANCE_BINS 16
+
+struct MultipathImportance {
+    uint64_t      seed = 1;
+    float         failureLimit = 5.0;
+    float         lo[2] = { 0.0, 0.1 };     // nominal ranges of offset and duration
+    float         hi[2] = { 4.0, 1.0 };
+    double        prob[2][IMPORTANCE_BINS];
+    MultipathBias lidar;                    // belowAltitude is the descent target altitude
+
+    MultipathImportance() {
+        for (int k = 0; k < 2; k++)
+            fill(prob[k], prob[k] + IMPORTANCE_BINS, 1.0/IMPORTANCE_BINS);
+    }
+
+    // Configures sim for run; returns the lidar seed, logWeight the log
+    // likelihood ratio of the attributes and u their range fractions
+    unsigned int setup(uint64_t run, Simulator &sim, double &logWeight, double u[2]) const {
+        uint64_t state = seed*0xA0761D6478BD642FULL + run;
+        logWeight = 0.0;
+        for (int k = 0; k < 2; k++) {
+            double v = double(splitMix64(state) >> 11)*0x1.0p-53;
+            int b = 0;
+            while (b < IMPORTANCE_BINS - 1 && v >= prob[k][b])
+                v -= prob[k][b++];
+            u[k] = min(1.0, (b + v/prob[k][b])/IMPORTANCE_BINS);
+            logWeight -= log(IMPORTANCE_BINS*prob[k][b]);
+        }
+        sim.multipathErrorOffset   = lo[0] + float(u[0])*(hi[0] - lo[0]);
+        sim.multipathErrorDuration = lo[1] + float(u[1])*(hi[1] - lo[1]);
+        return unsigned(splitMix64(state));
+    }
+};
+
+struct RareEventRun {
+    LandingMetrics     m;
+    MultipathBiasStats lidar;
+    double             logWeight;   // attributes and lidar
+    double             u[2];        // offset and duration as fractions of their ranges
+
+    double weight() const { return exp(logWeight); }
+};
+
+// Evaluates runs [first, first + count) of is on threads workers, in order
+void runMultipathImportance(const MultipathImportance &is, const Simulator &base, uint64_t first,
+                            uint64_t count, unsigned threads, vector<RareEventRun> &out) {
+    out.resize(count);
+    forEachRun(base, threads, count, [&](Simulator &sim, Estimator3DoF &est, uint64_t i) {
+        RareEventRun &r = out[i];
+        unsigned int seed = is.setup(first + i, sim, r.logWeight, r.u);
+        MultipathBias bias = is.lidar;
+        bias.belowAltitude = sim.descentTargetAltitude;    // bookkeeping even when nominal
+        MultipathBiasHook hook(bias, sim);
+        r.m = simulateLanding(sim, seed, est, 0.1, std::ref(hook));
+        r.lidar = hook.stats;
+        r.logWeight += hook.stats.logWeight;
+    });
+}
+
+// Cross-entropy tuning of the sampling. Each level runs pilotRuns under the
+// current sampling; the runs in the top rho fraction (touchdownError above
+// the level, which is capped at the failure limit) refit it by weighted
+// maximum likelihood: bin probabilities from where those runs fell (mixed
+// with `defensive` of the nominal, which bounds the weights) and noise
+// shifts from the mean noise at the end of bursts. Stops once the level reaches
+// the limit. Pilot runs use their own seeds and are not part of any
+// estimate. Returns the number of landings run
+uint64_t tuneMultipathImportance(MultipathImportance &is, const Simulator &base, uint64_t pilotRuns,
+                                 unsigned threads, int maxLevels = 10, double rho = 0.1,
+                                 double defensive = 0.1) {
+    vector<RareEventRun> out;
+    vector<float> scores;
+    uint64_t landings = 0;
+    for (int level = 0; level < maxLevels; level++) {
+        MultipathImportance pilot = is;
+        pilot.seed = ~is.seed - uint64_t(level);
+        runMultipathImportance(pilot, base, 0, pilotRuns, threads, out);
+        landings += pilotRuns;
+
+        scores.clear();
+        for (const RareEventRun &r : out)
+            scores.push_back(r.m.touchdownError());
+        size_t top = size_t((1.0 - rho)*double(pilotRuns - 1));
+        nth_element(scores.begin(), scores.begin() + top, scores.end());
+        float gamma = min(is.failureLimit, scores[top]);
+
+        double sw = 0.0, bins[2][IMPORTANCE_BINS] = {};
+        double noise[MULTIPATH_SHIFTS] = {}, samples[MULTIPATH_SHIFTS] = {};
+        for (const RareEventRun &r : out) {
+            if (r.m.touchdownError() < gamma)
+                continue;
+            double w = r.weight();
+            sw += w;
+            for (int k = 0; k < 2; k++)
+                bins[k][min(IMPORTANCE_BINS - 1, int(r.u[k]*IMPORTANCE_BINS))] += w;
+            for (int k = 0; k < MULTIPATH_SHIFTS; k++) {
+                noise[k]   += w*r.lidar.burstNoise[k];
+                samples[k] += w*r.lidar.burstSamples[k];
+            }
+        }
+        if (sw > 0.0) {
+            for (int k = 0; k < 2; k++)
+                for (int b = 0; b < IMPORTANCE_BINS; b++)
+                    is.prob[k][b] = (1.0 - defensive)*bins[k][b]/sw + defensive/IMPORTANCE_BINS;
+            for (int k = 0; k < MULTIPATH_SHIFTS; k++)
+                if (samples[k] > 0.0)
+                    is.lidar.noiseShift[k] = float(noise[k]/samples[k]);
+        }
+        if (gamma >= is.failureLimit)
+            break;
+    }
+    return landings;
+}
+
+// Safe-landing envelope by adaptive refinement. The box spanned by the axes
+// is a lattice of (coarse - 1)*2^levels + 1 points per axis; a point passes
+// when none of its landings (the same `seeds` lidar seeds at every point)
+// has a touchdownError above errorLimit. Starting from the coarse cells,
+// only cells whose corners disagree are split in two along every axis, down
+// to the lattice spacing; a cell whose corners agree is taken to be
+// uniform. Each level's new corners are evaluated as one parallel batch and
+// cached by lattice index, so a corner shared by several cells runs once
+struct EnvelopeLevel {
+    uint64_t cells;         // cells examined
+    uint64_t split;         // of which corners disagree
+    uint64_t newPoints;     // lattice points evaluated for this level
+};
+
+struct Envelope {
+    vector<CampaignParam> axes;
+    uint32_t coarse = 5;
+    uint32_t levels = 3;
+    uint32_t seeds  = 4;
+    uint64_t seed   = 1;
+    float    errorLimit = 3.0;
+
+    unordered_map<uint64_t, float> scores;      // lattice point -> largest touchdownError over the seeds
+    vector<pair<uint64_t, uint32_t> > uniform;  // (lower corner, size) of cells whose corners agree
+    vector<uint64_t> boundary;                  // lattice cells (size 1) whose corners disagree
+    uint64_t landings = 0;
+
+    uint32_t points() const { return ((coarse - 1) << levels) + 1; }
+    uint64_t lattice() const { return uint64_t(pow(double(points()), double(axes.size()))); }
+
+    // Lattice point (one index per axis) <-> key
+    uint64_t key(const uint32_t *idx) const {
+        uint64_t k = 0;
+        for (size_t a = axes.size(); a-- > 0; )
+            k = k*points() + idx[a];
+        return k;
+    }
+    void index(uint64_t k, uint32_t *idx) const {
+        for (size_t a = 0; a < axes.size(); a++, k /= points())
+            idx[a] = uint32_t(k % points());
+    }
+
+    float value(size_t a, uint32_t i) const {
+        return axes[a].lo + (axes[a].hi - axes[a].lo)*float(i)/float(points() - 1);
+    }
+
+    bool pass(uint64_t k) const { return scores.at(k) <= errorLimit; }
+
+    // Evaluates the points of keys not cached yet on threads workers;
+    // returns how many were new
+    uint64_t evaluate(vector<uint64_t> keys, const Simulator &base, unsigned threads) {
+        sort(keys.begin(), keys.end());
+        keys.erase(unique(keys.begin(), keys.end()), keys.end());
+        keys.erase(remove_if(keys.begin(), keys.end(), [&](uint64_t k) { return scores.count(k) > 0; }),
+                   keys.end());
+        vector<float> result(keys.size());
+        // one point (seeds landings) per task
+        forEachRun(base, threads, keys.size(), [&](Simulator &sim, Estimator3DoF &est, uint64_t i) {
+            vector<uint32_t> idx(axes.size());
+            index(keys[i], idx.data());
+            for (size_t a = 0; a < axes.size(); a++)
+                sim.*axes[a].field = value(a, idx[a]);
+            uint64_t state = seed*0x9E6C63D0676A9A99ULL;
+            float worst = 0.0;
+            for (uint32_t s = 0; s < seeds; s++)
+                worst = max(worst, simulateLanding(sim, unsigned(splitMix64(state)), est).touchdownError());
+            result[i] = worst;
+        }, 1);
+        for (size_t i = 0; i < keys.size(); i++)
+            scores[keys[i]] = result[i];
+        landings += keys.size()*seeds;
+        return keys.size();
+    }
+
+    // Drops every result, e.g. once axes, seeds or the limit changed; the
+    // table is rebuilt rather than emptied, so a rerun lists points in the
+    // same order
+    void clear() {
+        unordered_map<uint64_t, float>().swap(scores);
+        uniform.clear();
+        boundary.clear();
+        landings = 0;
+    }
+
+    // Maps the envelope level by level, from scratch; progress gets one
+    // entry per level
+    void run(const Simulator &base, unsigned threads, vector<EnvelopeLevel> *progress = NULL) {
+        clear();
+        const size_t d = axes.size();
+        const uint32_t corners = 1u << d;
+        uint32_t size = 1u << levels;
+        vector<uint64_t> cells;             // lower corners of the cells of this level
+        vector<uint32_t> idx(d), c(d);
+        for (uint64_t k = 0; k < uint64_t(pow(double(coarse - 1), double(d))); k++) {
+            uint64_t rest = k;
+            for (size_t a = 0; a < d; a++, rest /= coarse - 1)
+                idx[a] = uint32_t(rest % (coarse - 1))*size;
+            cells.push_back(key(idx.data()));
+        }
+
+        for (;;) {
+            vector<uint64_t> needed;
+            for (uint64_t cell : cells) {
+                index(cell, idx.data());
+                for (uint32_t m = 0; m < corners; m++) {
+                    for (size_t a = 0; a < d; a++)
+                        c[a] = idx[a] + ((m >> a) & 1u)*size;
+                    needed.push_back(key(c.data()));
+                }
+            }
+            EnvelopeLevel level = { cells.size(), 0, evaluate(needed, base, threads) };
+
+            vector<uint64_t> next;
+            for (uint64_t cell : cells) {
+                index(cell, idx.data());
+                int passed = 0;
+                for (uint32_t m = 0; m < corners; m++) {
+                    for (size_t a = 0; a < d; a++)
+                        c[a] = idx[a] + ((m >> a) & 1u)*size;
+                    passed += pass(key(c.data()));
+                }
+                if (passed == 0 || passed == int(corners)) {
+                    uniform.push_back({ cell, size });
+                    continue;
+                }
+                level.split++;
+                if (size == 1) {
+                    boundary.push_back(cell);
+                    continue;
+                }
+                for (uint32_t m = 0; m < corners; m++) {
+                    for (size_t a = 0; a < d; a++)
+                        c[a] = idx[a] + ((m >> a) & 1u)*(size/2);
+                    next.push_back(key(c.data()));
+                }
+            }
+            if (progress != NULL)
+                progress->push_back(level);
+            if (next.empty() || size == 1)
+                break;
+            cells.swap(next);
+            size /= 2;
+        }
+    }
+
+    // Pass (1) or fail (0) of every lattice point: evaluated, else that of
+    // the uniform cell it lies in; 2 where neither applies
+    vector<uint8_t> classify() const {
+        const size_t d = axes.size();
+        vector<uint8_t> out(lattice(), 2);
+        vector<uint32_t> idx(d), c(d);
+        for (const pair<uint64_t, uint32_t> &u : uniform) {
+            index(u.first, idx.data());
+            bool p = pass(u.first);
+            uint64_t n = uint64_t(pow(double(u.second + 1), double(d)));
+            for (uint64_t k = 0; k < n; k++) {
+                uint64_t rest = k;
+                for (size_t a = 0; a < d; a++, rest /= u.second + 1)
+                    c[a] = idx[a] + uint32_t(rest % (u.second + 1));
+                out[key(c.data())] = p;
+            }
+        }
+        for (const auto &s : scores)
+            out[s.first] = s.second <= errorLimit;
+        return out;
+    }
+};
+
+
+// Monotonic wall clock in nanoseconds
+inline long long nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif
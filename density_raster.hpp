@@ -0,0 +1,271 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Multithreaded 2D density rasterizer for very large point clouds
+///
+///  Instead of handing 10^8 points to gnuplot, the points are binned into a
+///  width x height grid of counts. Each thread bins its share of the points
+///  into a private grid (no atomics, no false sharing); the grids are then
+///  summed band by band, again in parallel.
+///
+///  The counts are mapped through a log colour scale and written straight to
+///  a PNG file (8-bit RGB, stored deflate blocks, so no zlib is needed), or
+///  sent to gnuplot as an inline binary rgb image.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _DENSITY_RASTER_H_
+#define _DENSITY_RASTER_H_
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gnuplot_i.hpp"
+
+
+class DensityRaster
+{
+    public:
+
+        unsigned int            width, height;
+        float                   xmin, xmax, ymin, ymax;
+        std::vector<uint32_t>   counts;     // row-major, row 0 at ymin
+
+    DensityRaster(unsigned int width_, unsigned int height_,
+                  float xmin_, float xmax_, float ymin_, float ymax_)
+        : width(width_), height(height_), xmin(xmin_), xmax(xmax_), ymin(ymin_), ymax(ymax_),
+          counts(size_t(width_)*height_, 0) {}
+
+    // Adds n points to the grid using up to threads threads (0 = one per
+    // core); points outside the range, and NaNs, are ignored
+    void accumulate(const float *x, const float *y, size_t n, unsigned int threads = 0)
+    {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        if (n < size_t(threads)*65536)
+            threads = std::max<size_t>(1, n / 65536);
+
+        if (threads == 1)
+        {
+            bin(x, y, n, &counts[0]);
+            return;
+        }
+
+        // every thread bins into its own grid
+        std::vector<std::vector<uint32_t> > tiles(threads);
+        std::vector<std::thread> pool;
+        size_t chunk = (n + threads - 1) / threads;
+        for (unsigned int t = 0; t < threads; t++)
+        {
+            pool.push_back(std::thread([&, t]() {
+                size_t first = t*chunk, last = std::min(n, first + chunk);
+                tiles[t].assign(counts.size(), 0);
+                if (first < last)
+                    bin(x + first, y + first, last - first, &tiles[t][0]);
+            }));
+        }
+        for (size_t t = 0; t < pool.size(); t++)
+            pool[t].join();
+        pool.clear();
+
+        // sum the grids, one band of rows per thread
+        size_t band = (counts.size() + threads - 1) / threads;
+        for (unsigned int t = 0; t < threads; t++)
+        {
+            pool.push_back(std::thread([&, t]() {
+                size_t first = t*band, last = std::min(counts.size(), first + band);
+                for (size_t k = 0; k < tiles.size(); k++)
+                {
+                    const uint32_t *src = &tiles[k][0];
+                    for (size_t i = first; i < last; i++)
+                        counts[i] += src[i];
+                }
+            }));
+        }
+        for (size_t t = 0; t < pool.size(); t++)
+            pool[t].join();
+    }
+
+    uint32_t maxCount() const
+    {
+        return counts.empty() ? 0 : *std::max_element(counts.begin(), counts.end());
+    }
+
+    // Log colour map (empty cells black, then blue -> red -> yellow -> white);
+    // rgb is width*height*3 bytes, row 0 at ymin like counts
+    void toRgb(std::vector<unsigned char> &rgb) const
+    {
+        rgb.resize(counts.size()*3);
+        double scale = 1.0 / std::log1p(double(std::max<uint32_t>(maxCount(), 1)));
+        for (size_t i = 0; i < counts.size(); i++)
+        {
+            unsigned char *p = &rgb[3*i];
+            if (counts[i] == 0)
+            {
+                p[0] = p[1] = p[2] = 0;
+                continue;
+            }
+            double v = std::log1p(double(counts[i])) * scale; // (0, 1]
+            palette(v, p);
+        }
+    }
+
+    // Writes the log-scaled image as an 8-bit RGB PNG in one write
+    bool writePng(const std::string &filename) const
+    {
+        std::vector<unsigned char> rgb;
+        toRgb(rgb);
+
+        // scanlines top row first, each prefixed with filter type 0
+        size_t stride = size_t(width)*3 + 1;
+        std::vector<unsigned char> raw(stride*height);
+        for (unsigned int r = 0; r < height; r++)
+        {
+            raw[r*stride] = 0;
+            const unsigned char *src = &rgb[size_t(height - 1 - r)*width*3];
+            std::copy(src, src + size_t(width)*3, &raw[r*stride + 1]);
+        }
+
+        // zlib stream made of stored (uncompressed) deflate blocks
+        std::vector<unsigned char> z;
+        z.reserve(raw.size() + raw.size()/65535*5 + 16);
+        z.push_back(0x78);
+        z.push_back(0x01);
+        size_t pos = 0;
+        do
+        {
+            size_t len = std::min<size_t>(65535, raw.size() - pos);
+            bool final = pos + len == raw.size();
+            z.push_back(final ? 1 : 0);
+            z.push_back(len & 0xff);
+            z.push_back((len >> 8) & 0xff);
+            z.push_back(~len & 0xff);
+            z.push_back((~len >> 8) & 0xff);
+            z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + len);
+            pos += len;
+        } while (pos < raw.size());
+        put32(z, adler32(&raw[0], raw.size()));
+
+        std::vector<unsigned char> png;
+        png.reserve(z.size() + 64);
+        static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        png.insert(png.end(), signature, signature + 8);
+
+        unsigned char ihdr[13];
+        ihdr[0] = width >> 24;  ihdr[1] = width >> 16;  ihdr[2]  = width >> 8;  ihdr[3]  = width;
+        ihdr[4] = height >> 24; ihdr[5] = height >> 16; ihdr[6]  = height >> 8; ihdr[7]  = height;
+        ihdr[8] = 8;    // bit depth
+        ihdr[9] = 2;    // colour type: RGB
+        ihdr[10] = ihdr[11] = ihdr[12] = 0;
+        chunk(png, "IHDR", ihdr, sizeof(ihdr));
+        chunk(png, "IDAT", &z[0], z.size());
+        chunk(png, "IEND", NULL, 0);
+
+        FILE *f = fopen(filename.c_str(), "wb");
+        if (f == NULL)
+            return false;
+        bool ok = fwrite(&png[0], 1, png.size(), f) == png.size();
+        return fclose(f) == 0 && ok;
+    }
+
+    // Displays the log-scaled image in a gnuplot session
+    Gnuplot& show(Gnuplot &gp, const std::string &title = "") const
+    {
+        std::vector<unsigned char> rgb;
+        toRgb(rgb);
+        return gp.plot_image_binary(&rgb[0], width, height, title, true);
+    }
+
+    private:
+
+    inline void bin(const float *x, const float *y, size_t n, uint32_t *grid) const
+    {
+        const float sx = width / (xmax - xmin), sy = height / (ymax - ymin);
+        const float w = float(width), h = float(height);
+        for (size_t i = 0; i < n; i++)
+        {
+            float fx = (x[i] - xmin) * sx, fy = (y[i] - ymin) * sy;
+            if (fx >= 0.0f && fx < w && fy >= 0.0f && fy < h)
+                grid[size_t(fy)*width + size_t(fx)]++;
+        }
+    }
+
+    static void palette(double v, unsigned char *p)
+    {
+        // piecewise linear through blue, red, yellow, white
+        static const double stops[5][3] = { {0, 0, 64}, {0, 0, 255}, {255, 0, 0}, {255, 255, 0}, {255, 255, 255} };
+        double s = v * 4.0;
+        int k = std::min(3, int(s));
+        double f = s - k;
+        for (int c = 0; c < 3; c++)
+            p[c] = (unsigned char)(stops[k][c] + f*(stops[k + 1][c] - stops[k][c]) + 0.5);
+    }
+
+    static void put32(std::vector<unsigned char> &out, uint32_t v)
+    {
+        out.push_back(v >> 24);
+        out.push_back(v >> 16);
+        out.push_back(v >> 8);
+        out.push_back(v);
+    }
+
+    static uint32_t adler32(const unsigned char *d, size_t n)
+    {
+        uint32_t a = 1, b = 0;
+        while (n > 0)
+        {
+            size_t m = std::min<size_t>(n, 5552); // largest run without overflow
+            for (size_t i = 0; i < m; i++)
+            {
+                a += d[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+            d += m;
+            n -= m;
+        }
+        return (b << 16) | a;
+    }
+
+    static uint32_t crc32(const unsigned char *d, size_t n, uint32_t crc = 0xffffffffu)
+    {
+        struct Table
+        {
+            uint32_t t[256];
+            Table()
+            {
+                for (uint32_t i = 0; i < 256; i++)
+                {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; k++)
+                        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                    t[i] = c;
+                }
+            }
+        };
+        static const Table table; // built once, thread-safe
+        for (size_t i = 0; i < n; i++)
+            crc = table.t[(crc ^ d[i]) & 0xff] ^ (crc >> 8);
+        return crc;
+    }
+
+    static void chunk(std::vector<unsigned char> &png, const char *type,
+                      const unsigned char *data, size_t n)
+    {
+        put32(png, uint32_t(n));
+        size_t start = png.size();
+        png.insert(png.end(), type, type + 4);
+        if (n > 0)
+            png.insert(png.end(), data, data + n);
+        put32(png, crc32(&png[start], png.size() - start) ^ 0xffffffffu);
+    }
+};
+
+#endif
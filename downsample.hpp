@@ -0,0 +1,243 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Plot downsampling: Largest-Triangle-Three-Buckets and min/max
+///
+///  Reduces an x/y series to a target number of points before it is sent to
+///  gnuplot. The result is a list of sample indices, so any column of the
+///  telemetry can be gathered with the same selection.
+///
+///  The first and last samples and any caller supplied "keep" indices (phase
+///  changes, touchdown) are always part of the result; the series is split
+///  at those anchors and the remaining budget is shared between the segments
+///  in proportion to their length, so no bucket straddles a feature.
+///
+///  The per-bucket scans (min/max search, triangle areas) use SSE on x86 and
+///  plain loops elsewhere.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _DOWNSAMPLE_H_
+#define _DOWNSAMPLE_H_
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined(__SSE2__)
+ #include <emmintrin.h>
+ #define DOWNSAMPLE_HAVE_SSE 1
+#endif
+
+
+class Downsample
+{
+    public:
+
+    enum Method
+    {
+        LTTB,       // keeps the visually dominant point per bucket
+        MIN_MAX     // keeps the lowest and highest point per bucket (envelope)
+    };
+
+    // Selects at most max(target, anchors) indices of the n samples in x/y;
+    // keep must hold indices in [0, n), in any order
+    static void select(const float *x, const float *y, size_t n, size_t target, Method method,
+                       const std::vector<size_t> &keep, std::vector<size_t> &out)
+    {
+        out.clear();
+        if (n == 0)
+            return;
+        if (n <= target)
+        {
+            for (size_t i = 0; i < n; i++)
+                out.push_back(i);
+            return;
+        }
+
+        std::vector<size_t> anchors(keep);
+        anchors.push_back(0);
+        anchors.push_back(n - 1);
+        std::sort(anchors.begin(), anchors.end());
+        anchors.erase(std::unique(anchors.begin(), anchors.end()), anchors.end());
+        while (!anchors.empty() && anchors.back() >= n)
+            anchors.pop_back();
+
+        size_t budget   = target > anchors.size() ? target - anchors.size() : 0;
+        size_t interior = n - anchors.size();
+        size_t covered  = 0, given = 0;     // interior samples seen / points handed out
+
+        for (size_t a = 0; a + 1 < anchors.size(); a++)
+        {
+            size_t first = anchors[a] + 1, last = anchors[a + 1]; // interior [first, last)
+            out.push_back(anchors[a]);
+            if (first >= last)
+                continue;
+
+            // cumulative rounding so the segment shares add up to the budget
+            covered += last - first;
+            size_t k = size_t(double(budget) * covered / interior + 0.5) - given;
+            given += k;
+            if (k >= last - first)
+            {
+                for (size_t i = first; i < last; i++)
+                    out.push_back(i);
+            }
+            else if (method == LTTB)
+                lttb(x, y, anchors[a], first, last, k, out);
+            else
+                minMax(y, first, last, k, out);
+        }
+        out.push_back(anchors.back());
+    }
+
+    // out[i] = v[idx[i]]
+    static void gather(const float *v, const std::vector<size_t> &idx, std::vector<float> &out)
+    {
+        out.resize(idx.size());
+        for (size_t i = 0; i < idx.size(); i++)
+            out[i] = v[idx[i]];
+    }
+
+    //----------------------------------------------------------------------------------
+    // SIMD helpers
+
+    // Index of the first minimum and first maximum of v[0..n)
+    static void argMinMax(const float *v, size_t n, size_t &imin, size_t &imax)
+    {
+        float lo = v[0], hi = v[0];
+        size_t i = 0;
+#if defined(DOWNSAMPLE_HAVE_SSE)
+        if (n >= 4)
+        {
+            __m128 vlo = _mm_loadu_ps(v), vhi = vlo;
+            for (i = 4; i + 4 <= n; i += 4)
+            {
+                __m128 a = _mm_loadu_ps(v + i);
+                vlo = _mm_min_ps(vlo, a);
+                vhi = _mm_max_ps(vhi, a);
+            }
+            float l[4], h[4];
+            _mm_storeu_ps(l, vlo);
+            _mm_storeu_ps(h, vhi);
+            for (int j = 0; j < 4; j++)
+            {
+                lo = std::min(lo, l[j]);
+                hi = std::max(hi, h[j]);
+            }
+        }
+#endif
+        for (; i < n; i++)
+        {
+            lo = std::min(lo, v[i]);
+            hi = std::max(hi, v[i]);
+        }
+
+        imin = imax = n;
+        for (i = 0; i < n && (imin == n || imax == n); i++)
+        {
+            if (imin == n && v[i] == lo)
+                imin = i;
+            if (imax == n && v[i] == hi)
+                imax = i;
+        }
+        if (imin == n) imin = 0; // only with NaNs in v
+        if (imax == n) imax = 0;
+    }
+
+    // Twice the area of the triangles (a, (x[i],y[i]), c) for i in [0, n)
+    static void triangleAreas(const float *x, const float *y, size_t n,
+                              float ax, float ay, float cx, float cy, float *area)
+    {
+        const float dx = ax - cx, dy = cy - ay;
+        size_t i = 0;
+#if defined(DOWNSAMPLE_HAVE_SSE)
+        const __m128 vax = _mm_set1_ps(ax), vay = _mm_set1_ps(ay);
+        const __m128 vdx = _mm_set1_ps(dx), vdy = _mm_set1_ps(dy);
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i);
+            __m128 t  = _mm_sub_ps(_mm_mul_ps(vdx, _mm_sub_ps(py, vay)),
+                                   _mm_mul_ps(_mm_sub_ps(vax, px), vdy));
+            _mm_storeu_ps(area + i, _mm_andnot_ps(sign, t));
+        }
+#endif
+        for (; i < n; i++)
+            area[i] = std::fabs(dx*(y[i] - ay) - (ax - x[i])*dy);
+    }
+
+    private:
+
+    // LTTB over the interior [first, last) with k buckets; prev is the index
+    // selected before the interior and last the anchor that follows it
+    static void lttb(const float *x, const float *y, size_t prev, size_t first, size_t last,
+                     size_t k, std::vector<size_t> &out)
+    {
+        if (k == 0)
+            return;
+
+        thread_local std::vector<float> area;
+        double width = double(last - first) / k;
+        for (size_t b = 0; b < k; b++)
+        {
+            size_t b0 = first + size_t(b*width), b1 = first + size_t((b + 1)*width);
+            if (b1 > last) b1 = last;
+            if (b1 <= b0) continue;
+
+            // third vertex: mean of the next bucket, or the closing anchor
+            float cx = x[last], cy = y[last];
+            if (b + 1 < k)
+            {
+                size_t n0 = b1, n1 = std::min(last, first + size_t((b + 2)*width));
+                if (n1 > n0)
+                {
+                    double sx = 0.0, sy = 0.0;
+                    for (size_t i = n0; i < n1; i++)
+                    {
+                        sx += x[i];
+                        sy += y[i];
+                    }
+                    cx = float(sx / (n1 - n0));
+                    cy = float(sy / (n1 - n0));
+                }
+            }
+
+            area.resize(b1 - b0);
+            triangleAreas(x + b0, y + b0, b1 - b0, x[prev], y[prev], cx, cy, &area[0]);
+            size_t imin, imax;
+            argMinMax(&area[0], b1 - b0, imin, imax);
+
+            prev = b0 + imax;
+            out.push_back(prev);
+        }
+    }
+
+    // min and max of y per bucket over [first, last), in sample order;
+    // k points means k/2 buckets
+    static void minMax(const float *y, size_t first, size_t last, size_t k, std::vector<size_t> &out)
+    {
+        size_t buckets = std::max<size_t>(k / 2, 1);
+        double width = double(last - first) / buckets;
+        for (size_t b = 0; b < buckets; b++)
+        {
+            size_t b0 = first + size_t(b*width), b1 = first + size_t((b + 1)*width);
+            if (b1 > last) b1 = last;
+            if (b1 <= b0) continue;
+
+            size_t imin, imax;
+            argMinMax(y + b0, b1 - b0, imin, imax);
+            if (imin == imax || k == 1)
+                out.push_back(b0 + imax);
+            else
+            {
+                out.push_back(b0 + std::min(imin, imax));
+                out.push_back(b0 + std::max(imin, imax));
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,244 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Crash-safe flight recorder: an mmap'd file ring buffer
+///
+///  The recorder keeps the last `capacity` records of a fixed set of float
+///  fields in a file mapped MAP_SHARED. append() is a handful of plain stores
+///  into the mapping (no syscall, no lock, no allocation); the kernel owns
+///  the dirty pages, so whatever was appended survives the process being
+///  killed or crashing. (Surviving power loss additionally needs sync().)
+///
+///  Every slot starts with the sequence number of its record (1, 2, ...).
+///  append() first zeroes the slot's sequence, then writes the fields, then
+///  publishes the new sequence with a release store, so a record torn by a
+///  crash is recognisable and dropped by recover().
+///
+///  File layout: a FLIGHT_RECORDER_HEADER_SIZE byte header (magic, schema,
+///  slot size, capacity), then capacity slots of [uint64 seq][float fields],
+///  each padded to a multiple of 8 bytes.
+///
+///  recover() is the reader side: it rebuilds the final window, oldest
+///  record first, from the file alone.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _FLIGHT_RECORDER_H_
+#define _FLIGHT_RECORDER_H_
+
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define FLIGHT_RECORDER_MAGIC         "CSFLTREC"
+#define FLIGHT_RECORDER_VERSION       1
+#define FLIGHT_RECORDER_MAX_FIELDS    32
+#define FLIGHT_RECORDER_NAME_LEN      24
+#define FLIGHT_RECORDER_HEADER_SIZE   4096
+
+
+struct FlightRecorderHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t nFields;
+    uint32_t slotBytes;
+    uint32_t reserved;
+    uint64_t capacity;                      // slots in the ring
+    char     fieldName[FLIGHT_RECORDER_MAX_FIELDS][FLIGHT_RECORDER_NAME_LEN];
+};
+static_assert(sizeof(FlightRecorderHeader) <= FLIGHT_RECORDER_HEADER_SIZE, "header does not fit");
+
+
+class FlightRecorder
+{
+    public:
+
+        std::string     error;      // why open() or recover() failed
+
+    FlightRecorder() : base(NULL), length(0), slots(NULL), slotBytes(0), nFields(0), capacity(0), next(1) {}
+    ~FlightRecorder() { close(); }
+
+    FlightRecorder(const FlightRecorder&) = delete;
+    FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+    // Creates (or truncates) filename for capacity records of the named
+    // fields and pre-faults the whole mapping, so append() never page
+    // faults; lockMemory also pins it in RAM
+    bool open(const std::string &filename, const std::vector<std::string> &fields, size_t capacity_,
+              bool lockMemory = false)
+    {
+        close();
+        if (fields.empty() || fields.size() > FLIGHT_RECORDER_MAX_FIELDS || capacity_ == 0)
+            return fail("bad flight recorder schema");
+
+        nFields   = fields.size();
+        capacity  = capacity_;
+        slotBytes = (sizeof(uint64_t) + nFields*sizeof(float) + 7) & ~size_t(7);
+        length    = FLIGHT_RECORDER_HEADER_SIZE + capacity*slotBytes;
+
+        int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return fail("cannot create " + filename);
+        if (ftruncate(fd, off_t(length)) != 0)
+        {
+            ::close(fd);
+            return fail("cannot size " + filename);
+        }
+        void *p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+            return fail("cannot map " + filename);
+        base  = static_cast<char*>(p);
+        slots = base + FLIGHT_RECORDER_HEADER_SIZE;
+
+        // touching every page allocates it now rather than in the loop
+        memset(base, 0, length);
+        if (lockMemory && mlock(base, length) != 0)
+            error = "mlock failed; recording unlocked";
+
+        FlightRecorderHeader *hdr = reinterpret_cast<FlightRecorderHeader*>(base);
+        memcpy(hdr->magic, FLIGHT_RECORDER_MAGIC, sizeof(hdr->magic));
+        hdr->version   = FLIGHT_RECORDER_VERSION;
+        hdr->nFields   = uint32_t(nFields);
+        hdr->slotBytes = uint32_t(slotBytes);
+        hdr->capacity  = capacity;
+        for (size_t k = 0; k < nFields; k++)
+            strncpy(hdr->fieldName[k], fields[k].c_str(), FLIGHT_RECORDER_NAME_LEN - 1);
+        next = 1;
+        return true;
+    }
+
+    void close()
+    {
+        if (base != NULL)
+            munmap(base, length);
+        base   = NULL;
+        slots  = NULL;
+        length = 0;
+    }
+
+    bool isOpen() const { return base != NULL; }
+
+    // Hot path: stores nFields values, overwriting the oldest record
+    inline void append(const float *values)
+    {
+        uint64_t seq = next++;
+        char *slot = slots + ((seq - 1) % capacity)*slotBytes;
+        std::atomic_ref<uint64_t> tag(*reinterpret_cast<uint64_t*>(slot));
+
+        tag.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);    // invalidate before overwriting
+        memcpy(slot + sizeof(uint64_t), values, nFields*sizeof(float));
+        tag.store(seq, std::memory_order_release);              // publish after the fields
+    }
+
+    // Records appended since open()
+    uint64_t appended() const { return next - 1; }
+
+    // Schedules write-back of the mapping (for power-loss safety); not for the hot path
+    bool sync(bool wait = false)
+    {
+        return base != NULL && msync(base, length, wait ? MS_SYNC : MS_ASYNC) == 0;
+    }
+
+    // Reader: rebuilds the last complete run of records in filename, oldest
+    // first; records is row-major, fields.size() values per record, and
+    // firstSeq the sequence number of the first record returned
+    static bool recover(const std::string &filename, std::vector<std::string> &fields,
+                        std::vector<float> &records, uint64_t &firstSeq, std::string &error)
+    {
+        fields.clear();
+        records.clear();
+        firstSeq = 0;
+
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            error = "cannot open " + filename;
+            return false;
+        }
+        struct stat st;
+        void *p = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && size_t(st.st_size) >= FLIGHT_RECORDER_HEADER_SIZE)
+            p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+        {
+            error = "cannot map " + filename;
+            return false;
+        }
+
+        const char *file = static_cast<const char*>(p);
+        const FlightRecorderHeader *hdr = reinterpret_cast<const FlightRecorderHeader*>(file);
+        size_t n = hdr->nFields, slotBytes_ = hdr->slotBytes, capacity_ = hdr->capacity;
+        bool ok = memcmp(hdr->magic, FLIGHT_RECORDER_MAGIC, sizeof(hdr->magic)) == 0 &&
+                  hdr->version == FLIGHT_RECORDER_VERSION && n > 0 && n <= FLIGHT_RECORDER_MAX_FIELDS &&
+                  slotBytes_ >= sizeof(uint64_t) + n*sizeof(float) && capacity_ > 0 &&
+                  FLIGHT_RECORDER_HEADER_SIZE + capacity_*slotBytes_ <= size_t(st.st_size);
+        if (!ok)
+        {
+            munmap(p, st.st_size);
+            error = filename + " is not a flight recorder file";
+            return false;
+        }
+
+        for (size_t k = 0; k < n; k++)
+            fields.push_back(std::string(hdr->fieldName[k], strnlen(hdr->fieldName[k], FLIGHT_RECORDER_NAME_LEN)));
+
+        // the newest record, then walk back while the sequence is unbroken
+        const char *slotBase = file + FLIGHT_RECORDER_HEADER_SIZE;
+        uint64_t last = 0;
+        for (size_t i = 0; i < capacity_; i++)
+            last = std::max(last, seqAt(slotBase + i*slotBytes_));
+
+        uint64_t first = last;
+        while (first > 1 && last - first + 1 < capacity_ &&
+               seqAt(slotBase + ((first - 2) % capacity_)*slotBytes_) == first - 1)
+            first--;
+
+        records.resize(last == 0 ? 0 : (last + 1 - first)*n);
+        for (uint64_t s = first; s <= last && last > 0; s++)
+            memcpy(&records[(s - first)*n], slotBase + ((s - 1) % capacity_)*slotBytes_ + sizeof(uint64_t),
+                   n*sizeof(float));
+        firstSeq = first;
+        munmap(p, st.st_size);
+        return true;
+    }
+
+    private:
+
+        char       *base;
+        size_t      length;
+        char       *slots;
+        size_t      slotBytes;
+        size_t      nFields;
+        size_t      capacity;
+        uint64_t    next;       // sequence number of the next record
+
+    static uint64_t seqAt(const char *slot)
+    {
+        uint64_t seq;
+        memcpy(&seq, slot, sizeof(seq));
+        return seq;
+    }
+
+    bool fail(const std::string &why)
+    {
+        close();
+        error = why;
+        return false;
+    }
+};
+
+#endif
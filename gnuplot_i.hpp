@@ -40,6 +40,9 @@
 #include <cstdio>     
 #include <cstdlib>              // for getenv()
 #include <list>                 // for std::list
+#include <cstring>              // for memcpy()
+#include <type_traits>          // for std::decay
+#include <utility>              // for std::move
 
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__TOS_WIN__) 
@@ -86,6 +89,22 @@ class Gnuplot
   	///\brief list of created tmpfiles   
         std::vector<std::string> tmpfile_list; 
 
+	///\brief a data series streamed inline as raw binary through the pipe
+        struct binary_series_t
+        {
+            std::string          format;   // gnuplot binary format, e.g. %float32%float64
+            std::string          columns;  // using spec, e.g. 1:2; empty for images
+            std::vector<char>    data;     // packed records
+            std::string          shape;    // record=(N) or, for images, array=(W,H)
+            std::string          title;
+            std::string          style;    // "with <pstyle>" or "smooth <smooth>" unless preset
+        };
+	///\brief binary series queued for the next plot command; emptied once
+	/// sent, since gnuplot cannot replot inline data
+        std::vector<binary_series_t> binary_series;
+	///\brief binary series are 3d (splot)
+        bool                     binary_3d;
+
     //----------------------------------------------------------------------------------
     // static data
 	///\brief number of all tmpfiles (number of tmpfiles restricted)
@@ -115,6 +134,23 @@ class Gnuplot
 	/// \return <-- the name of the tempfile
 	// ---------------------------------------------------                          
         std::string    create_tmpfile(std::ofstream &tmp);  
+	// ---------------------------------------------------
+	///\brief appends a binary series and, unless queuing, sends one plot
+	/// command plus the raw data of every queued series through the pipe
+	/// 
+	/// \param series  --> the packed series
+	/// \param three_d --> splot (true) or plot (false)
+	/// \param send    --> false only queues the series for the next send
+	/// 
+	/// \return <-- a reference to the gnuplot object
+	// ---------------------------------------------------
+        Gnuplot&       send_binary(binary_series_t &series, bool three_d, bool send = true);
+	// ---------------------------------------------------
+	///\brief packs x y pairs into a binary series
+	// ---------------------------------------------------
+        template<typename X, typename Y>
+        static void    pack_xy_binary(const X &x, const Y &y, const std::string &title,
+                                      binary_series_t &series);
 
     //----------------------------------------------------------------------------------
 	///\brief gnuplot path found?
@@ -233,6 +269,9 @@ class Gnuplot
     /// saves a gnuplot session to a postscript file, filename without extension
     Gnuplot& savetops(const std::string &filename = "gnuplot_output");
 
+    /// saves a gnuplot session to a png file, filename without extension
+    Gnuplot& savetopng(const std::string &filename = "gnuplot_output");
+
 
     //----------------------------------------------------------------------------------
     // set and unset
@@ -488,6 +527,14 @@ class Gnuplot
     ///   from data
     template<typename X, typename Y>
     Gnuplot& plot_xy(const X& x, const Y& y, const std::string &title = "");
+    ///   many series (e.g. overlaid landings) from a single tmpfile: the
+    ///   series are written as blocks separated by two blank lines and drawn
+    ///   by one plot element, so gnuplot opens and parses one file however
+    ///   many series there are. x[i] and y[i] are the columns of series i.
+    template<typename X, typename Y>
+    Gnuplot& plot_xy_series(const std::vector<X> &x,
+                            const std::vector<Y> &y,
+                            const std::string &title = "");
 
 
     /// plot x,y pairs with dy errorbars: x y dy
@@ -518,6 +565,37 @@ class Gnuplot
                       const std::string &title = "");
 
 
+    /// plot data streamed inline as raw binary through the pipe: no tmpfile and
+    /// no text formatting. float columns are sent as float32, everything else
+    /// as float64. Inline data cannot be replotted, so every call draws a new
+    /// plot; overlay several series with plot_xy_binary_multi or
+    /// plot_xy_binary_series, which send them all in one plot command.
+    template<typename X>
+    Gnuplot& plot_x_binary(const X &x, const std::string &title = "");
+    ///   x y pairs
+    template<typename X, typename Y>
+    Gnuplot& plot_xy_binary(const X &x, const Y &y, const std::string &title = "");
+    ///   several y series over one x column in a single plot command (no
+    ///   intermediate frames, e.g. when redrawing a live window); replaces
+    ///   the binary series plotted so far
+    template<typename X, typename Y>
+    Gnuplot& plot_xy_binary_multi(const X &x,
+                                  const std::vector<Y> &y,
+                                  const std::vector<std::string> &titles);
+    ///   several x y series, each with its own x column, in a single plot
+    ///   command; x[i] and y[i] are the columns of series i
+    template<typename X, typename Y>
+    Gnuplot& plot_xy_binary_series(const std::vector<X> &x,
+                                   const std::vector<Y> &y,
+                                   const std::vector<std::string> &titles);
+    ///   x y z triples
+    template<typename X, typename Y, typename Z>
+    Gnuplot& plot_xyz_binary(const X &x,
+                             const Y &y,
+                             const Z &z,
+                             const std::string &title = "");
+
+
 
     /// plot an equation of the form: y = ax + b, you supply a and b
     Gnuplot& plot_slope(const double a,
@@ -544,6 +622,14 @@ class Gnuplot
                              const std::string &title = "");
 
 
+    /// plot image sent inline as binary: iWidth x iHeight grey values, or
+    /// rgb triples with rgb set; row 0 is drawn at the bottom
+    Gnuplot& plot_image_binary(const unsigned char *ucPicBuf,
+                               const unsigned int iWidth,
+                               const unsigned int iHeight,
+                               const std::string &title = "",
+                               const bool rgb = false);
+
     /// plot image
     Gnuplot& plot_image(const unsigned char *ucPicBuf,
                         const unsigned int iWidth,
@@ -568,7 +654,8 @@ class Gnuplot
     /// resets a gnuplot session and sets all variables to default
     Gnuplot& reset_all();
 
-    /// deletes temporary files
+    /// deletes temporary files; only safe once gnuplot has read them, the
+    /// destructor calls it after gnuplot has exited
     void remove_tmpfiles();
 
     // -------------------------------------------------------------------
@@ -610,7 +697,7 @@ std::string Gnuplot::terminal_std = "aqua";
 // constructor: set a style during construction
 //
 inline Gnuplot::Gnuplot(const std::string &style)
-			   :gnucmd(NULL) ,valid(false) ,two_dim(false) ,nplots(0)
+			   :gnucmd(NULL) ,valid(false) ,two_dim(false) ,nplots(0) ,binary_3d(false)
 
 {
     init();
@@ -626,7 +713,7 @@ inline Gnuplot::Gnuplot(const std::vector<double> &x,
                  const std::string &style,
                  const std::string &labelx,
                  const std::string &labely)
-			   :gnucmd(NULL) ,valid(false) ,two_dim(false) ,nplots(0)
+			   :gnucmd(NULL) ,valid(false) ,two_dim(false) ,nplots(0) ,binary_3d(false)
 {
     init();
 
@@ -648,7 +735,7 @@ inline Gnuplot::Gnuplot(const std::vector<double> &x,
                  const std::string &style,
                  const std::string &labelx,
                  const std::string &labely)
-			   :gnucmd(NULL) ,valid(false) ,two_dim(false) ,nplots(0)
+			   :gnucmd(NULL) ,valid(false) ,two_dim(false) ,nplots(0) ,binary_3d(false)
 {
     init();
 
@@ -672,7 +759,7 @@ inline Gnuplot::Gnuplot(const std::vector<double> &x,
                  const std::string &labelx,
                  const std::string &labely,
                  const std::string &labelz)
-			   :gnucmd(NULL) ,valid(false) ,two_dim(false) ,nplots(0)
+			   :gnucmd(NULL) ,valid(false) ,two_dim(false) ,nplots(0) ,binary_3d(false)
 {
     init();
 
@@ -759,6 +846,62 @@ Gnuplot& Gnuplot::plot_xy(const X& x, const Y& y, const std::string &title)
     return *this;
 }
 
+//------------------------------------------------------------------------------
+//
+/// Plots many 2d series from one file, one data block per series
+//
+template<typename X, typename Y>
+Gnuplot& Gnuplot::plot_xy_series(const std::vector<X> &x,
+                                 const std::vector<Y> &y,
+                                 const std::string &title)
+{
+    if (x.size() == 0 || y.size() == 0)
+    {
+        throw GnuplotException("std::vectors too small");
+        return *this;
+    }
+
+    if (x.size() != y.size())
+    {
+        throw GnuplotException("Number of x and y series differs");
+        return *this;
+    }
+
+    for (unsigned int s = 0; s < x.size(); s++)
+    {
+        if (x[s].size() != y[s].size())
+        {
+            throw GnuplotException("Length of the std::vectors differs");
+            return *this;
+        }
+    }
+
+
+    std::ofstream tmp;
+    std::string name = create_tmpfile(tmp);
+    if (name == "")
+        return *this;
+
+    //
+    // write the data to file, two blank lines between series
+    //
+    for (unsigned int s = 0; s < x.size(); s++)
+    {
+        if (s > 0)
+            tmp << "\n\n";
+        for (unsigned int i = 0; i < x[s].size(); i++)
+            tmp << x[s][i] << " " << y[s][i] << "\n";
+    }
+
+    tmp.flush();
+    tmp.close();
+
+
+    plotfile_xy(name, 1, 2, title);
+
+    return *this;
+}
+
 ///-----------------------------------------------------------------------------
 ///
 /// plot x,y pairs with dy errorbars
@@ -848,6 +991,204 @@ Gnuplot& Gnuplot::plot_xyz(const X &x,
 }
 
 
+//------------------------------------------------------------------------------
+//
+// binary transport helpers: float stays float32, anything else becomes float64
+//
+template<typename T> struct gp_binary_type        { typedef double type; };
+template<>           struct gp_binary_type<float> { typedef float  type; };
+
+template<typename T> inline const char* gp_binary_format()        { return "%float64"; }
+template<>           inline const char* gp_binary_format<float>() { return "%float32"; }
+
+template<typename X>
+inline void gp_binary_pack(char *&p, const X &v)
+{
+    typename gp_binary_type<X>::type t = v;
+    memcpy(p, &t, sizeof(t));
+    p += sizeof(t);
+}
+
+
+//------------------------------------------------------------------------------
+//
+/// Plots a 2d graph from a list of doubles (x), sent inline as binary
+//
+template<typename X>
+Gnuplot& Gnuplot::plot_x_binary(const X &x, const std::string &title)
+{
+    typedef typename std::decay<decltype(x[0])>::type TX;
+
+    if (x.size() == 0)
+    {
+        throw GnuplotException("std::vector too small");
+        return *this;
+    }
+
+    binary_series_t series;
+    series.format  = gp_binary_format<TX>();
+    series.columns = "1";
+    series.shape   = "record=(" + std::to_string(x.size()) + ")";
+    series.title   = title;
+    series.data.resize(x.size() * sizeof(typename gp_binary_type<TX>::type));
+
+    char *p = &series.data[0];
+    for (unsigned int i = 0; i < x.size(); i++)
+        gp_binary_pack(p, x[i]);
+
+    return send_binary(series, false);
+}
+
+
+//------------------------------------------------------------------------------
+//
+/// Packs x y pairs for the binary transport
+//
+template<typename X, typename Y>
+void Gnuplot::pack_xy_binary(const X &x, const Y &y, const std::string &title,
+                             binary_series_t &series)
+{
+    typedef typename std::decay<decltype(x[0])>::type TX;
+    typedef typename std::decay<decltype(y[0])>::type TY;
+
+    if (x.size() == 0 || y.size() == 0)
+        throw GnuplotException("std::vectors too small");
+
+    if (x.size() != y.size())
+        throw GnuplotException("Length of the std::vectors differs");
+
+    series.format  = std::string(gp_binary_format<TX>()) + gp_binary_format<TY>();
+    series.columns = "1:2";
+    series.shape   = "record=(" + std::to_string(x.size()) + ")";
+    series.title   = title;
+    series.data.resize(x.size() * (sizeof(typename gp_binary_type<TX>::type) +
+                                   sizeof(typename gp_binary_type<TY>::type)));
+
+    char *p = &series.data[0];
+    for (unsigned int i = 0; i < x.size(); i++)
+    {
+        gp_binary_pack(p, x[i]);
+        gp_binary_pack(p, y[i]);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//
+/// Plots a 2d graph from a list of doubles (x y), sent inline as binary
+//
+template<typename X, typename Y>
+Gnuplot& Gnuplot::plot_xy_binary(const X &x, const Y &y, const std::string &title)
+{
+    binary_series_t series;
+    pack_xy_binary(x, y, title, series);
+
+    return send_binary(series, false);
+}
+
+
+//------------------------------------------------------------------------------
+//
+/// Plots several y series over one x column in one plot command, as binary
+//
+template<typename X, typename Y>
+Gnuplot& Gnuplot::plot_xy_binary_multi(const X &x,
+                                       const std::vector<Y> &y,
+                                       const std::vector<std::string> &titles)
+{
+    if (y.size() == 0 || y.size() != titles.size())
+    {
+        throw GnuplotException("Need one title per series");
+        return *this;
+    }
+
+    binary_series.clear();
+    for (unsigned int k = 0; k < y.size(); k++)
+    {
+        binary_series_t series;
+        pack_xy_binary(x, y[k], titles[k], series);
+        send_binary(series, false, k + 1 == y.size());
+    }
+
+    return *this;
+}
+
+
+//------------------------------------------------------------------------------
+//
+/// Plots several 2d series, each over its own x, in one plot command, as binary
+//
+template<typename X, typename Y>
+Gnuplot& Gnuplot::plot_xy_binary_series(const std::vector<X> &x,
+                                        const std::vector<Y> &y,
+                                        const std::vector<std::string> &titles)
+{
+    if (y.size() == 0 || x.size() != y.size() || y.size() != titles.size())
+    {
+        throw GnuplotException("Need one x column and one title per series");
+        return *this;
+    }
+
+    binary_series.clear();
+    for (unsigned int k = 0; k < y.size(); k++)
+    {
+        binary_series_t series;
+        pack_xy_binary(x[k], y[k], titles[k], series);
+        send_binary(series, false, k + 1 == y.size());
+    }
+
+    return *this;
+}
+
+
+//------------------------------------------------------------------------------
+//
+/// Plots a 3d graph from a list of doubles (x y z), sent inline as binary
+//
+template<typename X, typename Y, typename Z>
+Gnuplot& Gnuplot::plot_xyz_binary(const X &x,
+                                  const Y &y,
+                                  const Z &z,
+                                  const std::string &title)
+{
+    typedef typename std::decay<decltype(x[0])>::type TX;
+    typedef typename std::decay<decltype(y[0])>::type TY;
+    typedef typename std::decay<decltype(z[0])>::type TZ;
+
+    if (x.size() == 0 || y.size() == 0 || z.size() == 0)
+    {
+        throw GnuplotException("std::vectors too small");
+        return *this;
+    }
+
+    if (x.size() != y.size() || x.size() != z.size())
+    {
+        throw GnuplotException("Length of the std::vectors differs");
+        return *this;
+    }
+
+    binary_series_t series;
+    series.format  = std::string(gp_binary_format<TX>()) + gp_binary_format<TY>() +
+                     gp_binary_format<TZ>();
+    series.columns = "1:2:3";
+    series.shape   = "record=(" + std::to_string(x.size()) + ")";
+    series.title   = title;
+    series.data.resize(x.size() * (sizeof(typename gp_binary_type<TX>::type) +
+                                   sizeof(typename gp_binary_type<TY>::type) +
+                                   sizeof(typename gp_binary_type<TZ>::type)));
+
+    char *p = &series.data[0];
+    for (unsigned int i = 0; i < x.size(); i++)
+    {
+        gp_binary_pack(p, x[i]);
+        gp_binary_pack(p, y[i]);
+        gp_binary_pack(p, z[i]);
+    }
+
+    return send_binary(series, true);
+}
+
+
 //------------------------------------------------------------------------------
 //
 // define static member function: set Gnuplot path manual
@@ -943,14 +1284,17 @@ void stringtok (Container &container,
 //
 Gnuplot::~Gnuplot()
 {
-//  remove_tmpfiles();
-
     // A stream opened by popen() should be closed by pclose()
+    // pclose() waits for gnuplot to exit, so the tmpfiles can go afterwards
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__TOS_WIN__)
-    if (_pclose(gnucmd) == -1)
+    bool closed = (gnucmd == NULL || _pclose(gnucmd) != -1);
 #elif defined(unix) || defined(__unix) || defined(__unix__) || defined(__APPLE__)
-    if (pclose(gnucmd) == -1)
+    bool closed = (gnucmd == NULL || pclose(gnucmd) != -1);
 #endif
+
+    remove_tmpfiles();
+
+    if (!closed)
         throw GnuplotException("Problem closing communication to gnuplot");
 }
 
@@ -961,9 +1305,11 @@ Gnuplot::~Gnuplot()
 //
 Gnuplot& Gnuplot::reset_plot()
 {
-//  remove_tmpfiles();
+    // tmpfiles are kept until the destructor: gnuplot reads them
+    // asynchronously and an interactive window re-reads them on zoom
 
     nplots = 0;
+    binary_series.clear();
 
     return *this;
 }
@@ -975,9 +1321,10 @@ Gnuplot& Gnuplot::reset_plot()
 //
 Gnuplot& Gnuplot::reset_all()
 {
-//  remove_tmpfiles();
+    // tmpfiles are kept until the destructor, see reset_plot()
 
     nplots = 0;
+    binary_series.clear();
     cmd("reset");
     cmd("clear");
     pstyle = "points";
@@ -1085,6 +1432,21 @@ Gnuplot& Gnuplot::savetops(const std::string &filename)
     return *this;
 }
 
+//------------------------------------------------------------------------------
+//
+// saves a gnuplot session to a png file
+//
+Gnuplot& Gnuplot::savetopng(const std::string &filename)
+{
+    cmd("set terminal png");
+
+    std::ostringstream cmdstr;
+    cmdstr << "set output \"" << filename << ".png\"";
+    cmd(cmdstr.str());
+
+    return *this;
+}
+
 //------------------------------------------------------------------------------
 //
 // Switches legend on
@@ -1633,6 +1995,95 @@ Gnuplot& Gnuplot::plot_image(const unsigned char * ucPicBuf,
 }
 
 
+//------------------------------------------------------------------------------
+//
+// Plots a grey or rgb image sent inline as binary
+//
+Gnuplot& Gnuplot::plot_image_binary(const unsigned char * ucPicBuf,
+                                    const unsigned int iWidth,
+                                    const unsigned int iHeight,
+                                    const std::string &title,
+                                    const bool rgb)
+{
+    if (iWidth == 0 || iHeight == 0)
+    {
+        throw GnuplotException("image too small");
+        return *this;
+    }
+
+    binary_series_t series;
+    series.format = rgb ? "%uchar%uchar%uchar" : "%uchar";
+    series.shape  = "array=(" + std::to_string(iWidth) + "," + std::to_string(iHeight) + ")";
+    series.title  = title;
+    series.style  = rgb ? "with rgbimage" : "with image";
+    series.data.assign(reinterpret_cast<const char*>(ucPicBuf),
+                       reinterpret_cast<const char*>(ucPicBuf) + size_t(iWidth)*iHeight*(rgb ? 3 : 1));
+
+    binary_series.clear();
+    return send_binary(series, false);
+}
+
+
+
+//------------------------------------------------------------------------------
+//
+// Appends a binary series and streams the plot command and raw data
+//
+Gnuplot& Gnuplot::send_binary(binary_series_t &series, bool three_d, bool send)
+{
+    if( !(valid) )
+    {
+        return *this;
+    }
+
+    if (three_d != binary_3d)
+        binary_series.clear();
+    binary_3d = three_d;
+
+    if (series.style != "")
+        ; // preset, e.g. "with image"
+    else if (smooth == "" || three_d)
+        series.style = "with " + pstyle;
+    else
+        series.style = "smooth " + smooth;
+
+    binary_series.push_back(std::move(series));
+    if (!send)
+        return *this;
+
+    std::ostringstream cmdstr;
+    cmdstr << (three_d ? "splot " : "plot ");
+    for (unsigned int i = 0; i < binary_series.size(); i++)
+    {
+        const binary_series_t &s = binary_series[i];
+        if (i > 0)
+            cmdstr << ", ";
+        cmdstr << "'-' binary " << s.shape << " format=\"" << s.format << "\"";
+        if (s.columns != "")
+            cmdstr << " using " << s.columns;
+        if (s.title == "")
+            cmdstr << " notitle ";
+        else
+            cmdstr << " title \"" << s.title << "\" ";
+        cmdstr << s.style;
+    }
+
+    cmd(cmdstr.str());
+
+    for (unsigned int i = 0; i < binary_series.size(); i++)
+    {
+        const std::vector<char> &d = binary_series[i].data;
+        fwrite(&d[0], 1, d.size(), gnucmd);
+    }
+    fflush(gnucmd);
+    binary_series.clear();
+
+    // inline data cannot be replotted, so the next plot starts afresh
+    nplots = 0;
+
+    return *this;
+}
+
 
 //------------------------------------------------------------------------------
 //
@@ -1871,6 +2322,7 @@ bool Gnuplot::file_available(const std::string &filename){
         throw GnuplotException( except.str() );
         return false;
     }
+    return true;
 }
 
 
@@ -1952,6 +2404,7 @@ void Gnuplot::remove_tmpfiles(){
             remove( tmpfile_list[i].c_str() );
 
         Gnuplot::tmpfile_num -= tmpfile_list.size();
+        tmpfile_list.clear();
     }
 }
 #endif
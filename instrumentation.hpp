@@ -0,0 +1,316 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Low-overhead hot-path instrumentation
+///
+///  INSTRUMENT_SCOPE("name") times the enclosing scope and records the result
+///  into a per-thread, log-linear (HDR-style) latency histogram for that probe.
+///  Each thread owns its counters, so recording is a couple of plain stores;
+///  threads never contend. Histograms are merged and p50/p99/p99.9/max are
+///  printed to stderr at exit.
+///
+///  Compiled in with -DCASE_STUDY_INSTRUMENT (or -DCASE_STUDY_TRACK_ALLOC,
+///  which attributes allocations to the same probes); otherwise
+///  INSTRUMENT_SCOPE expands to nothing. The classes are always available.
+///
+///  Timestamps come from rdtsc on x86 (calibrated against steady_clock over
+///  the run) and from steady_clock elsewhere.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _INSTRUMENTATION_H_
+#define _INSTRUMENTATION_H_
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+ #include <x86intrin.h>
+ #define INSTRUMENT_HAVE_RDTSC 1
+#endif
+
+
+#define INSTRUMENT_MAX_PROBES   32
+#define INSTRUMENT_OVERFLOW     INSTRUMENT_MAX_PROBES        // shared id for names past the limit
+#define INSTRUMENT_SUB_BITS     5                            // 32 sub-buckets per power of two (~3% resolution)
+#define INSTRUMENT_SUB_COUNT    (1 << INSTRUMENT_SUB_BITS)
+#define INSTRUMENT_MAX_EXP      40                           // values are clamped to 2^40 ticks
+#define INSTRUMENT_BUCKETS      ((INSTRUMENT_MAX_EXP - INSTRUMENT_SUB_BITS + 2) * INSTRUMENT_SUB_COUNT)
+
+
+class Instrumentation
+{
+    public:
+
+    //----------------------------------------------------------------------------------
+    // clock
+    static inline uint64_t ticks()
+    {
+#if defined(INSTRUMENT_HAVE_RDTSC)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    static inline int64_t steadyNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    //----------------------------------------------------------------------------------
+    // log-linear histogram
+    struct Histogram
+    {
+        uint64_t count;
+        uint64_t sum;
+        uint64_t max;
+        uint64_t buckets[INSTRUMENT_BUCKETS];
+
+        static inline int index(uint64_t v)
+        {
+            if (v < INSTRUMENT_SUB_COUNT)
+                return int(v);
+            int e = 63 - __builtin_clzll(v);
+            if (e > INSTRUMENT_MAX_EXP)
+                return INSTRUMENT_BUCKETS - 1;
+            int m = int(v >> (e - INSTRUMENT_SUB_BITS)) - INSTRUMENT_SUB_COUNT;
+            return (e - INSTRUMENT_SUB_BITS + 1) * INSTRUMENT_SUB_COUNT + m;
+        }
+
+        // midpoint of the values mapped to bucket i
+        static inline double value(int i)
+        {
+            if (i < INSTRUMENT_SUB_COUNT)
+                return i;
+            int e = i / INSTRUMENT_SUB_COUNT - 1 + INSTRUMENT_SUB_BITS;
+            uint64_t m = INSTRUMENT_SUB_COUNT + i % INSTRUMENT_SUB_COUNT;
+            double width = double(1ULL << (e - INSTRUMENT_SUB_BITS));
+            return double(m << (e - INSTRUMENT_SUB_BITS)) + 0.5*width;
+        }
+
+        inline void record(uint64_t v)
+        {
+            count++;
+            sum += v;
+            if (v > max)
+                max = v;
+            buckets[index(v)]++;
+        }
+
+        void merge(const Histogram &h)
+        {
+            count += h.count;
+            sum   += h.sum;
+            max    = std::max(max, h.max);
+            for (int i = 0; i < INSTRUMENT_BUCKETS; i++)
+                buckets[i] += h.buckets[i];
+        }
+
+        double percentile(double p) const
+        {
+            uint64_t target = uint64_t(p * count);
+            uint64_t seen = 0;
+            for (int i = 0; i < INSTRUMENT_BUCKETS; i++)
+            {
+                seen += buckets[i];
+                if (seen > target)
+                    return std::min(value(i), double(max));
+            }
+            return double(max);
+        }
+    };
+
+    // counters owned by one thread
+    struct ThreadBlock
+    {
+        Histogram probes[INSTRUMENT_MAX_PROBES + 1];   // plus the overflow slot
+    };
+
+    //----------------------------------------------------------------------------------
+    // registry
+
+    // Returns the id for a probe name, registering it on first use; once the
+    // table is full every new name shares INSTRUMENT_OVERFLOW
+    static int probe(const char *name)
+    {
+        Instrumentation &in = instance();
+        std::lock_guard<std::mutex> lock(in.mutex);
+        for (size_t i = 0; i < in.names.size(); i++)
+            if (in.names[i] == name)
+                return int(i);
+        if (in.names.size() == INSTRUMENT_MAX_PROBES)
+            return INSTRUMENT_OVERFLOW;
+        in.names.push_back(name);
+        return int(in.names.size() - 1);
+    }
+
+    // The calling thread's counters; allocated once, kept until exit so the
+    // report still sees threads that have finished
+    static inline ThreadBlock& local()
+    {
+        thread_local ThreadBlock *block = NULL;
+        if (block == NULL)
+        {
+            block = new ThreadBlock();
+            Instrumentation &in = instance();
+            std::lock_guard<std::mutex> lock(in.mutex);
+            in.blocks.push_back(block);
+        }
+        return *block;
+    }
+
+    static inline void record(int id, uint64_t ticks)
+    {
+        local().probes[id].record(ticks);
+    }
+
+    // Innermost active probe on the calling thread (-1 outside any probe);
+    // maintained only when allocation tracking is compiled in
+    static inline int& currentProbe()
+    {
+        thread_local int id = -1;
+        return id;
+    }
+
+    // Name a probe was registered with
+    static std::string name(int id)
+    {
+        Instrumentation &in = instance();
+        std::lock_guard<std::mutex> lock(in.mutex);
+        if (id == INSTRUMENT_OVERFLOW)
+            return "(overflow)";
+        return (id >= 0 && id < int(in.names.size())) ? in.names[id] : std::string("(unscoped)");
+    }
+
+    // Times the enclosing scope
+    class ScopedTimer
+    {
+        public:
+            int      id;
+            uint64_t start;
+#if defined(CASE_STUDY_TRACK_ALLOC)
+            int      parent;
+
+        inline ScopedTimer(int id_) : id(id_), start(ticks()), parent(currentProbe()) { currentProbe() = id; }
+        inline ~ScopedTimer() { record(id, ticks() - start); currentProbe() = parent; }
+#else
+        inline ScopedTimer(int id_) : id(id_), start(ticks()) {}
+        inline ~ScopedTimer() { record(id, ticks() - start); }
+#endif
+    };
+
+    //----------------------------------------------------------------------------------
+    // reporting
+
+    // Nanoseconds per tick, calibrated over the lifetime of the process
+    static double tickNs()
+    {
+        return instance().nsPerTick();
+    }
+
+    // Merges every thread's counters and prints one line per probe
+    static void report(std::ostream &out)
+    {
+        instance().reportTo(out);
+    }
+
+    static Instrumentation& instance()
+    {
+        static Instrumentation in;
+        return in;
+    }
+
+#if defined(CASE_STUDY_INSTRUMENT)
+    // dumps the report when the process exits
+    ~Instrumentation()
+    {
+        reportTo(std::cerr);
+    }
+#endif
+
+    private:
+
+        std::mutex                  mutex;
+        std::vector<std::string>    names;
+        std::vector<ThreadBlock*>   blocks;
+        int64_t                     startNs;
+        uint64_t                    startTicks;
+
+    Instrumentation() : startNs(steadyNs()), startTicks(ticks()) {}
+
+    double nsPerTick()
+    {
+#if defined(INSTRUMENT_HAVE_RDTSC)
+        int64_t  ns = steadyNs();
+        uint64_t t  = ticks();
+        while (ns - startNs < 10000000) // at least 10 ms of calibration
+        {
+            ns = steadyNs();
+            t  = ticks();
+        }
+        return double(ns - startNs) / double(t - startTicks);
+#else
+        return 1.0;
+#endif
+    }
+
+    void reportTo(std::ostream &out)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (names.empty())
+            return;
+
+        double scale = 1e-3 * nsPerTick(); // ticks -> us
+        out << "Instrumentation (us)\n"
+            << std::setw(20) << std::left << "  probe" << std::right
+            << std::setw(10) << "count" << std::setw(10) << "mean"
+            << std::setw(10) << "p50" << std::setw(10) << "p99"
+            << std::setw(10) << "p99.9" << std::setw(10) << "max" << "\n";
+
+        Histogram *h = new Histogram();
+        for (size_t p = 0; p <= INSTRUMENT_OVERFLOW; p++)
+        {
+            if (p >= names.size() && p != INSTRUMENT_OVERFLOW)
+                continue;
+            *h = Histogram();
+            for (size_t b = 0; b < blocks.size(); b++)
+                h->merge(blocks[b]->probes[p]);
+            if (h->count == 0)
+                continue;
+
+            out << "  " << std::setw(18) << std::left
+                << (p == INSTRUMENT_OVERFLOW ? std::string("(overflow)") : names[p]) << std::right
+                << std::setw(10) << h->count
+                << std::setw(10) << std::setprecision(4) << scale*h->sum/h->count
+                << std::setw(10) << scale*h->percentile(0.50)
+                << std::setw(10) << scale*h->percentile(0.99)
+                << std::setw(10) << scale*h->percentile(0.999)
+                << std::setw(10) << scale*h->max << "\n";
+        }
+        delete h;
+    }
+};
+
+
+#define INSTRUMENT_CONCAT_(a, b) a##b
+#define INSTRUMENT_CONCAT(a, b)  INSTRUMENT_CONCAT_(a, b)
+
+#if defined(CASE_STUDY_INSTRUMENT) || defined(CASE_STUDY_TRACK_ALLOC)
+ #define INSTRUMENT_SCOPE(name) \
+    static const int INSTRUMENT_CONCAT(instrumentProbe_, __LINE__) = Instrumentation::probe(name); \
+    Instrumentation::ScopedTimer INSTRUMENT_CONCAT(instrumentTimer_, __LINE__)(INSTRUMENT_CONCAT(instrumentProbe_, __LINE__))
+#else
+ #define INSTRUMENT_SCOPE(name)
+#endif
+
+#endif
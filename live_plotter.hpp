@@ -0,0 +1,181 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Live telemetry plot fed from a hot loop
+///
+///  push() hands one sample to a render thread through a lock-free SPSC
+///  ring and returns immediately; when the ring is full the sample is
+///  dropped and counted, the producer never waits. The render thread keeps
+///  a rolling window of the latest samples and redraws it at a throttled
+///  rate (default 5 Hz) through one open gnuplot session, skipping frames it
+///  cannot keep up with.
+///
+///  Exactly one thread may call push().
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _LIVE_PLOTTER_H_
+#define _LIVE_PLOTTER_H_
+
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gnuplot_i.hpp"
+#include "spsc_ring.hpp"
+
+
+#define LIVE_MAX_SERIES 4
+
+
+class LivePlotter
+{
+    public:
+
+    struct Sample
+    {
+        float x;
+        float y[LIVE_MAX_SERIES];
+    };
+
+        std::atomic<long>   pushed;     // samples accepted by push()
+        std::atomic<long>   dropped;    // samples dropped because the ring was full
+        std::atomic<long>   frames;     // frames sent to gnuplot
+        std::atomic<long>   skipped;    // frames skipped because rendering fell behind
+        std::string         error;      // why gnuplot could not be started, if so
+
+    // titles: one per y series (1 to LIVE_MAX_SERIES); window: samples kept (at least 2);
+    // rateHz: positive. A rejected configuration leaves the reason in error and
+    // the plotter running without gnuplot, like one that could not be started.
+    LivePlotter(const std::vector<std::string> &titles_, size_t window_ = 1000,
+                double rateHz = 5.0, size_t queueSize = 4096)
+        : pushed(0), dropped(0), frames(0), skipped(0), gp(NULL), titles(titles_),
+          window(window_), periodNs(rateHz > 0 ? (long long)(1e9/rateHz) : 200000000), ring(queueSize), stop(false)
+    {
+        if (titles.size() > LIVE_MAX_SERIES)
+            titles.resize(LIVE_MAX_SERIES);
+        if (window < 2) // the render loop indexes the window modulo its size
+            window = 2;
+        if (titles.empty())
+            error = "live plot needs at least one series";
+        else if (!(rateHz > 0))
+            error = "live plot rate must be positive";
+        else
+        {
+            try
+            {
+                gp = new Gnuplot("lines");
+            }
+            catch (GnuplotException &ge)
+            {
+                error = ge.what();
+            }
+        }
+        renderer = std::thread(&LivePlotter::run, this);
+    }
+
+    // Draws what is left, then closes gnuplot
+    ~LivePlotter()
+    {
+        stop.store(true, std::memory_order_release);
+        renderer.join();
+        delete gp;
+    }
+
+    // Producer side: never blocks
+    inline void push(float x, const float *y)
+    {
+        Sample s;
+        s.x = x;
+        for (size_t k = 0; k < titles.size(); k++)
+            s.y[k] = y[k];
+        if (ring.push(&s, 1) == 1)
+            pushed.fetch_add(1, std::memory_order_relaxed);
+        else
+            dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    private:
+
+        Gnuplot                    *gp;     // used by the render thread only
+        std::vector<std::string>    titles;
+        size_t                      window;
+        long long                   periodNs;
+        SpscRing<Sample>            ring;
+        std::atomic<bool>           stop;
+        std::thread                 renderer;
+
+    static long long now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void run()
+    {
+        // rolling window, oldest sample at head
+        std::vector<Sample> win(window);
+        size_t head = 0, count = 0;
+        std::vector<float> x;
+        std::vector<std::vector<float> > y(titles.size());
+        Sample batch[256];
+
+        long long next = now();
+        for (;;)
+        {
+            bool last = stop.load(std::memory_order_acquire);
+
+            size_t n;
+            bool fresh = false;
+            while ((n = ring.pop(batch, 256)) > 0)
+            {
+                for (size_t i = 0; i < n; i++)
+                {
+                    win[(head + count) % window] = batch[i];
+                    if (count < window)
+                        count++;
+                    else
+                        head = (head + 1) % window;
+                }
+                fresh = true;
+            }
+
+            if (fresh && gp != NULL && count > 0)
+            {
+                x.resize(count);
+                for (size_t k = 0; k < y.size(); k++)
+                    y[k].resize(count);
+                for (size_t i = 0; i < count; i++)
+                {
+                    const Sample &s = win[(head + i) % window];
+                    x[i] = s.x;
+                    for (size_t k = 0; k < y.size(); k++)
+                        y[k][i] = s.y[k];
+                }
+                gp->plot_xy_binary_multi(x, y, titles);
+                frames++;
+            }
+
+            if (last)
+                break;
+
+            // throttle to the frame rate; slots that passed while
+            // rendering are skipped rather than caught up
+            next += periodNs;
+            long long t = now();
+            if (next <= t)
+            {
+                long long late = (t - next)/periodNs + 1;
+                skipped += late;
+                next    += late*periodNs;
+            }
+            while (now() < next && !stop.load(std::memory_order_acquire))
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,395 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Replay source for recorded sensor logs
+///
+///  Maps a recorded log, either a TelemetryFile (raw or packed columns) or a
+///  CSV file, and hands out its samples in batches: time, the three
+///  measured coordinates and a validity flag. Measurement columns are looked
+///  up as lidar.x/lidar.y/lidar.z (flight recorder names), else x/y/z; a
+///  missing lidar.valid column means every sample is valid.
+///
+///  A read-ahead thread keeps the pages ahead of the consumer resident
+///  (madvise(MADV_WILLNEED), then touching one byte per page), so page
+///  faults and disk reads land on that thread rather than on the loop that
+///  consumes the samples. Memory use does not grow with the log size.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _LOG_REPLAY_H_
+#define _LOG_REPLAY_H_
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "telemetry_file.hpp"
+#include "telemetry_csv.hpp"
+
+
+struct ReplaySample
+{
+    float   t;
+    float   z[3];       // measured x, y, z
+    bool    valid;
+};
+
+
+class LogReplay
+{
+    public:
+
+        std::string     error;      // why open() or next() failed
+
+    LogReplay() : csv(NULL), csvEnd(NULL), csvCursor(NULL), csvBase(NULL), csvLength(0),
+                  cursor(0), progress(0.0), stop(false) {}
+    ~LogReplay() { close(); }
+
+    LogReplay(const LogReplay&) = delete;
+    LogReplay& operator=(const LogReplay&) = delete;
+
+    // Maps filename; prefetchBytes is how far ahead of the consumer the
+    // read-ahead thread keeps each column (0 = no read-ahead thread)
+    bool open(const std::string &filename, size_t prefetchBytes = size_t(64) << 20)
+    {
+        close();
+        error.clear();
+        if (isTelemetryFile(filename))
+        {
+            if (!file.open(filename))
+            {
+                error = file.error;
+                return false;
+            }
+            if (!findColumns())
+                return false;
+            for (int k = 0; k < 5; k++)
+            {
+                if (col[k] < 0)
+                    continue;
+                const char *base = reinterpret_cast<const char*>(file.data(col[k]));
+                regions.push_back(Region(base, file.storedBytes(col[k])));
+            }
+        }
+        else if (!openCsv(filename))
+            return false;
+
+        if (prefetchBytes > 0)
+        {
+            lead = prefetchBytes;
+            stop = false;
+            reader = std::thread(&LogReplay::readAhead, this);
+        }
+        return true;
+    }
+
+    void close()
+    {
+        stop = true;
+        if (reader.joinable())
+            reader.join();
+        file.close();
+        if (csvBase != NULL)
+            munmap(const_cast<char*>(csvBase), csvLength);
+        csvBase = csv = csvEnd = csvCursor = NULL;
+        csvLength = 0;
+        regions.clear();
+        cursor = 0;
+        progress = 0.0;
+    }
+
+    bool isCsv() const { return csvBase != NULL; }
+
+    // Log size on disk
+    uint64_t bytes() const
+    {
+        if (isCsv())
+            return csvLength;
+        uint64_t b = TELEMETRY_HEADER_SIZE;
+        for (int k = 0; k < file.columns(); k++)
+            b += file.storedBytes(k);
+        return b;
+    }
+
+    // Bytes of the log consumed so far
+    uint64_t position() const
+    {
+        if (isCsv())
+            return csvCursor - csvBase;
+        return file.samples() == 0 ? 0 : uint64_t(double(bytes())*cursor/file.samples());
+    }
+
+    // Samples in a binary log; 0 for CSV (not known before parsing)
+    size_t samples() const { return isCsv() ? 0 : file.samples(); }
+
+    // Nominal sample period: the clockCycle parameter, else from the sample
+    // rate, else 0 (caller's choice)
+    double samplePeriod() const
+    {
+        if (isCsv())
+            return csvPeriod;
+        double cycle = file.param("clockCycle", 0.0);
+        if (cycle > 0.0)
+            return cycle;
+        return file.header().sampleRate > 0.0 ? 1.0/file.header().sampleRate : 0.0;
+    }
+
+    // Fills up to max samples; returns 0 at the end of the log (or on a
+    // malformed CSV row, with error set)
+    size_t next(ReplaySample *out, size_t max)
+    {
+        size_t n = isCsv() ? nextCsv(out, max) : nextBinary(out, max);
+        double done = isCsv() ? double(csvCursor - csv) / double(csvEnd - csv)
+                              : double(cursor) / double(std::max<size_t>(1, file.samples()));
+        progress.store(done, std::memory_order_relaxed);
+        return n;
+    }
+
+    private:
+
+    struct Region
+    {
+        const char *base;
+        size_t      length;
+        size_t      fetched;    // bytes already made resident
+        Region(const char *b, size_t l) : base(b), length(l), fetched(0) {}
+    };
+
+        TelemetryFile           file;
+        int                     col[5];     // t, x, y, z, valid
+        std::vector<float>      buf[5];     // decoded packed columns / batch scratch
+
+        const char             *csv, *csvEnd, *csvCursor;   // CSV rows
+        const char             *csvBase;
+        size_t                  csvLength;
+        int                     csvCol[5];
+        size_t                  csvColumns;
+        double                  csvPeriod;
+
+        size_t                  cursor;     // next binary sample
+        std::vector<Region>     regions;
+        size_t                  lead;
+        std::atomic<double>     progress;   // consumed fraction, for the read-ahead thread
+        std::atomic<bool>       stop;
+        std::thread             reader;
+
+    // Telemetry files start with TELEMETRY_MAGIC; anything else is read as CSV
+    static bool isTelemetryFile(const std::string &filename)
+    {
+        char magic[sizeof(TELEMETRY_MAGIC)] = {};
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        bool match = ::pread(fd, magic, sizeof(magic), 0) == ssize_t(sizeof(magic)) &&
+                     memcmp(magic, TELEMETRY_MAGIC, sizeof(magic)) == 0;
+        ::close(fd);
+        return match;
+    }
+
+    static int findIndex(const std::vector<std::string> &names, const char *a, const char *b)
+    {
+        for (const char *want : { a, b })
+            for (size_t k = 0; want != NULL && k < names.size(); k++)
+                if (names[k] == want)
+                    return int(k);
+        return -1;
+    }
+
+    bool findColumns()
+    {
+        std::vector<std::string> names;
+        for (int k = 0; k < file.columns(); k++)
+            names.push_back(file.header().columnName[k]);
+        col[0] = findIndex(names, "t", NULL);
+        col[1] = findIndex(names, "lidar.x", "x");
+        col[2] = findIndex(names, "lidar.y", "y");
+        col[3] = findIndex(names, "lidar.z", "z");
+        col[4] = findIndex(names, "lidar.valid", NULL);
+        if (col[0] < 0 || col[1] < 0 || col[2] < 0 || col[3] < 0)
+        {
+            error = "log lacks a t, x, y or z column";
+            file.close();
+            return false;
+        }
+        return true;
+    }
+
+    size_t nextBinary(ReplaySample *out, size_t max)
+    {
+        size_t n = std::min(max, file.samples() - cursor);
+        const float *src[5];
+        for (int k = 0; k < 5; k++)
+        {
+            src[k] = NULL;
+            if (col[k] < 0)
+                continue;
+            if (file.encoding(col[k]) == TELEMETRY_RAW)
+                src[k] = file.data(col[k]) + cursor;
+            else
+            {
+                buf[k].resize(n);
+                file.read(col[k], cursor, n, &buf[k][0]);
+                src[k] = &buf[k][0];
+            }
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            out[i].t    = src[0][i];
+            out[i].z[0] = src[1][i];
+            out[i].z[1] = src[2][i];
+            out[i].z[2] = src[3][i];
+            out[i].valid = src[4] == NULL || src[4][i] != 0.0f;
+        }
+        cursor += n;
+        return n;
+    }
+
+    bool openCsv(const std::string &filename)
+    {
+        file.close();
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        struct stat st;
+        void *p = MAP_FAILED;
+        if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0)
+            p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (fd >= 0)
+            ::close(fd);
+        if (p == MAP_FAILED)
+        {
+            error = "cannot map " + filename;
+            return false;
+        }
+        csvBase   = static_cast<const char*>(p);
+        csvLength = st.st_size;
+        madvise(p, csvLength, MADV_SEQUENTIAL);
+
+        const char *end = csvBase + csvLength;
+        const char *eol = std::find(csvBase, end, '\n');
+        std::string head(csvBase, eol);
+        if (!head.empty() && head.back() == '\r')
+            head.pop_back();
+        std::vector<std::string> names;
+        for (size_t s = 0, e; s <= head.size(); s = e + 1)
+        {
+            e = std::min(head.find(',', s), head.size());
+            names.push_back(head.substr(s, e - s));
+        }
+        csvColumns = names.size();
+        csvCol[0] = findIndex(names, "t", NULL);
+        csvCol[1] = findIndex(names, "lidar.x", "x");
+        csvCol[2] = findIndex(names, "lidar.y", "y");
+        csvCol[3] = findIndex(names, "lidar.z", "z");
+        csvCol[4] = findIndex(names, "lidar.valid", NULL);
+        if (csvCol[0] < 0 || csvCol[1] < 0 || csvCol[2] < 0 || csvCol[3] < 0)
+        {
+            error = filename + " lacks a t, x, y or z column";
+            return false;
+        }
+        // nextCsv() keeps only the first TELEMETRY_MAX_COLUMNS fields of a row
+        if (*std::max_element(csvCol, csvCol + 5) >= TELEMETRY_MAX_COLUMNS)
+        {
+            error = filename + " has a t, x, y, z or valid column past column " +
+                    std::to_string(TELEMETRY_MAX_COLUMNS);
+            return false;
+        }
+        csv = csvCursor = eol < end ? eol + 1 : end;
+        csvEnd = end;
+        regions.push_back(Region(csv, csvEnd - csv));
+
+        // nominal period from the first two rows
+        csvPeriod = 0.0;
+        ReplaySample first[2];
+        if (nextCsv(first, 2) == 2 && first[1].t > first[0].t)
+            csvPeriod = first[1].t - first[0].t;
+        csvCursor = csv;
+        error.clear();
+        return true;
+    }
+
+    size_t nextCsv(ReplaySample *out, size_t max)
+    {
+        float row[TELEMETRY_MAX_COLUMNS];
+        size_t n = 0;
+        const char *p = csvCursor;
+        while (n < max && p < csvEnd)
+        {
+            if (*p == '\n')
+            {
+                p++;
+                continue;
+            }
+            for (size_t k = 0; k < csvColumns; k++)
+            {
+                float x = 0.0f;
+                const char *q = TelemetryCsv::parseValue(p, csvEnd, x);
+                if (q == NULL || (k + 1 < csvColumns && (q == csvEnd || *q != ',')))
+                {
+                    error = "malformed CSV row at byte " + std::to_string(p - csvBase);
+                    csvCursor = csvEnd;
+                    return 0;
+                }
+                if (k < TELEMETRY_MAX_COLUMNS)
+                    row[k] = x;
+                p = q + (k + 1 < csvColumns);
+            }
+            while (p < csvEnd && *p != '\n')
+                p++;
+            if (p < csvEnd)
+                p++;
+
+            out[n].t    = row[csvCol[0]];
+            out[n].z[0] = row[csvCol[1]];
+            out[n].z[1] = row[csvCol[2]];
+            out[n].z[2] = row[csvCol[3]];
+            out[n].valid = csvCol[4] < 0 || row[csvCol[4]] != 0.0f;
+            n++;
+        }
+        csvCursor = p;
+        return n;
+    }
+
+    // Keeps every region resident up to `lead` bytes past the consumer
+    void readAhead()
+    {
+        const size_t page = size_t(sysconf(_SC_PAGESIZE));
+        while (!stop.load(std::memory_order_relaxed))
+        {
+            double done = progress.load(std::memory_order_relaxed);
+            bool idle = true;
+            for (size_t r = 0; r < regions.size(); r++)
+            {
+                Region &reg = regions[r];
+                size_t want = std::min(reg.length, size_t(done*reg.length) + lead);
+                if (reg.fetched >= want)
+                    continue;
+                idle = false;
+
+                // ask for the whole window, then fault it in a slice at a time
+                size_t slice = std::min(want, reg.fetched + (size_t(4) << 20));
+                uintptr_t a = uintptr_t(reg.base + reg.fetched) & ~uintptr_t(page - 1);
+                madvise(reinterpret_cast<void*>(a), uintptr_t(reg.base + slice) - a, MADV_WILLNEED);
+                unsigned char sum = 0;
+                for (size_t off = reg.fetched; off < slice; off += page)
+                    sum += static_cast<const volatile unsigned char*>(
+                               static_cast<const void*>(reg.base))[off];
+                (void)sum;
+                reg.fetched = slice;
+            }
+            if (idle)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,314 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Mergeable summary statistics for distributed campaigns
+///
+///  Three summaries that can be computed on separate threads, processes or
+///  hosts and combined afterwards:
+///
+///  Moments         count, mean, central moments M2..M4, min and max;
+///                  Welford's update per value and Pebay's pairwise merge
+///  FixedHistogram  counts over equal bins of [lo, hi), plus under/overflow
+///  QuantileSketch  relative-error quantiles (DDSketch): logarithmic buckets
+///                  with integer counts, so any quantile is within `alpha`
+///                  (relative) of the true value
+///
+///  Histogram and sketch merges are integer additions and so exact in any
+///  order. Moments merges are floating point: merging the same parts in the
+///  same order gives the same bits, which is what a campaign relies on by
+///  always folding its fixed blocks of runs in block order.
+///
+///  save() appends a binary image to a string and load() reads it back
+///  (host byte order), for partial result files.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _MERGEABLE_STATS_H_
+#define _MERGEABLE_STATS_H_
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+
+// Binary helpers for save()/load()
+class StatsIO
+{
+    public:
+
+    template <typename T>
+    static void put(std::string &out, const T &value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    static bool get(const char *&p, const char *end, T &value)
+    {
+        if (size_t(end - p) < sizeof(T))
+            return false;
+        memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+};
+
+
+struct Moments
+{
+    uint64_t n    = 0;
+    double   mean = 0.0;
+    double   m2   = 0.0;        // sums of powers of deviations from the mean
+    double   m3   = 0.0;
+    double   m4   = 0.0;
+    double   min  = std::numeric_limits<double>::infinity();
+    double   max  = -std::numeric_limits<double>::infinity();
+
+    void add(double x)
+    {
+        double n1 = double(n++);
+        double d = x - mean, dn = d/double(n), dn2 = dn*dn, t = d*dn*n1;
+        mean += dn;
+        m4 += t*dn2*(double(n)*double(n) - 3.0*double(n) + 3.0) + 6.0*dn2*m2 - 4.0*dn*m3;
+        m3 += t*dn*(double(n) - 2.0) - 3.0*dn*m2;
+        m2 += t;
+        min = std::min(min, x);
+        max = std::max(max, x);
+    }
+
+    void merge(const Moments &o)
+    {
+        if (o.n == 0)
+            return;
+        if (n == 0)
+        {
+            *this = o;
+            return;
+        }
+        double na = double(n), nb = double(o.n), nn = na + nb;
+        double d = o.mean - mean, d2 = d*d;
+        double mean_ = mean + d*nb/nn;
+        double m2_ = m2 + o.m2 + d2*na*nb/nn;
+        double m3_ = m3 + o.m3 + d2*d*na*nb*(na - nb)/(nn*nn) + 3.0*d*(na*o.m2 - nb*m2)/nn;
+        double m4_ = m4 + o.m4 + d2*d2*na*nb*(na*na - na*nb + nb*nb)/(nn*nn*nn)
+                   + 6.0*d2*(na*na*o.m2 + nb*nb*m2)/(nn*nn) + 4.0*d*(na*o.m3 - nb*m3)/nn;
+        n += o.n;
+        mean = mean_;
+        m2 = m2_;
+        m3 = m3_;
+        m4 = m4_;
+        min = std::min(min, o.min);
+        max = std::max(max, o.max);
+    }
+
+    double variance() const { return n > 1 ? m2/double(n - 1) : 0.0; }
+    double stddev()   const { return std::sqrt(variance()); }
+    double skewness() const { return m2 > 0.0 ? std::sqrt(double(n))*m3/std::pow(m2, 1.5) : 0.0; }
+    double kurtosis() const { return m2 > 0.0 ? double(n)*m4/(m2*m2) - 3.0 : 0.0; }   // excess
+
+    // Half width of the confidence interval of the mean: z standard errors
+    // (1.96 for 95% with many values; a Student t quantile with few)
+    double halfWidth(double z = 1.96) const
+    {
+        return n > 1 ? z*stddev()/std::sqrt(double(n)) : std::numeric_limits<double>::infinity();
+    }
+
+    void save(std::string &out) const
+    {
+        StatsIO::put(out, n);
+        for (double v : { mean, m2, m3, m4, min, max })
+            StatsIO::put(out, v);
+    }
+
+    bool load(const char *&p, const char *end)
+    {
+        return StatsIO::get(p, end, n) && StatsIO::get(p, end, mean) && StatsIO::get(p, end, m2) &&
+               StatsIO::get(p, end, m3) && StatsIO::get(p, end, m4) && StatsIO::get(p, end, min) &&
+               StatsIO::get(p, end, max);
+    }
+};
+
+
+struct FixedHistogram
+{
+    double                  lo = 0.0, hi = 1.0;
+    std::vector<uint64_t>   counts;
+    uint64_t                below = 0, above = 0;
+
+    void init(double lo_, double hi_, size_t bins)
+    {
+        lo = lo_;
+        hi = hi_;
+        counts.assign(bins, 0);
+        below = above = 0;
+    }
+
+    void add(double x)
+    {
+        if (!(x >= lo))
+            below++;
+        else if (x >= hi)
+            above++;
+        else
+            counts[std::min(counts.size() - 1, size_t((x - lo)/(hi - lo)*counts.size()))]++;
+    }
+
+    // Parts must share the binning; returns false otherwise
+    bool merge(const FixedHistogram &o)
+    {
+        if (o.lo != lo || o.hi != hi || o.counts.size() != counts.size())
+            return false;
+        for (size_t b = 0; b < counts.size(); b++)
+            counts[b] += o.counts[b];
+        below += o.below;
+        above += o.above;
+        return true;
+    }
+
+    void save(std::string &out) const
+    {
+        StatsIO::put(out, lo);
+        StatsIO::put(out, hi);
+        StatsIO::put(out, uint64_t(counts.size()));
+        out.append(reinterpret_cast<const char*>(counts.data()), counts.size()*sizeof(uint64_t));
+        StatsIO::put(out, below);
+        StatsIO::put(out, above);
+    }
+
+    bool load(const char *&p, const char *end)
+    {
+        uint64_t bins;
+        if (!StatsIO::get(p, end, lo) || !StatsIO::get(p, end, hi) || !StatsIO::get(p, end, bins) ||
+            bins > uint64_t(end - p)/sizeof(uint64_t))
+            return false;
+        counts.resize(bins);
+        memcpy(counts.data(), p, bins*sizeof(uint64_t));
+        p += bins*sizeof(uint64_t);
+        return StatsIO::get(p, end, below) && StatsIO::get(p, end, above);
+    }
+};
+
+
+class QuantileSketch
+{
+    public:
+
+    explicit QuantileSketch(double alpha_ = 0.01) { init(alpha_); }
+
+    void init(double alpha_)
+    {
+        alpha = alpha_;
+        gamma = (1.0 + alpha)/(1.0 - alpha);
+        logGamma = std::log(gamma);
+        positive.clear();
+        negative.clear();
+        zeros = count = 0;
+    }
+
+    void add(double x)
+    {
+        count++;
+        if (x > MIN_VALUE)
+            positive[bucket(x)]++;
+        else if (x < -MIN_VALUE)
+            negative[bucket(-x)]++;
+        else
+            zeros++;
+    }
+
+    // Parts must share alpha; returns false otherwise
+    bool merge(const QuantileSketch &o)
+    {
+        if (o.alpha != alpha)
+            return false;
+        for (const auto &b : o.positive)
+            positive[b.first] += b.second;
+        for (const auto &b : o.negative)
+            negative[b.first] += b.second;
+        zeros += o.zeros;
+        count += o.count;
+        return true;
+    }
+
+    // Value at quantile q in [0, 1]; NaN when empty
+    double quantile(double q) const
+    {
+        if (count == 0)
+            return std::numeric_limits<double>::quiet_NaN();
+        uint64_t rank = uint64_t(std::clamp(q, 0.0, 1.0)*double(count - 1)), seen = 0;
+        for (auto b = negative.rbegin(); b != negative.rend(); ++b)
+            if ((seen += b->second) > rank)
+                return -value(b->first);
+        if ((seen += zeros) > rank)
+            return 0.0;
+        for (const auto &b : positive)
+            if ((seen += b.second) > rank)
+                return value(b.first);
+        return value(positive.rbegin()->first);
+    }
+
+    uint64_t size()     const { return count; }
+    double   accuracy() const { return alpha; }
+
+    void save(std::string &out) const
+    {
+        StatsIO::put(out, alpha);
+        StatsIO::put(out, zeros);
+        StatsIO::put(out, count);
+        for (const std::map<int32_t, uint64_t> *store : { &positive, &negative })
+        {
+            StatsIO::put(out, uint64_t(store->size()));
+            for (const auto &b : *store)
+            {
+                StatsIO::put(out, b.first);
+                StatsIO::put(out, b.second);
+            }
+        }
+    }
+
+    bool load(const char *&p, const char *end)
+    {
+        double a;
+        if (!StatsIO::get(p, end, a))
+            return false;
+        init(a);
+        if (!StatsIO::get(p, end, zeros) || !StatsIO::get(p, end, count))
+            return false;
+        for (std::map<int32_t, uint64_t> *store : { &positive, &negative })
+        {
+            uint64_t n;
+            if (!StatsIO::get(p, end, n))
+                return false;
+            for (uint64_t i = 0; i < n; i++)
+            {
+                int32_t k;
+                uint64_t c;
+                if (!StatsIO::get(p, end, k) || !StatsIO::get(p, end, c))
+                    return false;
+                (*store)[k] = c;
+            }
+        }
+        return true;
+    }
+
+    private:
+
+        static constexpr double MIN_VALUE = 1e-9;   // smaller magnitudes count as zero
+
+        double                      alpha, gamma, logGamma;
+        std::map<int32_t, uint64_t> positive, negative;     // bucket -> count
+        uint64_t                    zeros, count;
+
+    int32_t bucket(double x) const { return int32_t(std::ceil(std::log(x)/logGamma)); }
+
+    // Middle of bucket k, within alpha of every value in it
+    double value(int32_t k) const { return 2.0*std::pow(gamma, double(k))/(gamma + 1.0); }
+};
+
+#endif
@@ -0,0 +1,179 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Periodic real-time executor with deadline monitoring
+///
+///  Runs a cycle function on absolute deadlines (clock_nanosleep with
+///  TIMER_ABSTIME on CLOCK_MONOTONIC) and records, per cycle, the wake-up
+///  jitter, the execution time and whether the cycle overran its period.
+///
+///  Optional (Linux): pin the calling thread to a core, switch it to
+///  SCHED_FIFO and mlockall() the process so page faults cannot stall a cycle.
+///  These need CAP_SYS_NICE / CAP_IPC_LOCK; failures are reported, not fatal.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _RT_EXECUTOR_H_
+#define _RT_EXECUTOR_H_
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+ #include <pthread.h>
+ #include <sched.h>
+ #include <sys/mman.h>
+#endif
+
+
+class RtExecutor
+{
+    public:
+
+    // per-cycle record
+    struct Cycle
+    {
+        long long jitterNs;     // actual wake-up minus release time
+        long long execNs;       // time spent in the cycle function
+        bool      missed;       // cycle finished after its deadline
+    };
+
+        long long           periodNs;
+        int                 cpu;            // core to pin to, -1 = no pinning
+        int                 fifoPriority;   // SCHED_FIFO priority, 0 = keep policy
+        bool                lockMemory;     // mlockall current and future pages
+        std::vector<Cycle>  cycles;         // preallocated by run()
+        long                overruns;       // releases skipped after an overrun
+
+    RtExecutor(double rateHz, int cpu_ = -1, int fifoPriority_ = 0, bool lockMemory_ = false)
+        : periodNs((long long)(1e9/rateHz)), cpu(cpu_), fifoPriority(fifoPriority_),
+          lockMemory(lockMemory_), overruns(0) {}
+
+    static long long now()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (long long)ts.tv_sec*1000000000LL + ts.tv_nsec;
+    }
+
+    static void sleepUntil(long long t)
+    {
+        timespec ts;
+        ts.tv_sec  = t / 1000000000LL;
+        ts.tv_nsec = t % 1000000000LL;
+#if defined(__linux__)
+        // returns the error number itself; only a signal is worth retrying
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+#else
+        // no absolute sleep on this platform; fall back to a relative one
+        long long dt = t - now();
+        if (dt > 0)
+        {
+            timespec rel;
+            rel.tv_sec  = dt / 1000000000LL;
+            rel.tv_nsec = dt % 1000000000LL;
+            nanosleep(&rel, NULL);
+        }
+#endif
+    }
+
+    // Applies pinning / scheduling / memory locking to the calling thread
+    void configureThread()
+    {
+#if defined(__linux__)
+        if (cpu >= 0)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+                std::cerr << "rt: could not pin to cpu " << cpu << "\n";
+        }
+        if (fifoPriority > 0)
+        {
+            sched_param sp;
+            sp.sched_priority = fifoPriority;
+            if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp) != 0)
+                std::cerr << "rt: could not set SCHED_FIFO priority " << fifoPriority << "\n";
+        }
+        if (lockMemory)
+        {
+            if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+                std::cerr << "rt: mlockall failed (" << strerror(errno) << ")\n";
+
+            // pre-fault a chunk of stack so the first cycles do not page fault
+            volatile char stack[256*1024];
+            memset((char*)stack, 0, sizeof(stack));
+        }
+#endif
+    }
+
+    // Runs fn() once per period for nCycles cycles
+    template<typename Fn>
+    void run(long nCycles, Fn fn)
+    {
+        cycles.clear();
+        cycles.reserve(nCycles);
+        overruns = 0;
+        configureThread();
+
+        long long release = now() + periodNs;
+        for (long k = 0; k < nCycles; k++)
+        {
+            sleepUntil(release);
+            long long wake = now();
+            fn();
+            long long end = now();
+
+            long long deadline = release + periodNs;
+            Cycle c = { wake - release, end - wake, end > deadline };
+            cycles.push_back(c);
+
+            // after an overrun, skip the releases that have already passed
+            release = deadline;
+            while (release < end)
+            {
+                release += periodNs;
+                overruns++;
+            }
+        }
+    }
+
+    // Prints exec time / jitter percentiles, misses and worst-case margin
+    void report(std::ostream &out) const
+    {
+        if (cycles.empty())
+            return;
+
+        std::vector<long long> exec, jitter;
+        long misses = 0;
+        for (size_t i = 0; i < cycles.size(); i++)
+        {
+            exec.push_back(cycles[i].execNs);
+            jitter.push_back(cycles[i].jitterNs);
+            misses += cycles[i].missed;
+        }
+        std::sort(exec.begin(), exec.end());
+        std::sort(jitter.begin(), jitter.end());
+
+        size_t n = cycles.size();
+        double periodUs = periodNs*1e-3;
+        out << "  period " << periodUs << " us, " << n << " cycles\n";
+        out << "  exec   p50/p99/max: " << exec[n/2]*1e-3 << " / "
+            << exec[size_t(n*0.99)]*1e-3 << " / " << exec.back()*1e-3 << " us\n";
+        out << "  jitter p50/p99/max: " << jitter[n/2]*1e-3 << " / "
+            << jitter[size_t(n*0.99)]*1e-3 << " / " << jitter.back()*1e-3 << " us\n";
+        out << "  deadline misses   : " << misses << " (" << overruns << " releases skipped)\n";
+        out << "  worst-case margin : "
+            << 100.0*(1.0 - (exec.back() + jitter.back())*1e-3/periodUs) << " % of period\n";
+    }
+};
+
+#endif
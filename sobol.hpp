@@ -0,0 +1,128 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Scrambled Sobol low-discrepancy sequence
+///
+///  Points of the Sobol sequence in up to SOBOL_MAX_DIMS dimensions, with
+///  Joe and Kuo's direction numbers (new-joe-kuo-6.21201). point(i) is
+///  computed directly from the Gray code of i, so any range of indices can
+///  be generated independently (per thread, shard or block).
+///
+///  With a nonzero seed every coordinate is Owen-scrambled (nested uniform
+///  scrambling, hashed per dimension as in Burley, "Practical Hash-based
+///  Owen Scrambling", 2020). A scrambled sequence keeps the stratification
+///  of the original, each point is uniform on [0,1)^d, and independently
+///  seeded replicates give unbiased estimates whose spread is an error
+///  estimate (randomised quasi-Monte Carlo).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _SOBOL_H_
+#define _SOBOL_H_
+
+
+#include <cstdint>
+
+
+#define SOBOL_MAX_DIMS  16
+#define SOBOL_BITS      32
+
+
+class SobolSequence
+{
+    public:
+
+    explicit SobolSequence(uint32_t seed_ = 0) : seed(seed_)
+    {
+        // degree s, coefficients a and initial m_1..m_s of dimensions 2..16
+        static const uint32_t table[SOBOL_MAX_DIMS - 1][8] = {
+            { 1,  0, 1 },
+            { 2,  1, 1, 3 },
+            { 3,  1, 1, 3, 1 },
+            { 3,  2, 1, 1, 1 },
+            { 4,  1, 1, 1, 3, 3 },
+            { 4,  4, 1, 3, 5, 13 },
+            { 5,  2, 1, 1, 5, 5, 17 },
+            { 5,  4, 1, 1, 5, 5, 5 },
+            { 5,  7, 1, 1, 7, 11, 19 },
+            { 5, 11, 1, 1, 5, 1, 1 },
+            { 5, 13, 1, 1, 1, 3, 11 },
+            { 5, 14, 1, 3, 5, 5, 31 },
+            { 6,  1, 1, 3, 3, 9, 7, 49 },
+            { 6, 13, 1, 1, 1, 15, 21, 21 },
+            { 6, 16, 1, 3, 1, 13, 27, 49 },
+        };
+
+        for (int i = 0; i < SOBOL_BITS; i++)
+            direction[0][i] = 1u << (SOBOL_BITS - 1 - i);
+        for (int d = 1; d < SOBOL_MAX_DIMS; d++)
+        {
+            uint32_t s = table[d - 1][0], a = table[d - 1][1];
+            uint32_t *v = direction[d];
+            for (uint32_t i = 0; i < s; i++)
+                v[i] = table[d - 1][2 + i] << (SOBOL_BITS - 1 - i);
+            for (uint32_t i = s; i < SOBOL_BITS; i++)
+            {
+                v[i] = v[i - s] ^ (v[i - s] >> s);
+                for (uint32_t k = 1; k < s; k++)
+                    v[i] ^= ((a >> (s - 1 - k)) & 1u)*v[i - k];
+            }
+        }
+    }
+
+    // Coordinate d of point index as a 32-bit fraction
+    uint32_t bits(uint32_t index, int d) const
+    {
+        uint32_t x = 0;
+        for (uint32_t gray = index ^ (index >> 1), i = 0; gray != 0; gray >>= 1, i++)
+            if (gray & 1u)
+                x ^= direction[d][i];
+        return seed == 0 ? x : scramble(x, hash(seed + 0x9E3779B9u*uint32_t(d + 1)));
+    }
+
+    // Coordinates 0..dims-1 of point index, each in (0, 1)
+    void point(uint32_t index, int dims, double *u) const
+    {
+        for (int d = 0; d < dims; d++)
+            u[d] = (double(bits(index, d)) + 0.5)*0x1.0p-32;
+    }
+
+    private:
+
+        uint32_t seed;
+        uint32_t direction[SOBOL_MAX_DIMS][SOBOL_BITS];
+
+    static uint32_t hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7FEB352Du;
+        x ^= x >> 15;
+        x *= 0x846CA68Bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    static uint32_t reverse(uint32_t x)
+    {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+        x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    // Nested uniform scramble: a Laine-Karras permutation on the reversed
+    // bits, where each bit only depends on the bits above it
+    static uint32_t scramble(uint32_t x, uint32_t s)
+    {
+        x = reverse(x);
+        x += s;
+        x ^= x*0x6C50B47Cu;
+        x ^= x*0xB82F1E52u;
+        x ^= x*0xC7AFE638u;
+        x ^= x*0x8D22F6E6u;
+        return reverse(x);
+    }
+};
+
+#endif
@@ -0,0 +1,110 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Bounded lock-free single-producer/single-consumer ring buffer
+///
+///  Used to connect pipeline stages running on separate threads. Exactly one
+///  thread may push and exactly one thread may pop. Items are moved in batches
+///  to amortise the atomic index updates.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+
+template<typename T>
+class SpscRing
+{
+    private:
+
+        std::vector<T>           buffer;
+        size_t                   mask;
+
+        // producer-owned cache line
+        alignas(64) std::atomic<size_t> head;   // next slot to write
+        size_t                   cachedTail;    // producer's view of tail
+
+        // consumer-owned cache line
+        alignas(64) std::atomic<size_t> tail;   // next slot to read
+        size_t                   cachedHead;    // consumer's view of head
+
+        alignas(64) std::atomic<bool> done;     // producer has finished
+
+    public:
+
+    // capacity is rounded up to the next power of two
+    explicit SpscRing(size_t capacity)
+        : mask(0), head(0), cachedTail(0), tail(0), cachedHead(0), done(false)
+    {
+        size_t n = 1;
+        while (n < capacity)
+            n <<= 1;
+        buffer.resize(n);
+        mask = n - 1;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    // number of items currently queued (approximate while both sides run)
+    size_t size() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    // Pushes up to n items; returns the number actually queued (0 when full)
+    size_t push(const T *items, size_t n)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        size_t free = capacity() - (h - cachedTail);
+        if (free < n)
+        {
+            cachedTail = tail.load(std::memory_order_acquire);
+            free = capacity() - (h - cachedTail);
+        }
+        if (n > free)
+            n = free;
+
+        for (size_t i = 0; i < n; i++)
+            buffer[(h + i) & mask] = items[i];
+
+        head.store(h + n, std::memory_order_release);
+        return n;
+    }
+
+    // Pops up to n items; returns the number actually dequeued (0 when empty)
+    size_t pop(T *items, size_t n)
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        size_t avail = cachedHead - t;
+        if (avail < n)
+        {
+            cachedHead = head.load(std::memory_order_acquire);
+            avail = cachedHead - t;
+        }
+        if (n > avail)
+            n = avail;
+
+        for (size_t i = 0; i < n; i++)
+            items[i] = buffer[(t + i) & mask];
+
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    // Producer signals that no more items will be pushed
+    void close() { done.store(true, std::memory_order_release); }
+
+    // True once the producer has closed the ring and every item was consumed
+    bool drained() const
+    {
+        return done.load(std::memory_order_acquire) && size() == 0;
+    }
+};
+
+#endif
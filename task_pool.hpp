@@ -0,0 +1,66 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Runs independent tasks on a fixed set of worker threads
+///
+///  TaskPool::run() starts `threads` workers that claim task indices from a
+///  shared atomic counter until none are left. Tasks are therefore started
+///  in index order and a worker that finishes early simply takes the next
+///  one: ordering the tasks longest first (e.g. largest file first) keeps a
+///  long task from starting last and leaving the other workers idle.
+///
+///  The worker number passed to each task (0 .. threads-1) indexes
+///  per-worker state such as scratch buffers or a Simulator.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _TASK_POOL_H_
+#define _TASK_POOL_H_
+
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+
+class TaskPool
+{
+    public:
+
+    typedef std::function<void(size_t task, unsigned worker)> Task;
+
+    // Worker count for a request of threads (0 = one per core), never more
+    // than there are tasks
+    static unsigned workers(size_t nTasks, unsigned threads)
+    {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        return unsigned(std::max<size_t>(1, std::min<size_t>(threads, nTasks)));
+    }
+
+    // Runs task(0) .. task(nTasks - 1) and returns once all have finished
+    static void run(size_t nTasks, unsigned threads, const Task &task)
+    {
+        threads = workers(nTasks, threads);
+        std::atomic<size_t> next(0);
+        auto work = [&](unsigned worker)
+        {
+            for (size_t i = next++; i < nTasks; i = next++)
+                task(i, worker);
+        };
+        if (threads == 1)
+        {
+            work(0);
+            return;
+        }
+        std::vector<std::thread> pool;
+        for (unsigned t = 0; t < threads; t++)
+            pool.push_back(std::thread(work, t));
+        for (unsigned t = 0; t < threads; t++)
+            pool[t].join();
+    }
+};
+
+#endif
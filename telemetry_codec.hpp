@@ -0,0 +1,378 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Lossless compression of float telemetry columns
+///
+///  A column is cut into blocks of BLOCK samples that decode independently,
+///  so any sample range can be read without touching the rest of the column.
+///
+///  Within a block the float bit patterns are differenced as integers, once
+///  (delta) or twice (delta-of-delta, which suits clock timestamps and
+///  slowly varying positions), whichever packs smaller. The residuals are
+///  zigzag coded and bit-packed MINI at a time, each miniblock with its own
+///  bit width (an exponent change only costs its own miniblock).
+///
+///  Miniblocks are packed "vertically" over four 32-bit lanes (as in
+///  SIMD-BP128): value i lives in lane i % 4, so unpacking is one shift/or/and
+///  per four values in SSE registers with no bit-by-bit stream parsing. The
+///  residuals are then summed back with SSE prefix sums (four lanes at a time).
+///
+///  Column layout, in 32-bit words:
+///    [0]                 number of blocks nb
+///    [1]                 reserved (0)
+///    [2 .. nb+2]         word offset of each block from the column start,
+///                        plus the end of the last block
+///    blocks              [count | order << 16] [head0] [head1] [MINIS/4 words:
+///                        miniblock widths, one byte each] [packed miniblocks]
+///
+///  head0/head1 hold the first two residuals, which are kept out of the
+///  packed data so the block's starting value does not widen miniblock 0.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _TELEMETRY_CODEC_H_
+#define _TELEMETRY_CODEC_H_
+
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+ #include <emmintrin.h>
+ #define TELEMETRY_CODEC_HAVE_SSE 1
+#endif
+
+
+class TelemetryCodec
+{
+    public:
+
+    enum
+    {
+        BLOCK       = 1024,         // samples per independently decodable block
+        MINI        = 128,          // samples per bit width
+        MINIS       = BLOCK / MINI,
+        BLOCK_HEAD  = 3 + MINIS/4   // words before the packed miniblocks
+    };
+
+    // Appends the encoding of v[0..n) to out
+    static void encode(const float *v, size_t n, std::vector<uint32_t> &out)
+    {
+        size_t nb = (n + BLOCK - 1) / BLOCK;
+        size_t col = out.size();
+        out.resize(col + 2 + nb + 1, 0);
+        out[col] = uint32_t(nb);
+
+        std::vector<uint32_t> z1(BLOCK), z2(BLOCK);
+        for (size_t b = 0; b < nb; b++)
+        {
+            out[col + 2 + b] = uint32_t(out.size() - col);
+            size_t count = std::min<size_t>(BLOCK, n - b*BLOCK);
+            encodeBlock(v + b*BLOCK, count, &z1[0], &z2[0], out);
+        }
+        out[col + 2 + nb] = uint32_t(out.size() - col);
+    }
+
+    static size_t blocks(const uint32_t *col)
+    {
+        return col[0];
+    }
+
+    // Size in bytes of the encoded column
+    static size_t bytes(const uint32_t *col)
+    {
+        return size_t(col[2 + col[0]])*sizeof(uint32_t);
+    }
+
+    // Checks an encoded column of `bytes` bytes holding nSamples samples
+    // before anything trusts its offsets: the block table, each block's
+    // bounds, sample count, order and miniblock widths
+    static bool valid(const uint32_t *col, size_t bytes, size_t nSamples)
+    {
+        size_t words = bytes / sizeof(uint32_t);
+        if (words < 3 || bytes % sizeof(uint32_t) != 0)
+            return false;
+        size_t nb = col[0];
+        if (nb != (nSamples + BLOCK - 1) / BLOCK || 2 + nb + 1 > words || col[2 + nb] != words)
+            return false;
+
+        for (size_t b = 0; b < nb; b++)
+        {
+            size_t start = col[2 + b], end = col[2 + b + 1];
+            if (start < 2 + nb + 1 || start + BLOCK_HEAD > end || end > words)
+                return false;
+            const uint32_t *p = col + start;
+            size_t   count = p[0] & 0xffff;
+            unsigned order = p[0] >> 16;
+            if (count != std::min<size_t>(BLOCK, nSamples - b*BLOCK) || (order != 1 && order != 2))
+                return false;
+
+            const unsigned char *width = reinterpret_cast<const unsigned char*>(p + 3);
+            size_t packed = 0;
+            for (size_t m = 0; m*MINI < count; m++)
+            {
+                if (width[m] > 32)
+                    return false;
+                packed += 4*width[m];
+            }
+            if (start + BLOCK_HEAD + packed > end)
+                return false;
+        }
+        return true;
+    }
+
+    // Samples in block b
+    static size_t blockCount(const uint32_t *col, size_t b)
+    {
+        return col[col[2 + b]] & 0xffff;
+    }
+
+    // First sample of block b, without decoding the block
+    static float firstValue(const uint32_t *col, size_t b)
+    {
+        uint32_t bits = unzigzag(col[col[2 + b] + 1]);
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    // Decodes block b into out; returns the number of samples
+    static size_t decodeBlock(const uint32_t *col, size_t b, float *out)
+    {
+        const uint32_t *p = col + col[2 + b];
+        size_t   count = std::min<size_t>(p[0] & 0xffff, BLOCK);
+        unsigned order = p[0] >> 16;
+        const unsigned char *width = reinterpret_cast<const unsigned char*>(p + 3);
+
+        alignas(16) uint32_t z[BLOCK];
+        const uint32_t *packed = p + BLOCK_HEAD;
+        for (size_t m = 0; m*MINI < count; m++)
+        {
+            unpackers().fn[std::min<unsigned>(width[m], 32)](packed, z + m*MINI);
+            packed += 4*width[m];
+        }
+        z[0] = p[1];
+        if (count > 1)
+            z[1] = p[2];
+
+        // undo the differencing, in unsigned (wrapping) arithmetic
+        unzigzagSum(z, count);
+        if (order == 2)
+            prefixSum(z, count);
+        memcpy(out, z, count*sizeof(float));
+        return count;
+    }
+
+    // Decodes samples [first, first + count) of the column into out
+    static void decode(const uint32_t *col, size_t first, size_t count, float *out)
+    {
+        thread_local std::vector<float> tmp(BLOCK);
+        size_t last = first + count;
+        for (size_t b = first / BLOCK; b*BLOCK < last; b++)
+        {
+            size_t b0 = b*BLOCK, b1 = std::min(last, b0 + blockCount(col, b));
+            if (b0 >= first && b1 == b0 + blockCount(col, b))
+                decodeBlock(col, b, out + (b0 - first));
+            else
+            {
+                decodeBlock(col, b, &tmp[0]);
+                size_t s = std::max(first, b0);
+                std::copy(&tmp[0] + (s - b0), &tmp[0] + (b1 - b0), out + (s - first));
+            }
+        }
+    }
+
+    private:
+
+    static inline uint32_t zigzag(uint32_t r)   { return (r << 1) ^ uint32_t(int32_t(r) >> 31); }
+    static inline uint32_t unzigzag(uint32_t z) { return (z >> 1) ^ (0u - (z & 1)); }
+
+    // z[i] = unzigzag(z[0]) + ... + unzigzag(z[i])
+    static void unzigzagSum(uint32_t *z, size_t n)
+    {
+        size_t i = 0;
+#if defined(TELEMETRY_CODEC_HAVE_SSE)
+        const __m128i one = _mm_set1_epi32(1);
+        __m128i carry = _mm_setzero_si128();
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(z + i));
+            x = _mm_xor_si128(_mm_srli_epi32(x, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(x, one)));
+            carry = scan(x, carry);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(z + i), carry);
+            carry = _mm_shuffle_epi32(carry, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+        uint32_t acc = uint32_t(_mm_cvtsi128_si32(carry));
+#else
+        uint32_t acc = 0;
+#endif
+        for (; i < n; i++)
+            z[i] = (acc += unzigzag(z[i]));
+    }
+
+    // z[i] = z[0] + ... + z[i]
+    static void prefixSum(uint32_t *z, size_t n)
+    {
+        size_t i = 0;
+#if defined(TELEMETRY_CODEC_HAVE_SSE)
+        __m128i carry = _mm_setzero_si128();
+        for (; i + 4 <= n; i += 4)
+        {
+            carry = scan(_mm_loadu_si128(reinterpret_cast<const __m128i*>(z + i)), carry);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(z + i), carry);
+            carry = _mm_shuffle_epi32(carry, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+        uint32_t acc = uint32_t(_mm_cvtsi128_si32(carry));
+#else
+        uint32_t acc = 0;
+#endif
+        for (; i < n; i++)
+            z[i] = (acc += z[i]);
+    }
+
+#if defined(TELEMETRY_CODEC_HAVE_SSE)
+    // Inclusive scan of the four lanes of x plus carry (broadcast total so far)
+    static inline __m128i scan(__m128i x, __m128i carry)
+    {
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        return _mm_add_epi32(x, carry);
+    }
+#endif
+
+    static unsigned bitWidth(uint32_t x)
+    {
+        return x == 0 ? 0 : 32 - __builtin_clz(x);
+    }
+
+    // 32-bit words the residuals z[0..count) pack into, z[0..2) excluded
+    static size_t packedWords(const uint32_t *z, size_t count, unsigned char *width)
+    {
+        size_t words = 0;
+        for (size_t m = 0; m*MINI < count; m++)
+        {
+            uint32_t any = 0;
+            for (size_t i = std::max<size_t>(m*MINI, 2); i < std::min(count, (m + 1)*MINI); i++)
+                any |= z[i];
+            width[m] = (unsigned char)bitWidth(any);
+            words += 4*width[m];
+        }
+        return words;
+    }
+
+    static void encodeBlock(const float *v, size_t count, uint32_t *z1, uint32_t *z2,
+                            std::vector<uint32_t> &out)
+    {
+        // first and second integer differences of the bit patterns, zigzagged
+        uint32_t prev = 0, prevD = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t bits;
+            memcpy(&bits, &v[i], sizeof(bits));
+            uint32_t d = bits - prev;
+            z1[i] = zigzag(d);
+            z2[i] = zigzag(d - prevD);
+            prev  = bits;
+            prevD = d;
+        }
+
+        unsigned char w1[MINIS] = {}, w2[MINIS] = {};
+        size_t n1 = packedWords(z1, count, w1), n2 = packedWords(z2, count, w2);
+        unsigned order = n2 < n1 ? 2 : 1;
+        const uint32_t      *z     = order == 2 ? z2 : z1;
+        const unsigned char *width = order == 2 ? w2 : w1;
+
+        size_t head = out.size();
+        out.resize(head + BLOCK_HEAD + (order == 2 ? n2 : n1), 0);
+        out[head]     = uint32_t(count) | (order << 16);
+        out[head + 1] = z[0];
+        out[head + 2] = count > 1 ? z[1] : 0;
+        memcpy(&out[head + 3], width, MINIS);
+
+        uint32_t *packed = &out[head + BLOCK_HEAD];
+        uint32_t mini[MINI];
+        for (size_t m = 0; m*MINI < count; m++)
+        {
+            for (size_t i = 0; i < MINI; i++)
+            {
+                size_t k = m*MINI + i;
+                mini[i] = (k < 2 || k >= count) ? 0 : z[k];
+            }
+            pack(mini, width[m], packed);
+            packed += 4*width[m];
+        }
+    }
+
+    // Vertical layout: value 4k + j goes to lane j at bit k*w of that lane
+    static void pack(const uint32_t *in, unsigned w, uint32_t *out)
+    {
+        for (unsigned k = 0; k < MINI/4 && w > 0; k++)
+        {
+            unsigned p = k*w, r = p >> 5, off = p & 31;
+            for (unsigned j = 0; j < 4; j++)
+            {
+                uint32_t x = in[4*k + j];
+                out[4*r + j] |= x << off;
+                if (off + w > 32)
+                    out[4*(r + 1) + j] |= x >> (32 - off);
+            }
+        }
+    }
+
+    template<unsigned W>
+    static void unpack(const uint32_t *in, uint32_t *out)
+    {
+        if (W == 0)
+        {
+            memset(out, 0, MINI*sizeof(uint32_t));
+            return;
+        }
+        const uint32_t mask = W == 32 ? 0xffffffffu : (1u << (W & 31)) - 1;
+#if defined(TELEMETRY_CODEC_HAVE_SSE)
+        const __m128i vmask = _mm_set1_epi32(int(mask));
+#pragma GCC unroll 32
+        for (unsigned k = 0; k < MINI/4; k++)
+        {
+            const unsigned p = k*W, r = p >> 5, off = p & 31;
+            __m128i x = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 4*r)), off);
+            if (off + W > 32)
+                x = _mm_or_si128(x, _mm_slli_epi32(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 4*(r + 1))), 32 - off));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4*k), _mm_and_si128(x, vmask));
+        }
+#else
+        for (unsigned k = 0; k < MINI/4; k++)
+        {
+            const unsigned p = k*W, r = p >> 5, off = p & 31;
+            for (unsigned j = 0; j < 4; j++)
+            {
+                uint32_t x = in[4*r + j] >> off;
+                if (off + W > 32)
+                    x |= in[4*(r + 1) + j] << (32 - off);
+                out[4*k + j] = x & mask;
+            }
+        }
+#endif
+    }
+
+    // unpack<W> for every width, indexed by W
+    struct Unpackers
+    {
+        typedef void (*Fn)(const uint32_t*, uint32_t*);
+        Fn fn[33];
+
+        template<size_t... W>
+        explicit Unpackers(std::index_sequence<W...>) : fn{ &unpack<W>... } {}
+    };
+
+    static const Unpackers& unpackers()
+    {
+        static const Unpackers table(std::make_index_sequence<33>{});
+        return table;
+    }
+};
+
+#endif
@@ -0,0 +1,359 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Fast CSV export and import of float telemetry columns
+///
+///  write() formats rows straight into one large preallocated buffer per
+///  chunk of rows (std::to_chars, no streams, no locale) and hands each
+///  chunk to the kernel with a single write(). With several threads, each
+///  formats its own chunks and the chunks are written in row order.
+///
+///  Values are either the shortest text that reads back to the same float
+///  (precision < 0, lossless) or fixed-point with `precision` decimals, which
+///  is formatted as a scaled, rounded integer and is about twice as fast
+///  (like printf "%.*f", except that -0.000 is written as 0.000).
+///
+///  read() maps the file, splits the rows into per-thread byte ranges at
+///  line boundaries and parses them with a float fast path (integer
+///  mantissa <= 2^24 and at most 10 decimals, exact in one float division)
+///  that falls back to std::from_chars, so values round trip exactly.
+///
+///  The first line holds the column names. Rows are comma separated and end
+///  with '\n' (a '\r' before it is accepted).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _TELEMETRY_CSV_H_
+#define _TELEMETRY_CSV_H_
+
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+class TelemetryCsv
+{
+    public:
+
+    // Writes n rows of the columns to filename; threads = 0 uses one per core
+    static bool write(const std::string &filename, const std::vector<std::string> &names,
+                      const std::vector<const float*> &columns, size_t n,
+                      int precision = -1, unsigned threads = 1, size_t chunkRows = 8192)
+    {
+        if (names.size() != columns.size() || columns.empty() || precision > 9)
+            return false;
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        size_t nChunks = (n + chunkRows - 1) / chunkRows;
+        threads = unsigned(std::max<size_t>(1, std::min<size_t>(threads, nChunks)));
+
+        int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+
+        std::string head;
+        for (size_t k = 0; k < names.size(); k++)
+            head += (k > 0 ? "," : "") + names[k];
+        head += "\n";
+        bool ok = writeAll(fd, head.data(), head.size());
+
+        // one buffer per thread, sized for the longest possible chunk
+        size_t rowBytes = columns.size()*(valueChars(precision) + 1);
+        std::vector<std::vector<char> > buffer(threads, std::vector<char>(chunkRows*rowBytes));
+        std::vector<size_t> used(threads);
+
+        for (size_t c = 0; c < nChunks && ok; c += threads)
+        {
+            size_t batch = std::min<size_t>(threads, nChunks - c);
+            if (batch == 1)
+                used[0] = format(columns, c*chunkRows, std::min(n, (c + 1)*chunkRows), precision, &buffer[0][0]);
+            else
+            {
+                std::vector<std::thread> pool;
+                for (size_t t = 0; t < batch; t++)
+                {
+                    pool.push_back(std::thread([&, t]() {
+                        size_t first = (c + t)*chunkRows, last = std::min(n, first + chunkRows);
+                        used[t] = format(columns, first, last, precision, &buffer[t][0]);
+                    }));
+                }
+                for (size_t t = 0; t < batch; t++)
+                    pool[t].join();
+            }
+            for (size_t t = 0; t < batch && ok; t++)
+                ok = writeAll(fd, &buffer[t][0], used[t]);
+        }
+        return (::close(fd) == 0) && ok;
+    }
+
+    // Reads filename into one vector per column; threads = 0 uses one per core
+    static bool read(const std::string &filename, std::vector<std::string> &names,
+                     std::vector<std::vector<float> > &columns, unsigned threads, std::string &error)
+    {
+        names.clear();
+        columns.clear();
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            error = "cannot open " + filename;
+            return false;
+        }
+        struct stat st;
+        void *p = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+            p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+        {
+            error = "cannot map " + filename;
+            return false;
+        }
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+
+        const char *begin = static_cast<const char*>(p), *end = begin + st.st_size;
+        const char *body = std::find(begin, end, '\n');
+        std::string head(begin, body);
+        if (!head.empty() && head.back() == '\r')
+            head.pop_back();
+        for (size_t s = 0, e; s <= head.size(); s = e + 1)
+        {
+            e = std::min(head.find(',', s), head.size());
+            names.push_back(head.substr(s, e - s));
+        }
+        if (body < end)
+            body++;
+        size_t nCols = names.size();
+
+        // per-thread row ranges, cut at line ends
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        if (size_t(end - body) < size_t(threads)*(1 << 20))
+            threads = unsigned(std::max<size_t>(1, (end - body) >> 20));
+        std::vector<const char*> cut(threads + 1, end);
+        cut[0] = body;
+        for (unsigned t = 1; t < threads; t++)
+        {
+            const char *q = std::max(cut[t - 1], body + (end - body)*t/threads);
+            q = std::find(q, end, '\n');
+            cut[t] = q < end ? q + 1 : end;
+        }
+
+        std::vector<std::vector<std::vector<float> > > part(threads, std::vector<std::vector<float> >(nCols));
+        std::vector<const char*> bad(threads, (const char*)NULL);
+        if (threads == 1)
+            bad[0] = parse(cut[0], cut[1], part[0]);
+        else
+        {
+            std::vector<std::thread> pool;
+            for (unsigned t = 0; t < threads; t++)
+                pool.push_back(std::thread([&, t]() { bad[t] = parse(cut[t], cut[t + 1], part[t]); }));
+            for (unsigned t = 0; t < threads; t++)
+                pool[t].join();
+        }
+
+        for (unsigned t = 0; t < threads; t++)
+        {
+            if (bad[t] != NULL)
+            {
+                error = filename + ": malformed row at byte " + std::to_string(bad[t] - begin);
+                munmap(p, st.st_size);
+                return false;
+            }
+        }
+
+        columns.resize(nCols);
+        for (size_t k = 0; k < nCols; k++)
+        {
+            if (threads == 1)
+            {
+                columns[k].swap(part[0][k]);
+                continue;
+            }
+            size_t total = 0;
+            for (unsigned t = 0; t < threads; t++)
+                total += part[t][k].size();
+            columns[k].reserve(total);
+            for (unsigned t = 0; t < threads; t++)
+                columns[k].insert(columns[k].end(), part[t][k].begin(), part[t][k].end());
+        }
+        munmap(p, st.st_size);
+        return true;
+    }
+
+    // Formats x into p (at least valueChars(precision) bytes); returns the end
+    static inline char* formatValue(char *p, float x, int precision)
+    {
+        if (precision < 0)
+            return std::to_chars(p, p + 16, x).ptr;
+
+        static const double scale[10] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+        static const char pairs[201] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+
+        double a = std::fabs(double(x))*scale[precision];
+        if (!(a < 4.0e15))      // too large for the integer path, or not finite
+            return std::to_chars(p, p + valueChars(precision), x, std::chars_format::fixed, precision).ptr;
+
+        // round half to even without a libm call: 2^52 has no fraction bits
+        uint64_t u = uint64_t((a + 4503599627370496.0) - 4503599627370496.0);
+        if (std::signbit(x) && u != 0)
+            *p++ = '-';
+
+        // all digits of the scaled integer, two at a time from the end
+        char digits[24], *end = digits + sizeof(digits), *q = end;
+        for (; u >= 100; u /= 100)
+        {
+            q -= 2;
+            memcpy(q, pairs + 2*(u % 100), 2);
+        }
+        if (u >= 10)
+        {
+            q -= 2;
+            memcpy(q, pairs + 2*u, 2);
+        }
+        else
+            *--q = char('0' + u);
+
+        // then the decimal point precision digits from the end
+        int len = int(end - q);
+        if (len <= precision)
+        {
+            *p++ = '0';
+            *p++ = '.';
+            memset(p, '0', precision - len);
+            p += precision - len;
+            memcpy(p, q, len);
+            return p + len;
+        }
+        memcpy(p, q, len - precision);
+        p += len - precision;
+        if (precision > 0)
+        {
+            *p++ = '.';
+            memcpy(p, q + len - precision, precision);
+            p += precision;
+        }
+        return p;
+    }
+
+    // Parses one float from [p, end); returns the end of the number or NULL
+    static inline const char* parseValue(const char *p, const char *end, float &x)
+    {
+        static const float pow10[11] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+        const char *q = p;
+        bool neg = q < end && *q == '-';
+        q += neg;
+        uint32_t m = 0;
+        int digits = 0, decimals = 0;
+        for (; q < end && unsigned(*q - '0') < 10; q++, digits++)
+            m = m*10 + (*q - '0');
+        if (q < end && *q == '.')
+        {
+            for (q++; q < end && unsigned(*q - '0') < 10; q++, digits++, decimals++)
+                m = m*10 + (*q - '0');
+        }
+        // exact: m and 10^decimals are floats, one correctly rounded division
+        if (digits > 0 && digits <= 7 + (m <= (1u << 24)) && decimals <= 10 &&
+            (q == end || (*q != 'e' && *q != 'E')))
+        {
+            x = float(m) / pow10[decimals];
+            if (neg)
+                x = -x;
+            return q;
+        }
+        std::from_chars_result r = std::from_chars(p, end, x);
+        return r.ec == std::errc() ? r.ptr : NULL;
+    }
+
+    private:
+
+    // Longest text formatValue() can produce
+    static size_t valueChars(int precision)
+    {
+        return precision < 0 ? 16 : 41 + precision;
+    }
+
+    static size_t format(const std::vector<const float*> &columns, size_t first, size_t last,
+                         int precision, char *out)
+    {
+        char *p = out;
+        size_t nCols = columns.size();
+        for (size_t i = first; i < last; i++)
+        {
+            for (size_t k = 0; k < nCols; k++)
+            {
+                p = formatValue(p, columns[k][i], precision);
+                *p++ = ',';
+            }
+            p[-1] = '\n';
+        }
+        return p - out;
+    }
+
+    // Parses whole rows in [p, end); returns NULL or where parsing failed
+    static const char* parse(const char *p, const char *end, std::vector<std::vector<float> > &columns)
+    {
+        size_t nCols = columns.size();
+        size_t guess = (end - p) / (nCols*8 + 1);
+        for (size_t k = 0; k < nCols; k++)
+            columns[k].reserve(guess);
+
+        while (p < end)
+        {
+            if (*p == '\n')     // blank line
+            {
+                p++;
+                continue;
+            }
+            for (size_t k = 0; k < nCols; k++)
+            {
+                float x;
+                const char *q = parseValue(p, end, x);
+                if (q == NULL)
+                    return p;
+                columns[k].push_back(x);
+                p = q;
+                if (k + 1 < nCols)
+                {
+                    if (p == end || *p != ',')
+                        return p;
+                    p++;
+                }
+            }
+            if (p < end && *p == '\r')
+                p++;
+            if (p < end && *p != '\n')
+                return p;
+            p++;
+        }
+        return NULL;
+    }
+
+    static bool writeAll(int fd, const char *p, size_t n)
+    {
+        while (n > 0)
+        {
+            ssize_t k = ::write(fd, p, n);
+            if (k <= 0)
+                return false;
+            p += k;
+            n -= size_t(k);
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,453 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Memory-mappable columnar telemetry file
+///
+///  Layout:
+///   - a fixed TELEMETRY_HEADER_SIZE byte header: magic, version, sample
+///     count and rate, the column schema (name + byte offset) and named
+///     double parameters (e.g. the Simulator configuration),
+///   - one float32 block per column, each starting on a TELEMETRY_ALIGN
+///     byte boundary, samples stored contiguously (column-major).
+///
+///  TelemetryWriter emits the whole file with a single writev() straight
+///  from the callers' arrays (or, for files larger than memory, chunk by
+///  chunk with writeStreamed()). TelemetryFile mmaps a file read-only and hands
+///  out Eigen::Map views of the columns: no parsing and no copy, and any
+///  sample can be reached by time without reading the rest of the file.
+///
+///  Columns can instead be stored compressed (TELEMETRY_PACKED, see
+///  telemetry_codec.hpp); those are read through read(), which decodes only
+///  the blocks covering the requested range.
+///
+///  Files are written in the host byte order (little-endian on every target
+///  of this project). Version 1 files (raw columns only) are still read.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _TELEMETRY_FILE_H_
+#define _TELEMETRY_FILE_H_
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <Eigen/Core>
+
+#include "telemetry_codec.hpp"
+
+
+#define TELEMETRY_MAGIC         "CSTELEM"
+#define TELEMETRY_VERSION       2
+#define TELEMETRY_MAX_COLUMNS   32
+#define TELEMETRY_MAX_PARAMS    32
+#define TELEMETRY_NAME_LEN      24
+#define TELEMETRY_ALIGN         64
+#define TELEMETRY_HEADER_SIZE   4096
+
+
+// Column encodings
+enum TelemetryEncoding
+{
+    TELEMETRY_RAW    = 0,   // float32 samples, mappable as is
+    TELEMETRY_PACKED = 1    // TelemetryCodec blocks
+};
+
+
+struct TelemetryHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t headerSize;                    // bytes before the first column block
+    uint32_t nColumns;
+    uint32_t nParams;
+    uint64_t nSamples;
+    double   sampleRate;                    // Hz
+    uint64_t columnOffset[TELEMETRY_MAX_COLUMNS];   // from the start of the file
+    char     columnName[TELEMETRY_MAX_COLUMNS][TELEMETRY_NAME_LEN];
+    char     paramName[TELEMETRY_MAX_PARAMS][TELEMETRY_NAME_LEN];
+    double   paramValue[TELEMETRY_MAX_PARAMS];
+    // version 2; zero (raw) in version 1 files
+    uint32_t columnEncoding[TELEMETRY_MAX_COLUMNS];
+    uint64_t columnBytes[TELEMETRY_MAX_COLUMNS];    // stored size of each block
+};
+static_assert(sizeof(TelemetryHeader) <= TELEMETRY_HEADER_SIZE, "header does not fit");
+
+
+// A column of the mapped file; blocks are TELEMETRY_ALIGN aligned
+typedef Eigen::Map<const Eigen::VectorXf, Eigen::Aligned64> TelemetryColumn;
+
+
+class TelemetryWriter
+{
+    public:
+
+    explicit TelemetryWriter(double sampleRate)
+    {
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, TELEMETRY_MAGIC, sizeof(TELEMETRY_MAGIC));
+        hdr.version    = TELEMETRY_VERSION;
+        hdr.headerSize = TELEMETRY_HEADER_SIZE;
+        hdr.sampleRate = sampleRate;
+    }
+
+    // Returns false when the table is full or the name too long
+    bool addParam(const std::string &name, double value)
+    {
+        if (hdr.nParams == TELEMETRY_MAX_PARAMS || name.size() >= TELEMETRY_NAME_LEN)
+            return false;
+        strcpy(hdr.paramName[hdr.nParams], name.c_str());
+        hdr.paramValue[hdr.nParams++] = value;
+        return true;
+    }
+
+    // data must stay valid until write(); raw columns are not copied
+    bool addColumn(const std::string &name, const float *data,
+                   TelemetryEncoding encoding = TELEMETRY_RAW)
+    {
+        if (hdr.nColumns == TELEMETRY_MAX_COLUMNS || name.size() >= TELEMETRY_NAME_LEN)
+            return false;
+        hdr.columnEncoding[hdr.nColumns] = encoding;
+        strcpy(hdr.columnName[hdr.nColumns++], name.c_str());
+        columns.push_back(data);
+        return true;
+    }
+
+    // Writes header and the first nSamples of every column with writev()
+    bool write(const std::string &filename, size_t nSamples)
+    {
+        static const char zeros[TELEMETRY_HEADER_SIZE] = {};
+
+        // compressed columns are encoded up front
+        std::vector<std::vector<uint32_t> > packed(hdr.nColumns);
+        hdr.nSamples = nSamples;
+        uint64_t offset = TELEMETRY_HEADER_SIZE;
+        for (uint32_t k = 0; k < hdr.nColumns; k++)
+        {
+            if (hdr.columnEncoding[k] == TELEMETRY_PACKED)
+            {
+                TelemetryCodec::encode(columns[k], nSamples, packed[k]);
+                hdr.columnBytes[k] = packed[k].size()*sizeof(uint32_t);
+            }
+            else
+                hdr.columnBytes[k] = nSamples*sizeof(float);
+            hdr.columnOffset[k] = offset;
+            offset += hdr.columnBytes[k] + padding(hdr.columnBytes[k]);
+        }
+
+        std::vector<iovec> iov;
+        addIov(iov, &hdr, sizeof(hdr));
+        addIov(iov, zeros, TELEMETRY_HEADER_SIZE - sizeof(hdr));
+        for (uint32_t k = 0; k < hdr.nColumns; k++)
+        {
+            const void *data = hdr.columnEncoding[k] == TELEMETRY_PACKED ?
+                               (const void*)&packed[k][0] : (const void*)columns[k];
+            addIov(iov, data, hdr.columnBytes[k]);
+            addIov(iov, zeros, padding(hdr.columnBytes[k]));
+        }
+
+        int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        bool ok = writevAll(fd, &iov[0], iov.size());
+        return (::close(fd) == 0) && ok;
+    }
+
+    // Fills rows [first, first + count) of every column: columns[k][0..count)
+    typedef std::function<void(size_t first, size_t count, float *const *columns)> Fill;
+
+    // Writes a file too large to hold in memory: fill() is called for
+    // consecutive chunks of rows and each column's part is written in place
+    // with pwrite(). Raw columns only (the data pointers given to addColumn
+    // are ignored); memory use is one chunk of rows.
+    bool writeStreamed(const std::string &filename, size_t nSamples, const Fill &fill,
+                       size_t chunkRows = 1 << 18)
+    {
+        static const char zeros[TELEMETRY_ALIGN] = {};
+
+        hdr.nSamples = nSamples;
+        uint64_t offset = TELEMETRY_HEADER_SIZE;
+        for (uint32_t k = 0; k < hdr.nColumns; k++)
+        {
+            if (hdr.columnEncoding[k] != TELEMETRY_RAW)
+                return false;
+            hdr.columnBytes[k]  = nSamples*sizeof(float);
+            hdr.columnOffset[k] = offset;
+            offset += hdr.columnBytes[k] + padding(hdr.columnBytes[k]);
+        }
+
+        int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        std::vector<char> head(TELEMETRY_HEADER_SIZE, 0);
+        memcpy(&head[0], &hdr, sizeof(hdr));
+        bool ok = pwriteAll(fd, &head[0], head.size(), 0);
+
+        std::vector<std::vector<float> > chunk(hdr.nColumns, std::vector<float>(chunkRows));
+        std::vector<float*> rows(hdr.nColumns);
+        for (uint32_t k = 0; k < hdr.nColumns; k++)
+            rows[k] = &chunk[k][0];
+        for (size_t first = 0; first < nSamples && ok; first += chunkRows)
+        {
+            size_t count = std::min(chunkRows, nSamples - first);
+            fill(first, count, &rows[0]);
+            for (uint32_t k = 0; k < hdr.nColumns && ok; k++)
+                ok = pwriteAll(fd, rows[k], count*sizeof(float), hdr.columnOffset[k] + first*sizeof(float));
+        }
+        for (uint32_t k = 0; k < hdr.nColumns && ok; k++)
+            ok = pwriteAll(fd, zeros, padding(hdr.columnBytes[k]), hdr.columnOffset[k] + hdr.columnBytes[k]);
+        return (::close(fd) == 0) && ok;
+    }
+
+    private:
+
+        TelemetryHeader             hdr;
+        std::vector<const float*>   columns;
+
+    static bool pwriteAll(int fd, const void *p, size_t n, uint64_t offset)
+    {
+        const char *c = static_cast<const char*>(p);
+        while (n > 0)
+        {
+            ssize_t k = ::pwrite(fd, c, n, off_t(offset));
+            if (k <= 0)
+                return false;
+            c      += k;
+            n      -= size_t(k);
+            offset += uint64_t(k);
+        }
+        return true;
+    }
+
+    // Repeats writev() after short writes, skipping the buffers already written
+    static bool writevAll(int fd, iovec *iov, size_t count)
+    {
+        while (count > 0)
+        {
+            ssize_t k = ::writev(fd, iov, int(count));
+            if (k <= 0)
+                return false;
+            size_t done = size_t(k);
+            while (count > 0 && done >= iov->iov_len)
+            {
+                done -= iov->iov_len;
+                iov++;
+                count--;
+            }
+            if (count > 0)
+            {
+                iov->iov_base = static_cast<char*>(iov->iov_base) + done;
+                iov->iov_len -= done;
+            }
+        }
+        return true;
+    }
+
+    static size_t padding(size_t bytes)
+    {
+        return (TELEMETRY_ALIGN - bytes % TELEMETRY_ALIGN) % TELEMETRY_ALIGN;
+    }
+
+    static void addIov(std::vector<iovec> &iov, const void *p, size_t n)
+    {
+        if (n == 0)
+            return;
+        iovec v;
+        v.iov_base = const_cast<void*>(p);
+        v.iov_len  = n;
+        iov.push_back(v);
+    }
+};
+
+
+class TelemetryFile
+{
+    public:
+
+        std::string     error;      // why open() failed
+
+    TelemetryFile() : base(NULL), length(0), hdr(NULL) {}
+    ~TelemetryFile() { close(); }
+
+    TelemetryFile(const TelemetryFile&) = delete;
+    TelemetryFile& operator=(const TelemetryFile&) = delete;
+
+    // Maps filename read-only and checks the header and column bounds
+    bool open(const std::string &filename)
+    {
+        close();
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return fail("cannot open " + filename);
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < TELEMETRY_HEADER_SIZE)
+        {
+            ::close(fd);
+            return fail(filename + " is too small for a telemetry header");
+        }
+
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+            return fail("cannot map " + filename);
+        base   = static_cast<const char*>(p);
+        length = st.st_size;
+        hdr    = reinterpret_cast<const TelemetryHeader*>(base);
+
+        if (memcmp(hdr->magic, TELEMETRY_MAGIC, sizeof(TELEMETRY_MAGIC)) != 0 ||
+            hdr->version < 1 || hdr->version > TELEMETRY_VERSION)
+            return fail(filename + " is not a version 1-" + std::to_string(TELEMETRY_VERSION) + " telemetry file");
+        if (hdr->nColumns > TELEMETRY_MAX_COLUMNS || hdr->nParams > TELEMETRY_MAX_PARAMS ||
+            hdr->nSamples / TelemetryCodec::BLOCK > length)
+            return fail(filename + " has a corrupt header");
+        for (uint32_t k = 0; k < hdr->nColumns; k++)
+        {
+            size_t bytes = encoding(k) == TELEMETRY_RAW ? hdr->nSamples*sizeof(float) : hdr->columnBytes[k];
+            if (encoding(k) > TELEMETRY_PACKED || hdr->columnOffset[k] % TELEMETRY_ALIGN != 0 ||
+                bytes > length || hdr->columnOffset[k] > length - bytes)
+                return fail(filename + " is truncated");
+            if (encoding(k) == TELEMETRY_PACKED && !TelemetryCodec::valid(packed(k), bytes, hdr->nSamples))
+                return fail(filename + " has a corrupt compressed column");
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (base != NULL)
+            munmap(const_cast<char*>(base), length);
+        base   = NULL;
+        length = 0;
+        hdr    = NULL;
+    }
+
+    bool                   isOpen()  const { return hdr != NULL; }
+    const TelemetryHeader& header()  const { return *hdr; }
+    size_t                 samples() const { return hdr->nSamples; }
+    int                    columns() const { return int(hdr->nColumns); }
+
+    // Column index by name, -1 when absent
+    int columnIndex(const std::string &name) const
+    {
+        for (uint32_t k = 0; k < hdr->nColumns; k++)
+            if (name == hdr->columnName[k])
+                return int(k);
+        return -1;
+    }
+
+    TelemetryEncoding encoding(int k) const
+    {
+        return hdr->version < 2 ? TELEMETRY_RAW : TelemetryEncoding(hdr->columnEncoding[k]);
+    }
+
+    // Bytes column k occupies in the file (without alignment padding)
+    size_t storedBytes(int k) const
+    {
+        return encoding(k) == TELEMETRY_RAW ? hdr->nSamples*sizeof(float) : hdr->columnBytes[k];
+    }
+
+    // Samples of a raw column
+    const float* data(int k) const
+    {
+        return reinterpret_cast<const float*>(base + hdr->columnOffset[k]);
+    }
+
+    // Encoded words of a packed column
+    const uint32_t* packed(int k) const
+    {
+        return reinterpret_cast<const uint32_t*>(base + hdr->columnOffset[k]);
+    }
+
+    // Zero-copy view of a raw column
+    TelemetryColumn column(int k) const
+    {
+        return TelemetryColumn(data(k), Eigen::Index(hdr->nSamples));
+    }
+
+    // Copies samples [first, first + count) of any column into out,
+    // decoding only the blocks involved for packed columns
+    void read(int k, size_t first, size_t count, float *out) const
+    {
+        if (encoding(k) == TELEMETRY_PACKED)
+            TelemetryCodec::decode(packed(k), first, count, out);
+        else
+            memcpy(out, data(k) + first, count*sizeof(float));
+    }
+
+    // Value of a named parameter, or fallback when absent
+    double param(const std::string &name, double fallback = 0.0) const
+    {
+        for (uint32_t k = 0; k < hdr->nParams; k++)
+            if (name == hdr->paramName[k])
+                return hdr->paramValue[k];
+        return fallback;
+    }
+
+    // Index of the first sample at or after time t in the (ascending) time
+    // column; samples() when t is past the end
+    size_t indexAt(double t, int timeColumn = 0) const
+    {
+        size_t n = hdr->nSamples;
+        if (n == 0)
+            return 0;
+        if (encoding(timeColumn) == TELEMETRY_PACKED)
+            return packedIndexAt(t, timeColumn);
+
+        const float *time = data(timeColumn);
+
+        // uniform sampling: guess from the rate, then correct locally
+        size_t guess = size_t(std::max(0.0, std::ceil((t - time[0]) * hdr->sampleRate)));
+        if (guess < n && time[guess] >= t && (guess == 0 || time[guess - 1] < t))
+            return guess;
+        return std::lower_bound(time, time + n, float(t)) - time;
+    }
+
+    private:
+
+        const char             *base;
+        size_t                  length;
+        const TelemetryHeader  *hdr;
+
+    // indexAt() on a packed time column: find the block from the block
+    // start values, then search the decoded block
+    size_t packedIndexAt(double t, int timeColumn) const
+    {
+        const uint32_t *col = packed(timeColumn);
+        size_t lo = 0, hi = TelemetryCodec::blocks(col);     // first block starting at or after t
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            if (TelemetryCodec::firstValue(col, mid) < float(t))
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo == 0)
+            return 0;
+
+        thread_local std::vector<float> time(TelemetryCodec::BLOCK);
+        size_t count = TelemetryCodec::decodeBlock(col, lo - 1, &time[0]);
+        return (lo - 1)*TelemetryCodec::BLOCK + (std::lower_bound(&time[0], &time[0] + count, float(t)) - &time[0]);
+    }
+
+    bool fail(const std::string &why)
+    {
+        close();
+        error = why;
+        return false;
+    }
+};
+
+#endif
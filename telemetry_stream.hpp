@@ -0,0 +1,263 @@
+////////////////////////////////////////////////////////////////////////////////
+///
+///  \brief Out-of-core chunked reader for TelemetryFile logs
+///
+///  TelemetryStream reads selected raw columns of a TelemetryFile of any
+///  length in chunks of rows, in constant memory: two chunk buffers, filled
+///  alternately by a read-ahead thread with pread() while the caller works
+///  on the other one (double buffering). Nothing is mapped, and the pages
+///  just read are dropped from the page cache (POSIX_FADV_DONTNEED), so
+///  neither the process nor the cache grows with the log.
+///
+///  next() hands out the rows of the following chunk as one pointer per
+///  selected column, valid until the next call. Compressed columns are not
+///  supported (TelemetryFile::read() decodes those by range).
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef _TELEMETRY_STREAM_H_
+#define _TELEMETRY_STREAM_H_
+
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "telemetry_file.hpp"
+
+
+class TelemetryStream
+{
+    public:
+
+        std::string     error;      // why open() or next() failed
+
+    TelemetryStream() : fd(-1), chunkRows(0), nextRow(0), current(-1), stop(false), done(false), bytes(0) {}
+    ~TelemetryStream() { close(); }
+
+    TelemetryStream(const TelemetryStream&) = delete;
+    TelemetryStream& operator=(const TelemetryStream&) = delete;
+
+    // Opens filename for the named columns (in that order) and starts
+    // reading ahead; chunkRows is the size of each of the two buffers
+    bool open(const std::string &filename, const std::vector<std::string> &names,
+              size_t chunkRows_ = 1 << 16, bool dropBehind_ = true)
+    {
+        close();
+        error.clear();
+        fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return fail("cannot open " + filename);
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < TELEMETRY_HEADER_SIZE ||
+            pread(fd, &hdr, sizeof(hdr), 0) != ssize_t(sizeof(hdr)))
+            return fail(filename + " is too small for a telemetry header");
+        if (memcmp(hdr.magic, TELEMETRY_MAGIC, sizeof(TELEMETRY_MAGIC)) != 0 ||
+            hdr.version < 1 || hdr.version > TELEMETRY_VERSION ||
+            hdr.nColumns > TELEMETRY_MAX_COLUMNS || hdr.nParams > TELEMETRY_MAX_PARAMS)
+            return fail(filename + " is not a version 1-" + std::to_string(TELEMETRY_VERSION) + " telemetry file");
+
+        for (const std::string &name : names)
+        {
+            int k = columnIndex(name);
+            if (k < 0)
+                return fail(filename + " has no column " + name);
+            if (hdr.version >= 2 && hdr.columnEncoding[k] != TELEMETRY_RAW)
+                return fail(filename + ": column " + name + " is compressed");
+            if (hdr.columnOffset[k] + hdr.nSamples*sizeof(float) > uint64_t(st.st_size))
+                return fail(filename + " is truncated");
+            offset.push_back(hdr.columnOffset[k]);
+        }
+
+        chunkRows  = std::max<size_t>(1, chunkRows_);
+        dropBehind = dropBehind_;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        for (int b = 0; b < 2; b++)
+        {
+            chunk[b].data.resize(chunkRows*offset.size());
+            chunk[b].full = false;
+            chunk[b].count = 0;
+        }
+        nextRow = 0;
+        current = -1;
+        stop    = false;
+        done    = false;
+        bytes   = 0;
+        reader  = std::thread(&TelemetryStream::readAhead, this);
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        if (reader.joinable())
+            reader.join();
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+        offset.clear();
+    }
+
+    const TelemetryHeader& header()  const { return hdr; }
+    size_t                 samples() const { return hdr.nSamples; }
+
+    // Column index by name, -1 when absent
+    int columnIndex(const std::string &name) const
+    {
+        for (uint32_t k = 0; k < hdr.nColumns; k++)
+            if (strncmp(hdr.columnName[k], name.c_str(), TELEMETRY_NAME_LEN) == 0)
+                return int(k);
+        return -1;
+    }
+
+    // Stored parameter by name, fallback when absent
+    double param(const std::string &name, double fallback = 0.0) const
+    {
+        for (uint32_t k = 0; k < hdr.nParams; k++)
+            if (strncmp(hdr.paramName[k], name.c_str(), TELEMETRY_NAME_LEN) == 0)
+                return hdr.paramValue[k];
+        return fallback;
+    }
+
+    // Column bytes read from the file so far
+    uint64_t bytesRead() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return bytes;
+    }
+
+    // Waits for the next chunk; columns[k] then points at its rows of the
+    // k-th selected column. Returns the number of rows, 0 at the end of the
+    // log or on a read error (error set)
+    size_t next(std::vector<const float*> &columns)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (current >= 0)
+        {
+            chunk[current].full = false;    // hand the buffer back to the reader
+            wake.notify_all();
+        }
+        int b = current < 0 ? 0 : 1 - current;
+        wake.wait(lock, [&] { return chunk[b].full || done || stop; });
+        if (!chunk[b].full)
+        {
+            current = -1;
+            return 0;
+        }
+        current = b;
+        columns.resize(offset.size());
+        for (size_t k = 0; k < offset.size(); k++)
+            columns[k] = &chunk[b].data[k*chunkRows];
+        return chunk[b].count;
+    }
+
+    private:
+
+    struct Chunk
+    {
+        std::vector<float>  data;       // chunkRows per selected column
+        size_t              count;      // rows held
+        bool                full;       // filled, not yet handed back
+    };
+
+        int                     fd;
+        TelemetryHeader         hdr;
+        std::vector<uint64_t>   offset;     // file offset of each selected column
+        size_t                  chunkRows;
+        bool                    dropBehind;
+        size_t                  nextRow;    // first row of the next chunk to read (reader)
+        Chunk                   chunk[2];
+        int                     current;    // buffer held by the caller, -1 for none
+
+        mutable std::mutex      mutex;
+        std::condition_variable wake;
+        bool                    stop;
+        bool                    done;       // reader finished (end of log or error)
+        uint64_t                bytes;
+        std::thread             reader;     // last: starts once the rest is built
+
+    void readAhead()
+    {
+        for (int b = 0; nextRow < hdr.nSamples; b = 1 - b)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return !chunk[b].full || stop; });
+                if (stop)
+                    return;
+            }
+
+            // the buffer is the reader's until it is marked full
+            size_t count = std::min<size_t>(chunkRows, hdr.nSamples - nextRow);
+            bool ok = true;
+            for (size_t k = 0; k < offset.size() && ok; k++)
+            {
+                uint64_t at = offset[k] + nextRow*sizeof(float);
+                ok = preadAll(reinterpret_cast<char*>(&chunk[b].data[k*chunkRows]), count*sizeof(float), at);
+                if (dropBehind)
+                    posix_fadvise(fd, off_t(at), off_t(count*sizeof(float)), POSIX_FADV_DONTNEED);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!ok)
+                {
+                    done = true;
+                    error = "read error at row " + std::to_string(nextRow);
+                }
+                else
+                {
+                    chunk[b].count = count;
+                    chunk[b].full  = true;
+                    bytes += count*sizeof(float)*offset.size();
+                }
+            }
+            wake.notify_all();
+            if (!ok)
+                return;
+            nextRow += count;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;        // end of the log: nothing more will be filled
+        wake.notify_all();
+    }
+
+    bool preadAll(char *p, size_t n, uint64_t at)
+    {
+        while (n > 0)
+        {
+            ssize_t k = pread(fd, p, n, off_t(at));
+            if (k <= 0)
+                return false;
+            p  += k;
+            n  -= size_t(k);
+            at += uint64_t(k);
+        }
+        return true;
+    }
+
+    bool fail(const std::string &why)
+    {
+        close();
+        error = why;
+        return false;
+    }
+};
+
+#endif